@@ -44,7 +44,7 @@ void ComputeExample::OnAttach()
 	Renderer::Initialize(graph);
 
 	std::vector<uint32_t> computeBuffer(BufferElements);
-	m_ComputeBuffer->ReadData(computeBuffer.data(), BufferElements);
+	m_ComputeBuffer->ReadData(computeBuffer.data(), BufferElements * sizeof(uint32_t));
 
 	HG_INFO("Before fibonacci stage");
 	for (int i = 0; i < computeBuffer.size(); i++)
@@ -57,9 +57,12 @@ void ComputeExample::OnDetach()
 {
 	HG_PROFILE_FUNCTION()
 
+	// The stage may run on the async compute queue, make sure it is done before reading back
+	GraphicsContext::WaitIdle();
+
 	std::vector<uint32_t> computeBuffer(BufferElements);
 	HG_INFO("After fibonacci stage");
-	m_ComputeBuffer->ReadData(computeBuffer.data(), BufferElements);
+	m_ComputeBuffer->ReadData(computeBuffer.data(), BufferElements * sizeof(uint32_t));
 	for (int i = 0; i < computeBuffer.size(); i++)
 	{
 		HG_TRACE("computeBuffer[{0}] = {1}", i, computeBuffer[i]);
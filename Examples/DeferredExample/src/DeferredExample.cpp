@@ -18,7 +18,7 @@ void DeferredExample::OnAttach()
 	HG_PROFILE_FUNCTION();
 	CVarSystem::Get()->SetIntCVar("application.enableImGui", 0);
 	CVarSystem::Get()->SetIntCVar("renderer.enableMipMapping", 1);
-	CVarSystem::Get()->SetStringCVar("shader.compilation.macros", "MATERIAL_ARRAY_SIZE=128;TEXTURE_ARRAY_SIZE=512;LIGHT_ARRAY_SIZE=32");
+	CVarSystem::Get()->SetStringCVar("shader.compilation.macros", "LIGHT_ARRAY_SIZE=32");
 
 	ShaderCache::Initialize();
 	GraphicsContext::Initialize();
@@ -39,9 +39,8 @@ void DeferredExample::OnAttach()
 
 	Ref<Texture> colorAttachment = Texture::Create(Image::Create(ImageDescription::Defaults::SampledHDRColorAttachment, 1));
 
-	m_ViewProjection = Buffer::Create(BufferDescription::Defaults::UniformBuffer, sizeof(glm::mat4));
-	m_LightViewProjection = Buffer::Create(BufferDescription::Defaults::UniformBuffer, sizeof(glm::mat4));
 	uint32_t lightCount = m_Lights.size();
+	int32_t materialBuffer = m_MaterialBuffer->GetGPUIndex();
 
 	RenderGraph graph;
 
@@ -58,17 +57,17 @@ void DeferredExample::OnAttach()
 			{DataType::Defaults::Float2, "a_TexCoords"},
 			{DataType::Defaults::Float3, "a_Normal"},
 			{DataType::Defaults::Float4, "a_Tangent"},
-			{DataType::Defaults::Int, "a_MaterialIndex"},
 		},
 		{
-			{"u_ViewProjection", ResourceType::Uniform, ShaderType::Defaults::Vertex, m_LightViewProjection, 0, 0},
-			{"p_Model", ResourceType::PushConstant, ShaderType::Defaults::Vertex, sizeof(PushConstant), &m_PushConstant},
+			{"u_ViewProjection", ResourceType::FrameUniform, ShaderType::Defaults::Vertex, sizeof(glm::mat4), &m_LightViewProjectionMatrix, 0, 0},
+			{"p_InstanceBuffer", ResourceType::PushConstant, ShaderType::Defaults::Vertex, sizeof(int32_t), nullptr},
 		},
 		m_OpaqueMeshes,
 		{
-			{"Shadow Map", AttachmentType::Depth, shadowMap->GetImage(), true, {ImageLayout::DepthStencilAttachmentOptimal, ImageLayout::ShaderReadOnlyOptimal}},
+			{"Shadow Map", AttachmentType::Depth, shadowMap->GetImage(), true},
 		},
 	});
+	shadowPass->StageInfo.CullingViewProjection = &m_LightViewProjectionMatrix;
 
 	auto gbuffer = graph.AddStage(shadowPass, {
 		"GBuffer", RendererStageType::ForwardGraphics,
@@ -83,26 +82,21 @@ void DeferredExample::OnAttach()
 			{DataType::Defaults::Float2, "a_TexCoords"},
 			{DataType::Defaults::Float3, "a_Normal"},
 			{DataType::Defaults::Float4, "a_Tangent"},
-			{DataType::Defaults::Int, "a_MaterialIndex"},
 		},
 		{
-			{"u_ViewProjection", ResourceType::Uniform, ShaderType::Defaults::Vertex, m_ViewProjection, 0, 0},
-			{"u_Materials", ResourceType::Uniform, ShaderType::Defaults::Fragment, m_MaterialBuffer, 0, 1},
-			//{"u_Textures", ResourceType::SamplerArray, ShaderType::Defaults::Fragment, m_Textures, 0, 2, 512},
-			{"p_Model", ResourceType::PushConstant, ShaderType::Defaults::Vertex, sizeof(PushConstant), &m_PushConstant},
+			{"u_ViewProjection", ResourceType::FrameUniform, ShaderType::Defaults::Vertex, sizeof(glm::mat4), &m_ViewProjectionMatrix, 0, 0},
+			{"c_MaterialBuffer", ResourceType::Constant, ShaderType::Defaults::Fragment, 0, sizeof(int32_t), &materialBuffer},
+			{"p_InstanceBuffer", ResourceType::PushConstant, ShaderType::Defaults::Vertex, sizeof(int32_t), nullptr},
 		},
 		m_OpaqueMeshes,
 		{
-			{"Position", AttachmentType::Color, positionAttachment->GetImage(), true, 
-				{ImageLayout::ColorAttachmentOptimal, ImageLayout::ShaderReadOnlyOptimal}},
-			{"Normal", AttachmentType::Color, normalAttachment->GetImage(), true, 
-				{ImageLayout::ColorAttachmentOptimal, ImageLayout::ShaderReadOnlyOptimal}},
-			{"Albedo", AttachmentType::Color, albedoAttachment->GetImage(), true, 
-				{ImageLayout::ColorAttachmentOptimal, ImageLayout::ShaderReadOnlyOptimal}},
-			{"Depth", AttachmentType::Depth, depthAttachment->GetImage(), true,
-				{ImageLayout::DepthStencilAttachmentOptimal, ImageLayout::DepthStencilAttachmentOptimal}},
+			{"Position", AttachmentType::Color, positionAttachment->GetImage(), true},
+			{"Normal", AttachmentType::Color, normalAttachment->GetImage(), true},
+			{"Albedo", AttachmentType::Color, albedoAttachment->GetImage(), true},
+			{"Depth", AttachmentType::Depth, depthAttachment->GetImage(), true},
 		},
 	});
+	gbuffer->StageInfo.CullingViewProjection = &m_ViewProjectionMatrix;
 
 	auto defferedShade = graph.AddStage(gbuffer, {
 		"Deffered Shade", RendererStageType::ScreenSpacePass, GraphicsPipeline::Create({
@@ -113,14 +107,14 @@ void DeferredExample::OnAttach()
 			}
 		),
 		{
-			{"u_Position", ResourceType::Sampler, ShaderType::Defaults::Fragment, positionAttachment, 0, 0},
-			{"u_Normal", ResourceType::Sampler, ShaderType::Defaults::Fragment, normalAttachment, 0, 1},
-			{"u_Albedo", ResourceType::Sampler, ShaderType::Defaults::Fragment, albedoAttachment, 0, 2},
+			{"u_Position", ResourceType::InputAttachment, ShaderType::Defaults::Fragment, positionAttachment, 0, 0},
+			{"u_Normal", ResourceType::InputAttachment, ShaderType::Defaults::Fragment, normalAttachment, 0, 1},
+			{"u_Albedo", ResourceType::InputAttachment, ShaderType::Defaults::Fragment, albedoAttachment, 0, 2},
 			{"u_Lights", ResourceType::Uniform, ShaderType::Defaults::Fragment, m_LightBuffer, 0, 3},
 			{"c_LightCount", ResourceType::Constant, ShaderType::Defaults::Fragment, 0, sizeof(uint32_t), &lightCount},
 		},
 		{
-			{"Color", AttachmentType::Color, colorAttachment->GetImage(), true, {ImageLayout::ColorAttachmentOptimal, ImageLayout::ShaderReadOnlyOptimal}},
+			{"Color", AttachmentType::Color, colorAttachment->GetImage(), true},
 		},
 	});
 
@@ -137,11 +131,8 @@ void DeferredExample::OnAttach()
 				}
 			}
 		),
-		{{"FinalRender", ResourceType::Sampler, ShaderType::Defaults::Fragment, colorAttachment, 0, 0, {
-				PipelineStage::ColorAttachmentOutput, AccessFlag::ColorAttachmentWrite,
-				PipelineStage::FragmentShader, AccessFlag::ShaderSampledRead,
-		}},},
-		{{"SwapchainImage", AttachmentType::Swapchain, true, {ImageLayout::ColorAttachmentOptimal, ImageLayout::PresentSrcKHR}},},
+		{{"FinalRender", ResourceType::Sampler, ShaderType::Defaults::Fragment, colorAttachment, 0, 0},},
+		{{"SwapchainImage", AttachmentType::Swapchain, true},},
 	});
 
 	// Renderer::EnableDebugPasses(true);
@@ -165,8 +156,6 @@ void DeferredExample::OnDetach()
 	m_Lights.clear();
 	m_MaterialBuffer.reset();
 	m_LightBuffer.reset();
-	m_ViewProjection.reset();
-	m_LightViewProjection.reset(); 
 
 	GraphicsContext::Deinitialize();
 }
@@ -176,15 +165,12 @@ void DeferredExample::OnUpdate(Timestep ts)
 	HG_PROFILE_FUNCTION();
 
 	float nearPlane = 1.0f, farPlane = 50.0f;
-	glm::mat4 lightViewProj = glm::ortho(-50.0f, 50.0f, -50.0f, 50.0f, nearPlane, farPlane)
+	m_LightViewProjectionMatrix = glm::ortho(-50.0f, 50.0f, -50.0f, 50.0f, nearPlane, farPlane)
 		* glm::lookAt(m_Lights[0]->GetLightData().Position, Math::Vector3::Zero, Math::Vector3::Up);
-	m_LightViewProjection->WriteData(&lightViewProj, sizeof(lightViewProj));
 
 	m_EditorCamera.OnUpdate(ts);
 	//glm::mat4 viewProj = m_EditorCamera.GetViewProjection();
-	glm::mat4 viewProj = m_Cameras["Camera.006"].GetViewProjection();
-
-	m_ViewProjection->WriteData(&viewProj, sizeof(viewProj));
+	m_ViewProjectionMatrix = m_Cameras["Camera.006"].GetViewProjection();
 }
 
 void DeferredExample::OnImGuiRender()
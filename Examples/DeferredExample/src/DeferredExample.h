@@ -7,11 +7,6 @@ using namespace Hog;
 class DeferredExample : public Layer
 {
 public:
-	struct PushConstant
-	{
-		glm::mat4 Model;
-	};
-
 	DeferredExample();
 	virtual ~DeferredExample() = default;
 
@@ -31,8 +26,8 @@ private:
 	std::vector<Ref<Material>> m_Materials;
 	std::vector<Ref<Light>> m_Lights;
 	Ref<Buffer> m_MaterialBuffer;
-	Ref<Buffer> m_ViewProjection;
-	Ref<Buffer> m_LightViewProjection;
+	// Copied into the frame uniforms of the shadow and geometry passes every frame, which are culled against them as well
+	glm::mat4 m_ViewProjectionMatrix = glm::mat4(1.0f);
+	glm::mat4 m_LightViewProjectionMatrix = glm::mat4(1.0f);
 	Ref<Buffer> m_LightBuffer;
-	PushConstant m_PushConstant;
 };
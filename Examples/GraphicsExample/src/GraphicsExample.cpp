@@ -17,8 +17,6 @@ void GraphicsExample::OnAttach()
 	HG_PROFILE_FUNCTION();
 	CVarSystem::Get()->SetIntCVar("application.enableImGui", 0);
 	CVarSystem::Get()->SetIntCVar("renderer.enableMipMapping", 1);
-	CVarSystem::Get()->SetStringCVar("shader.compilation.macros", "MATERIAL_ARRAY_SIZE=128;TEXTURE_ARRAY_SIZE=512");
-	CVarSystem::Get()->SetIntCVar("material.array.size", 128);
 
 	ShaderCache::Initialize();
 	GraphicsContext::Initialize();
@@ -31,7 +29,7 @@ void GraphicsExample::OnAttach()
 	Ref<Image> depthAttachment = Image::Create(ImageDescription::Defaults::Depth, 1);
 	Ref<Texture> colorAttachmentTexture = Texture::Create(colorAttachment);
 
-	m_ViewProjection = Buffer::Create(BufferDescription::Defaults::UniformBuffer, sizeof(glm::mat4));
+	int32_t materialBuffer = m_MaterialBuffer->GetGPUIndex();
 
 	RenderGraph graph;
 	auto graphics = graph.AddStage(nullptr, {
@@ -44,20 +42,19 @@ void GraphicsExample::OnAttach()
 			{DataType::Defaults::Float2, "a_TexCoords"},
 			{DataType::Defaults::Float3, "a_Normal"},
 			{DataType::Defaults::Float4, "a_Tangent"},
-			{DataType::Defaults::Int, "a_MaterialIndex"},
 		},
 		{
-			{"u_ViewProjection", ResourceType::Uniform, ShaderType::Defaults::Vertex, m_ViewProjection, 0, 0},
-			{"u_Materials", ResourceType::Uniform, ShaderType::Defaults::Fragment, m_MaterialBuffer, 0, 1},
-			{"u_Textures", ResourceType::SamplerArray, ShaderType::Defaults::Fragment, m_Textures, 0, 2, 512},
-			{"p_Model", ResourceType::PushConstant, ShaderType::Defaults::Vertex, sizeof(PushConstant), &m_PushConstant},
+			{"u_ViewProjection", ResourceType::FrameUniform, ShaderType::Defaults::Vertex, sizeof(glm::mat4), &m_ViewProjectionMatrix, 0, 0},
+			{"c_MaterialBuffer", ResourceType::Constant, ShaderType::Defaults::Fragment, 0, sizeof(int32_t), &materialBuffer},
+			{"p_InstanceBuffer", ResourceType::PushConstant, ShaderType::Defaults::Vertex, sizeof(int32_t), nullptr},
 		},
 		m_OpaqueMeshes,
 		{
-			{"Color", AttachmentType::Color, colorAttachment, true, {ImageLayout::ColorAttachmentOptimal, ImageLayout::ColorAttachmentOptimal}},
-			{"Depth", AttachmentType::Depth, depthAttachment, true, {ImageLayout::DepthStencilAttachmentOptimal, ImageLayout::DepthStencilAttachmentOptimal}},
+			{"Color", AttachmentType::Color, colorAttachment, true},
+			{"Depth", AttachmentType::Depth, depthAttachment, true},
 		},
 	});
+	graphics->StageInfo.CullingViewProjection = &m_ViewProjectionMatrix;
 
 	auto transparentGraphics = graph.AddStage(graphics, {
 		"ForwardGraphics", RendererStageType::ForwardGraphics, 
@@ -69,29 +66,24 @@ void GraphicsExample::OnAttach()
 			{DataType::Defaults::Float2, "a_TexCoords"},
 			{DataType::Defaults::Float3, "a_Normal"},
 			{DataType::Defaults::Float4, "a_Tangent"},
-			{DataType::Defaults::Int, "a_MaterialIndex"},
 		},
 		{
-			{"u_ViewProjection", ResourceType::Uniform, ShaderType::Defaults::Vertex, m_ViewProjection, 0, 0},
-			{"u_Materials", ResourceType::Uniform, ShaderType::Defaults::Fragment, m_MaterialBuffer, 0, 1},
-			{"u_Textures", ResourceType::SamplerArray, ShaderType::Defaults::Fragment, m_Textures, 0, 2, 512},
-			{"p_Model", ResourceType::PushConstant, ShaderType::Defaults::Vertex, sizeof(PushConstant), &m_PushConstant},
+			{"u_ViewProjection", ResourceType::FrameUniform, ShaderType::Defaults::Vertex, sizeof(glm::mat4), &m_ViewProjectionMatrix, 0, 0},
+			{"c_MaterialBuffer", ResourceType::Constant, ShaderType::Defaults::Fragment, 0, sizeof(int32_t), &materialBuffer},
+			{"p_InstanceBuffer", ResourceType::PushConstant, ShaderType::Defaults::Vertex, sizeof(int32_t), nullptr},
 		},
 		m_TransparentMeshes,
 		{
-			{"Color", AttachmentType::Color, colorAttachment, false, {ImageLayout::ColorAttachmentOptimal, ImageLayout::ShaderReadOnlyOptimal}},
-			{"Depth", AttachmentType::Depth, depthAttachment, true, {ImageLayout::DepthStencilAttachmentOptimal, ImageLayout::DepthStencilAttachmentOptimal}},
+			{"Color", AttachmentType::Color, colorAttachment, false},
+			{"Depth", AttachmentType::Depth, depthAttachment, true},
 		},
 	});
+	transparentGraphics->StageInfo.CullingViewProjection = &m_ViewProjectionMatrix;
+	transparentGraphics->StageInfo.SortBackToFront = true;
 
 	//auto imGuiStage = graph.AddStage(graphics, {
 	//	"ImGuiStage", RendererStageType::ImGui, {
-	//		{"ColorTarget", AttachmentType::Color, colorAttachment, false, {
-	//			PipelineStage::ColorAttachmentOutput, AccessFlag::ColorAttachmentWrite,
-	//			PipelineStage::ColorAttachmentOutput, AccessFlag::ColorAttachmentRead,
-	//			ImageLayout::ColorAttachmentOptimal,
-	//			ImageLayout::ShaderReadOnlyOptimal
-	//		}},
+	//		{"ColorTarget", AttachmentType::Color, colorAttachment, false},
 	//	}
 	//});
 
@@ -109,12 +101,9 @@ void GraphicsExample::OnAttach()
 			},
 		}),
 		{
-			{"FinalRender", ResourceType::Sampler, ShaderType::Defaults::Fragment, colorAttachmentTexture, 0, 0, {
-				PipelineStage::ColorAttachmentOutput, AccessFlag::ColorAttachmentWrite,
-				PipelineStage::FragmentShader, AccessFlag::ShaderSampledRead,
-			}},
+			{"FinalRender", ResourceType::Sampler, ShaderType::Defaults::Fragment, colorAttachmentTexture, 0, 0},
 		},
-		{{"SwapchainImage", AttachmentType::Swapchain, true, {ImageLayout::ColorAttachmentOptimal, ImageLayout::PresentSrcKHR}},},
+		{{"SwapchainImage", AttachmentType::Swapchain, true},},
 	});
 
 	Renderer::Initialize(graph);
@@ -137,7 +126,6 @@ void GraphicsExample::OnDetach()
 	m_Lights.clear();
 	m_MaterialBuffer.reset();
 	m_LightBuffer.reset();
-	m_ViewProjection.reset();
 
 	GraphicsContext::Deinitialize();
 }
@@ -147,8 +135,7 @@ void GraphicsExample::OnUpdate(Timestep ts)
 	HG_PROFILE_FUNCTION();
 
 	m_EditorCamera.OnUpdate(ts);
-	glm::mat4 viewProj = m_Cameras.begin()->second.GetViewProjection();
-	m_ViewProjection->WriteData(&viewProj, sizeof(viewProj));
+	m_ViewProjectionMatrix = m_Cameras.begin()->second.GetViewProjection();
 }
 
 void GraphicsExample::OnImGuiRender()
@@ -7,11 +7,6 @@ using namespace Hog;
 class GraphicsExample : public Layer
 {
 public:
-	struct PushConstant
-	{
-		glm::mat4 Model;
-	};
-
 	GraphicsExample();
 	virtual ~GraphicsExample() = default;
 
@@ -31,7 +26,7 @@ private:
 	std::vector<Ref<Material>> m_Materials;
 	std::vector<Ref<Light>> m_Lights;
 	Ref<Buffer> m_MaterialBuffer;
-	Ref<Buffer> m_ViewProjection;
+	// Copied into the frame uniforms of both passes every frame, which are culled against it as well
+	glm::mat4 m_ViewProjectionMatrix = glm::mat4(1.0f);
 	Ref<Buffer> m_LightBuffer;
-	PushConstant m_PushConstant;
 };
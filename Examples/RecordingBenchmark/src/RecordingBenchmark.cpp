@@ -0,0 +1,195 @@
+#include "RecordingBenchmark.h"
+
+#include <thread>
+#include <glm/gtc/matrix_transform.hpp>
+
+constexpr uint32_t GridSize = 32;
+constexpr uint32_t DrawsPerMesh = 16;
+constexpr uint32_t WarmupFrames = 32;
+constexpr uint32_t MeasuredFrames = 256;
+
+static Ref<Mesh> CreateCube(UploadBatch& batch, const glm::vec3& position)
+{
+	std::vector<Vertex> vertices(8);
+	for (uint32_t i = 0; i < 8; i++)
+	{
+		vertices[i].Position = { (i & 1) ? 0.5f : -0.5f, (i & 2) ? 0.5f : -0.5f, (i & 4) ? 0.5f : -0.5f };
+	}
+
+	std::vector<uint16_t> indices = {
+		0, 2, 1, 1, 2, 3,
+		4, 5, 6, 5, 7, 6,
+		0, 1, 4, 1, 5, 4,
+		2, 6, 3, 3, 6, 7,
+		0, 4, 2, 2, 4, 6,
+		1, 3, 5, 3, 7, 5,
+	};
+
+	Ref<Mesh> mesh = Mesh::Create("Cube");
+	mesh->AddPrimitive(vertices, indices);
+	mesh->Build(batch);
+	mesh->SetModelMatrix(glm::translate(glm::mat4(1.0f), position));
+
+	return mesh;
+}
+
+RecordingBenchmark::RecordingBenchmark()
+	: Layer("RecordingBenchmark")
+{
+
+}
+
+void RecordingBenchmark::OnAttach()
+{
+	HG_PROFILE_FUNCTION();
+	CVarSystem::Get()->SetIntCVar("application.enableImGui", 0);
+
+	ShaderCache::Initialize();
+	GraphicsContext::Initialize();
+
+	// Every mesh is drawn several times so the stage has enough draws to split into many recording jobs
+	std::vector<Ref<Mesh>> cubes;
+	UploadBatch batch;
+	for (uint32_t x = 0; x < GridSize; x++)
+	{
+		for (uint32_t z = 0; z < GridSize; z++)
+		{
+			cubes.push_back(CreateCube(batch, { x * 2.0f - GridSize, 0.0f, z * 2.0f - GridSize }));
+		}
+	}
+
+	batch.Submit();
+
+	for (uint32_t i = 0; i < DrawsPerMesh; i++)
+	{
+		m_Meshes.insert(m_Meshes.end(), cubes.begin(), cubes.end());
+	}
+
+	Ref<Texture> depthAttachment = Texture::Create(Image::Create(ImageDescription::Defaults::ShadowMap, 1, static_cast<VkFormat>(DataType::Defaults::Depth32)));
+
+	m_ViewProjection = Buffer::Create(BufferDescription::Defaults::UniformBuffer, sizeof(glm::mat4));
+	VkExtent2D extent = GraphicsContext::GetExtent();
+	glm::mat4 viewProj = glm::perspective(glm::radians(60.0f), extent.width / (float)extent.height, 0.1f, 200.0f)
+		* glm::lookAt(glm::vec3(0.0f, 40.0f, 40.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	m_ViewProjection->WriteData(&viewProj, sizeof(viewProj));
+
+	RenderGraph graph;
+
+	auto depthPass = graph.AddStage(nullptr, {
+		"Depth Pass", RendererStageType::ForwardGraphics, GraphicsPipeline::Create({
+				.Shaders = {"Shadow.vertex", "Shadow.fragment"},
+				.Rasterizer = {
+					.CullMode = CullMode::Back,
+				}
+			}
+		),
+		{
+			{DataType::Defaults::Float3, "a_Position"},
+			{DataType::Defaults::Float2, "a_TexCoords"},
+			{DataType::Defaults::Float3, "a_Normal"},
+			{DataType::Defaults::Float4, "a_Tangent"},
+		},
+		{
+			{"u_ViewProjection", ResourceType::Uniform, ShaderType::Defaults::Vertex, m_ViewProjection, 0, 0},
+			{"p_InstanceBuffer", ResourceType::PushConstant, ShaderType::Defaults::Vertex, sizeof(int32_t), nullptr},
+		},
+		m_Meshes,
+		{
+			{"Depth", AttachmentType::Depth, depthAttachment->GetImage(), true},
+		},
+	});
+
+	graph.AddStage(depthPass, {
+		"BlitStage", RendererStageType::Blit, GraphicsPipeline::Create({
+				.Shaders = {"fullscreen.vertex", "blit.fragment"},
+				.Rasterizer = {
+					.CullMode = CullMode::Front,
+				},
+				.BlendAttachments = {
+					{
+						.Enable = false
+					}
+				}
+			}
+		),
+		{{"FinalRender", ResourceType::Sampler, ShaderType::Defaults::Fragment, depthAttachment, 0, 0},},
+		{{"SwapchainImage", AttachmentType::Swapchain, true},},
+	});
+
+	m_MaxThreadCount = std::max(1u, std::thread::hardware_concurrency());
+	StartRun(1);
+
+	Renderer::Initialize(graph);
+
+	HG_INFO("Recording {} draws on 1 to {} threads, {} draws per job",
+		m_Meshes.size(), m_MaxThreadCount, *CVarSystem::Get()->GetIntCVar("renderer.meshesPerRecordingJob"));
+}
+
+void RecordingBenchmark::OnDetach()
+{
+	HG_PROFILE_FUNCTION()
+
+	GraphicsContext::WaitIdle();
+
+	Renderer::Cleanup();
+
+	m_Meshes.clear();
+	m_ViewProjection.reset();
+
+	GraphicsContext::Deinitialize();
+}
+
+void RecordingBenchmark::OnUpdate(Timestep ts)
+{
+	HG_PROFILE_FUNCTION();
+
+	if (m_ThreadCount > m_MaxThreadCount) return;
+
+	// The stats describe the frame drawn after the previous update
+	if (m_Frame++ < WarmupFrames) return;
+
+	m_Samples.push_back(Renderer::GetStats().RecordingTime);
+	if (m_Samples.size() < MeasuredFrames) return;
+
+	float total = 0.0f;
+	for (float sample : m_Samples)
+	{
+		total += sample;
+	}
+
+	m_Results.push_back({ m_ThreadCount, total / m_Samples.size(), *std::min_element(m_Samples.begin(), m_Samples.end()) });
+
+	if (m_ThreadCount == m_MaxThreadCount)
+	{
+		m_ThreadCount++;
+		ReportResults();
+		Application::Get().Close();
+		return;
+	}
+
+	StartRun(m_ThreadCount + 1);
+}
+
+void RecordingBenchmark::OnImGuiRender()
+{
+}
+
+void RecordingBenchmark::StartRun(uint32_t threadCount)
+{
+	m_ThreadCount = threadCount;
+	m_Frame = 0;
+	m_Samples.clear();
+
+	CVarSystem::Get()->SetIntCVar("renderer.recordingThreads", threadCount);
+}
+
+void RecordingBenchmark::ReportResults()
+{
+	const float baseline = m_Results.front().Average;
+
+	for (const auto& result : m_Results)
+	{
+		HG_INFO("{:2} threads: recording avg {:.3f} ms, min {:.3f} ms, speedup {:.2f}x",
+			result.ThreadCount, result.Average, result.Min, baseline / result.Average);
+	}
+}
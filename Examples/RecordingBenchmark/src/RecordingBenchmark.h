@@ -0,0 +1,37 @@
+#pragma once
+
+#include "Hog.h"
+
+using namespace Hog;
+
+class RecordingBenchmark : public Layer
+{
+public:
+	struct Result
+	{
+		uint32_t ThreadCount;
+		float Average;
+		float Min;
+	};
+
+	RecordingBenchmark();
+	virtual ~RecordingBenchmark() = default;
+
+	virtual void OnAttach() override;
+	virtual void OnDetach() override;
+
+	void OnUpdate(Timestep ts) override;
+	virtual void OnImGuiRender() override;
+private:
+	void StartRun(uint32_t threadCount);
+	void ReportResults();
+private:
+	std::vector<Ref<Mesh>> m_Meshes;
+	Ref<Buffer> m_ViewProjection;
+
+	uint32_t m_ThreadCount = 1;
+	uint32_t m_MaxThreadCount = 1;
+	uint32_t m_Frame = 0;
+	std::vector<float> m_Samples;
+	std::vector<Result> m_Results;
+};
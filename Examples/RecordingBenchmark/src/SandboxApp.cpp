@@ -0,0 +1,24 @@
+
+#include <Hog.h>
+#include <Hog/Core/EntryPoint.h>
+
+#include "RecordingBenchmark.h"
+
+class Sandbox : public Hog::Application
+{
+public:
+	Sandbox(Hog::ApplicationCommandLineArgs args)
+		: Application("Recording Benchmark", args)
+	{
+		PushLayer(CreateRef<RecordingBenchmark>());
+	}
+
+	~Sandbox()
+	{
+	}
+};
+
+Hog::Application* Hog::CreateApplication(Hog::ApplicationCommandLineArgs args)
+{
+	return new Sandbox(args);
+}
@@ -0,0 +1,141 @@
+// Compiles large render graphs on the CPU only, no window or device is created
+
+#include <Hog.h>
+
+#include "Hog/Core/Timer.h"
+
+using namespace Hog;
+
+constexpr uint32_t ChainLength = 16384;
+constexpr uint32_t FanInWidth = 16384;
+constexpr uint32_t LayerCount = 128;
+constexpr uint32_t LayerWidth = 128;
+constexpr uint32_t ParentsPerNode = 16;
+constexpr uint32_t ColdIterations = 8;
+constexpr uint32_t CachedIterations = 1000;
+
+static StageDescription MakeStage(uint32_t index)
+{
+	return { "Stage " + std::to_string(index), RendererStageType::Barrier, BarrierDescription{} };
+}
+
+static void BuildChain(RenderGraph& graph)
+{
+	Ref<Node> previous = nullptr;
+	for (uint32_t i = 0; i < ChainLength; i++)
+	{
+		previous = graph.AddStage(previous, MakeStage(i));
+	}
+}
+
+static void BuildFanIn(RenderGraph& graph)
+{
+	std::vector<Ref<Node>> sources(FanInWidth);
+	for (uint32_t i = 0; i < FanInWidth; i++)
+	{
+		sources[i] = graph.AddStage(nullptr, MakeStage(i));
+	}
+
+	graph.AddStage(sources, MakeStage(FanInWidth));
+}
+
+static void BuildLayered(RenderGraph& graph)
+{
+	std::vector<Ref<Node>> previousLayer;
+	std::vector<Ref<Node>> currentLayer;
+	std::vector<Ref<Node>> parents(ParentsPerNode);
+	uint32_t index = 0;
+
+	for (uint32_t layer = 0; layer < LayerCount; layer++)
+	{
+		currentLayer.clear();
+		for (uint32_t i = 0; i < LayerWidth; i++)
+		{
+			if (previousLayer.empty())
+			{
+				currentLayer.push_back(graph.AddStage(nullptr, MakeStage(index++)));
+				continue;
+			}
+
+			for (uint32_t p = 0; p < ParentsPerNode; p++)
+			{
+				parents[p] = previousLayer[(i + p * 7) % LayerWidth];
+			}
+
+			currentLayer.push_back(graph.AddStage(parents, MakeStage(index++)));
+		}
+
+		std::swap(previousLayer, currentLayer);
+	}
+}
+
+static bool ValidatePlan(const std::vector<Ref<Node>>& plan)
+{
+	std::unordered_map<Node*, size_t> position;
+	for (size_t i = 0; i < plan.size(); i++)
+	{
+		position[plan[i].get()] = i;
+	}
+
+	for (size_t i = 0; i < plan.size(); i++)
+	{
+		for (const auto& child : plan[i]->ChildList)
+		{
+			if (position[child.get()] <= i) return false;
+		}
+	}
+
+	return true;
+}
+
+static void RunBenchmark(const std::string& name, void (*build)(RenderGraph&))
+{
+	float coldTotal = 0.0f;
+	float coldMin = std::numeric_limits<float>::max();
+	size_t stageCount = 0;
+	bool valid = true;
+
+	for (uint32_t i = 0; i < ColdIterations; i++)
+	{
+		RenderGraph graph;
+		build(graph);
+
+		Timer timer;
+		const auto& plan = graph.Compile();
+		float elapsed = timer.ElapsedMillis();
+
+		coldTotal += elapsed;
+		coldMin = std::min(coldMin, elapsed);
+		stageCount = plan.size();
+		valid &= ValidatePlan(plan);
+
+		graph.Cleanup();
+	}
+
+	RenderGraph graph;
+	build(graph);
+	graph.Compile();
+
+	Timer timer;
+	for (uint32_t i = 0; i < CachedIterations; i++)
+	{
+		graph.Compile();
+	}
+	float cached = timer.ElapsedMillis() / CachedIterations;
+
+	graph.Cleanup();
+
+	HG_INFO("{}: {} stages, compile avg {:.3f} ms, min {:.3f} ms, cached {:.6f} ms, order {}",
+		name, stageCount, coldTotal / ColdIterations, coldMin, cached, valid ? "valid" : "INVALID");
+}
+
+int main()
+{
+	Log::Init();
+
+	RunBenchmark("Chain", BuildChain);
+	RunBenchmark("Fan-in", BuildFanIn);
+	RunBenchmark("Layered", BuildLayered);
+
+	return 0;
+}
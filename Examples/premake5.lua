@@ -3,4 +3,6 @@ group "Examples"
 	include "GraphicsExample"
 	include "DeferredExample"
 	include "AccelerationStructureExample"
+	include "RenderGraphBenchmark"
+	include "RecordingBenchmark"
 group ""
\ No newline at end of file
@@ -27,6 +27,8 @@
 #include "Hog/Renderer/Pipeline.h"
 #include "Hog/Renderer/Shader.h"
 #include "Hog/Renderer/Buffer.h"
+#include "Hog/Renderer/UploadBatch.h"
+#include "Hog/Renderer/GeometryBuffer.h"
 #include "Hog/Renderer/Mesh.h"
 #include "Hog/Renderer/Material.h"
 #include "Hog/Renderer/Renderer.h"
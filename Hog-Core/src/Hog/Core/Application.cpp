@@ -113,6 +113,8 @@ namespace Hog {
 
 						for (Ref<Layer> layer : m_LayerStack)
 							layer->OnImGuiRender();
+
+						Renderer::DrawStatsOverlay();
 					}
 					m_ImGuiLayer->End();
 				}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+namespace Hog {
+
+	// Keeps the last samples of a value that changes every frame and summarizes them
+	class RollingStatistic
+	{
+	public:
+		struct Summary
+		{
+			float Last = 0.0f;
+			float Min = 0.0f;
+			float Average = 0.0f;
+			float Max = 0.0f;
+			float P99 = 0.0f;
+		};
+
+		RollingStatistic(size_t windowSize = 240)
+			: m_WindowSize(std::max<size_t>(windowSize, 1))
+		{
+			m_Samples.reserve(m_WindowSize);
+		}
+
+		void Add(float sample)
+		{
+			if (m_Samples.size() < m_WindowSize)
+				m_Samples.push_back(sample);
+			else
+				m_Samples[m_Next] = sample;
+
+			m_Last = sample;
+			m_Next = (m_Next + 1) % m_WindowSize;
+		}
+
+		// Sorts a copy of the window, so it is meant to be called when the summary is looked at rather than for every sample
+		Summary Summarize() const
+		{
+			Summary summary;
+			if (m_Samples.empty()) return summary;
+
+			m_Sorted = m_Samples;
+			std::sort(m_Sorted.begin(), m_Sorted.end());
+
+			float total = 0.0f;
+			for (float sample : m_Sorted)
+			{
+				total += sample;
+			}
+
+			size_t p99 = (m_Sorted.size() * 99 + 99) / 100 - 1;
+
+			summary.Last = m_Last;
+			summary.Min = m_Sorted.front();
+			summary.Average = total / m_Sorted.size();
+			summary.Max = m_Sorted.back();
+			summary.P99 = m_Sorted[p99];
+
+			return summary;
+		}
+
+		size_t GetSampleCount() const { return m_Samples.size(); }
+	private:
+		std::vector<float> m_Samples;
+		mutable std::vector<float> m_Sorted;
+		size_t m_WindowSize;
+		size_t m_Next = 0;
+		float m_Last = 0.0f;
+	};
+
+}
@@ -0,0 +1,81 @@
+#include "hgpch.h"
+#include "Hog/Core/ThreadPool.h"
+
+namespace Hog {
+
+	ThreadPool::ThreadPool(uint32_t threadCount)
+	{
+		HG_CORE_ASSERT(threadCount > 0, "ThreadPool needs at least one thread");
+
+		m_Threads.reserve(threadCount);
+		for (uint32_t i = 0; i < threadCount; ++i)
+		{
+			m_Threads.emplace_back(&ThreadPool::WorkerLoop, this, i);
+		}
+	}
+
+	ThreadPool::~ThreadPool()
+	{
+		{
+			std::lock_guard lock(m_Mutex);
+			m_Stopping = true;
+		}
+
+		m_JobAvailable.notify_all();
+
+		for (auto& thread : m_Threads)
+		{
+			thread.join();
+		}
+	}
+
+	void ThreadPool::Submit(Job&& job)
+	{
+		{
+			std::lock_guard lock(m_Mutex);
+			m_Jobs.push(std::move(job));
+			m_PendingJobs++;
+		}
+
+		m_JobAvailable.notify_one();
+	}
+
+	void ThreadPool::Wait()
+	{
+		HG_PROFILE_FUNCTION();
+
+		std::unique_lock lock(m_Mutex);
+		m_JobsFinished.wait(lock, [this] { return m_PendingJobs == 0; });
+	}
+
+	void ThreadPool::WorkerLoop(uint32_t threadIndex)
+	{
+		HG_PROFILE_THREAD("Worker");
+
+		while (true)
+		{
+			Job job;
+
+			{
+				std::unique_lock lock(m_Mutex);
+				m_JobAvailable.wait(lock, [this] { return m_Stopping || !m_Jobs.empty(); });
+
+				if (m_Jobs.empty()) return;
+
+				job = std::move(m_Jobs.front());
+				m_Jobs.pop();
+			}
+
+			job(threadIndex);
+
+			{
+				std::lock_guard lock(m_Mutex);
+				if (--m_PendingJobs == 0)
+				{
+					m_JobsFinished.notify_all();
+				}
+			}
+		}
+	}
+
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "Hog/Core/Base.h"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <queue>
+#include <vector>
+
+namespace Hog {
+
+	// Fixed set of worker threads that pick up jobs in submission order.
+	// Every job gets the index of the worker running it, so it can use per thread resources.
+	class ThreadPool
+	{
+	public:
+		using Job = std::function<void(uint32_t threadIndex)>;
+	public:
+		ThreadPool(uint32_t threadCount);
+		~ThreadPool();
+
+		void Submit(Job&& job);
+		// Blocks until every submitted job has finished
+		void Wait();
+
+		uint32_t GetThreadCount() const { return static_cast<uint32_t>(m_Threads.size()); }
+	private:
+		void WorkerLoop(uint32_t threadIndex);
+	private:
+		std::vector<std::thread> m_Threads;
+		std::queue<Job> m_Jobs;
+		std::mutex m_Mutex;
+		std::condition_variable m_JobAvailable;
+		std::condition_variable m_JobsFinished;
+		uint32_t m_PendingJobs = 0;
+		bool m_Stopping = false;
+	};
+
+}
@@ -10,6 +10,8 @@
 #include <thread>
 #include <mutex>
 #include <sstream>
+#include <unordered_set>
+#include <vector>
 
 #include "Hog/Core/Log.h"
 
@@ -26,6 +28,22 @@ namespace Hog {
 		std::thread::id ThreadID;
 	};
 
+	// Event measured with GPU timestamps that were already converted to CPU time
+	struct GPUProfileResult
+	{
+		using ArgList = std::vector<std::pair<const char*, uint64_t>>;
+
+		std::string Name;
+
+		FloatingPointMicroseconds Start;
+		FloatingPointMicroseconds ElapsedTime;
+		// GPU events go on tracks of their own next to the CPU threads, one per queue
+		uint32_t Track;
+		const char* TrackName;
+		// Shown along with the event when it is selected
+		ArgList Args;
+	};
+
 	struct InstrumentationSession
 	{
 		std::string Name;
@@ -97,6 +115,47 @@ namespace Hog {
 			}
 		}
 
+		void WriteGPUProfile(const GPUProfileResult& result)
+		{
+			// Tracks are numbered far away from the thread ids, so they never share a row with a CPU thread
+			const uint64_t trackID = 0xFFFF0000ull + result.Track;
+
+			std::stringstream json;
+
+			json << std::setprecision(3) << std::fixed;
+			json << ",{";
+			json << "\"cat\":\"gpu\",";
+			json << "\"dur\":" << result.ElapsedTime.count() << ',';
+			json << "\"name\":\"" << result.Name << "\",";
+			json << "\"ph\":\"X\",";
+			json << "\"pid\":0,";
+			json << "\"tid\":" << trackID << ",";
+			json << "\"ts\":" << result.Start.count();
+			if (!result.Args.empty())
+			{
+				json << ",\"args\":{";
+				for (size_t i = 0; i < result.Args.size(); i++)
+				{
+					json << (i ? "," : "") << '"' << result.Args[i].first << "\":" << result.Args[i].second;
+				}
+				json << "}";
+			}
+			json << "}";
+
+			std::lock_guard lock(m_Mutex);
+			if (m_CurrentSession)
+			{
+				if (m_NamedTracks.insert(trackID).second)
+				{
+					m_OutputStream << ",{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << trackID
+						<< ",\"args\":{\"name\":\"" << result.TrackName << "\"}}";
+				}
+
+				m_OutputStream << json.str();
+				m_OutputStream.flush();
+			}
+		}
+
 		static Instrumentor& Get()
 		{
 			static Instrumentor instance;
@@ -135,12 +194,14 @@ namespace Hog {
 				m_OutputStream.close();
 				delete m_CurrentSession;
 				m_CurrentSession = nullptr;
+				m_NamedTracks.clear();
 			}
 		}
 	private:
 		std::mutex m_Mutex;
 		InstrumentationSession* m_CurrentSession;
 		std::ofstream m_OutputStream;
+		std::unordered_set<uint64_t> m_NamedTracks;
 	};
 
 	class InstrumentationTimer
@@ -236,11 +297,13 @@ namespace Hog {
 		#define HG_PROFILE_TAG(name, ...)
 		#define HG_PROFILE_FUNCTION() HG_PROFILE_SCOPE(HG_FUNC_SIG)
 		#define HG_PROFILE_START_FRAME(name)
+		#define HG_PROFILE_THREAD(name)
 
 		#define HG_PROFILE_GPU_INIT_VULKAN(devices, physical_devices, cnd_queues, cnd_queues_family, num_cmd_queus, functions)
 		#define HG_PROFILE_GPU_CONTEXT(command_list)
 		#define HG_PROFILE_GPU_EVENT(name)
 		#define HG_PROFILE_GPU_FLIP(swap_chain)
+		#define HG_PROFILE_GPU_RESULT(...) ::Hog::Instrumentor::Get().WriteGPUProfile(__VA_ARGS__)
 	#else
 		#define HG_PROFILE_BEGIN_SESSION(name, filepath) OPTICK_START_CAPTURE()
 		#define HG_PROFILE_SAVE_SESSION(filepath) OPTICK_SAVE_CAPTURE(filepath)
@@ -249,12 +312,14 @@ namespace Hog {
 		#define HG_PROFILE_TAG(name, ...) OPTICK_TAG(name, __VA_ARGS__)
 		#define HG_PROFILE_FUNCTION() OPTICK_EVENT()
 		#define HG_PROFILE_START_FRAME(name) OPTICK_FRAME(name)
+		#define HG_PROFILE_THREAD(name) OPTICK_THREAD(name)
 
 		#define HG_PROFILE_GPU_INIT_VULKAN(devices, physical_devices, cnd_queues, cnd_queues_family, num_cmd_queus, functions)
 			//OPTICK_GPU_INIT_VULKAN(devices, physical_devices, cnd_queues, cnd_queues_family, num_cmd_queus, functions)
 		#define HG_PROFILE_GPU_CONTEXT(...) //OPTICK_GPU_CONTEXT(__VA_ARGS__)
 		#define HG_PROFILE_GPU_EVENT(name) //OPTICK_GPU_EVENT(name)
 		#define HG_PROFILE_GPU_FLIP(swap_chain) //OPTICK_GPU_FLIP(swap_chain)
+		#define HG_PROFILE_GPU_RESULT(...)
 	#endif
 #else
 	#define HG_PROFILE_BEGIN_SESSION(name, filepath)
@@ -264,9 +329,11 @@ namespace Hog {
 	#define HG_PROFILE_TAG(name, ...)
 	#define HG_PROFILE_FUNCTION()
 	#define HG_PROFILE_START_FRAME(name)
+	#define HG_PROFILE_THREAD(name)
 
 	#define HG_PROFILE_GPU_INIT_VULKAN(devices, physical_devices, cnd_queues, cnd_queues_family, num_cmd_queus, functions)
 	#define HG_PROFILE_GPU_CONTEXT(command_list)
 	#define HG_PROFILE_GPU_EVENT(name)
 	#define HG_PROFILE_GPU_FLIP(swap_chain)
+	#define HG_PROFILE_GPU_RESULT(...)
 #endif
\ No newline at end of file
@@ -76,8 +76,10 @@ namespace Hog {
 		initInfo.Device = GraphicsContext::GetDevice();
 		initInfo.Queue = GraphicsContext::GetQueue();
 		initInfo.DescriptorPool = GraphicsContext::GetImGuiDescriptorPool();
-		initInfo.MinImageCount = *CVarSystem::Get()->GetIntCVar("renderer.frameCount");
-		initInfo.ImageCount = *CVarSystem::Get()->GetIntCVar("renderer.frameCount");
+		// ImGui keeps a set of vertex buffers per image count, it has to cover every frame in flight
+		uint32_t imageCount = static_cast<uint32_t>(GraphicsContext::GetSwapchainImages().size());
+		initInfo.MinImageCount = imageCount;
+		initInfo.ImageCount = std::max(imageCount, static_cast<uint32_t>(*CVarSystem::Get()->GetIntCVar("renderer.frameCount")));
 		initInfo.MSAASamples = GraphicsContext::GetMSAASamples();
 		initInfo.CheckVkResultFn = CheckVkResult;
 
@@ -4,6 +4,19 @@
 #include <glm/gtx/matrix_decompose.hpp>
 #include <glm/gtx/norm.hpp>
 
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+// MSVC compiles AVX intrinsics without /arch:AVX, GCC and Clang only compile them in functions that target AVX. Either
+// way the kernel is only called after checking that the CPU supports it.
+#if defined(_MSC_VER) && !defined(__clang__)
+#define HG_TARGET_AVX
+#else
+#define HG_TARGET_AVX __attribute__((target("avx")))
+#endif
+
 namespace Hog::Math {
 
 	const glm::vec3 Vector3::Zero = { 0.f, 0.f, 0.f };
@@ -18,6 +31,46 @@ namespace Hog::Math {
 	const glm::vec3 Vector3::Forward = { 0.f, 0.f, 1.f };
 	const glm::vec3 Vector3::Backward = { 0.f, 0.f, -1.f };
 
+	BoundingBox BoundingBox::Transform(const glm::mat4& transform) const
+	{
+		// Arvo, the extents along each world axis are the absolute projections of the local ones
+		glm::vec3 center = glm::vec3(transform * glm::vec4(GetCenter(), 1.0f));
+		glm::mat3 absolute = glm::mat3(glm::abs(glm::vec3(transform[0])), glm::abs(glm::vec3(transform[1])), glm::abs(glm::vec3(transform[2])));
+		glm::vec3 extents = absolute * GetExtents();
+
+		return { center - extents, center + extents };
+	}
+
+	void BoundingBox::Merge(const BoundingBox& other)
+	{
+		Min = glm::min(Min, other.Min);
+		Max = glm::max(Max, other.Max);
+	}
+
+	void BoundingBoxArray::Resize(size_t count)
+	{
+		m_Count = count;
+
+		size_t padded = (count + Width - 1) / Width * Width;
+		for (auto* values : { &CenterX, &CenterY, &CenterZ, &ExtentX, &ExtentY, &ExtentZ })
+		{
+			values->resize(padded, 0.0f);
+		}
+	}
+
+	void BoundingBoxArray::Set(size_t index, const BoundingBox& box)
+	{
+		glm::vec3 center = box.GetCenter();
+		glm::vec3 extents = box.GetExtents();
+
+		CenterX[index] = center.x;
+		CenterY[index] = center.y;
+		CenterZ[index] = center.z;
+		ExtentX[index] = extents.x;
+		ExtentY[index] = extents.y;
+		ExtentZ[index] = extents.z;
+	}
+
 	bool DecomposeTransform(const glm::mat4& transform, glm::vec3& translation, glm::vec3& rotation, glm::vec3& scale)
 	{
 		// From glm::decompose in matrix_decompose.inl
@@ -119,6 +172,145 @@ namespace Hog::Math {
 		}
 	}
 
+	std::array<glm::vec4, 6> ExtractFrustumPlanes(const glm::mat4& viewProjection)
+	{
+		// Gribb and Hartmann, the rows of the matrix combine into the clip space planes
+		glm::mat4 rows = glm::transpose(viewProjection);
+
+		std::array<glm::vec4, 6> planes = {
+			rows[3] + rows[0],
+			rows[3] - rows[0],
+			rows[3] + rows[1],
+			rows[3] - rows[1],
+			rows[2],
+			rows[3] - rows[2],
+		};
+
+		for (auto& plane : planes)
+		{
+			plane /= glm::length(glm::vec3(plane));
+		}
+
+		return planes;
+	}
+
+	static bool SupportsAVX()
+	{
+#if defined(_MSC_VER) && !defined(__clang__)
+		int info[4];
+		__cpuid(info, 1);
+
+		// The OS has to save the upper halves of the registers as well
+		const bool osxsave = info[2] & (1 << 27);
+		const bool avx = info[2] & (1 << 28);
+		return osxsave && avx && (_xgetbv(0) & 0x6) == 0x6;
+#else
+		return __builtin_cpu_supports("avx");
+#endif
+	}
+
+	// A box is outside once its center lies further behind a plane than the box reaches towards it
+	HG_TARGET_AVX static void CullBoundingBoxesAVX(const std::array<glm::vec4, 6>& planes, const BoundingBoxArray& boxes, uint8_t* visible)
+	{
+		const __m256 signMask = _mm256_set1_ps(-0.0f);
+
+		for (size_t i = 0; i < boxes.CenterX.size(); i += 8)
+		{
+			__m256 centerX = _mm256_loadu_ps(&boxes.CenterX[i]);
+			__m256 centerY = _mm256_loadu_ps(&boxes.CenterY[i]);
+			__m256 centerZ = _mm256_loadu_ps(&boxes.CenterZ[i]);
+			__m256 extentX = _mm256_loadu_ps(&boxes.ExtentX[i]);
+			__m256 extentY = _mm256_loadu_ps(&boxes.ExtentY[i]);
+			__m256 extentZ = _mm256_loadu_ps(&boxes.ExtentZ[i]);
+
+			__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+			for (const auto& plane : planes)
+			{
+				__m256 distance = _mm256_add_ps(_mm256_add_ps(
+					_mm256_mul_ps(centerX, _mm256_set1_ps(plane.x)),
+					_mm256_mul_ps(centerY, _mm256_set1_ps(plane.y))),
+					_mm256_add_ps(_mm256_mul_ps(centerZ, _mm256_set1_ps(plane.z)), _mm256_set1_ps(plane.w)));
+
+				__m256 radius = _mm256_add_ps(_mm256_add_ps(
+					_mm256_mul_ps(extentX, _mm256_set1_ps(std::abs(plane.x))),
+					_mm256_mul_ps(extentY, _mm256_set1_ps(std::abs(plane.y)))),
+					_mm256_mul_ps(extentZ, _mm256_set1_ps(std::abs(plane.z))));
+
+				inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, _mm256_xor_ps(radius, signMask), _CMP_GE_OQ));
+			}
+
+			int mask = _mm256_movemask_ps(inside);
+			for (size_t j = 0; j < 8; j++)
+			{
+				visible[i + j] = (mask >> j) & 1;
+			}
+		}
+	}
+
+	static void CullBoundingBoxesSSE(const std::array<glm::vec4, 6>& planes, const BoundingBoxArray& boxes, uint8_t* visible)
+	{
+		const __m128 signMask = _mm_set1_ps(-0.0f);
+
+		for (size_t i = 0; i < boxes.CenterX.size(); i += 4)
+		{
+			__m128 centerX = _mm_loadu_ps(&boxes.CenterX[i]);
+			__m128 centerY = _mm_loadu_ps(&boxes.CenterY[i]);
+			__m128 centerZ = _mm_loadu_ps(&boxes.CenterZ[i]);
+			__m128 extentX = _mm_loadu_ps(&boxes.ExtentX[i]);
+			__m128 extentY = _mm_loadu_ps(&boxes.ExtentY[i]);
+			__m128 extentZ = _mm_loadu_ps(&boxes.ExtentZ[i]);
+
+			__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+			for (const auto& plane : planes)
+			{
+				__m128 distance = _mm_add_ps(_mm_add_ps(
+					_mm_mul_ps(centerX, _mm_set1_ps(plane.x)),
+					_mm_mul_ps(centerY, _mm_set1_ps(plane.y))),
+					_mm_add_ps(_mm_mul_ps(centerZ, _mm_set1_ps(plane.z)), _mm_set1_ps(plane.w)));
+
+				__m128 radius = _mm_add_ps(_mm_add_ps(
+					_mm_mul_ps(extentX, _mm_set1_ps(std::abs(plane.x))),
+					_mm_mul_ps(extentY, _mm_set1_ps(std::abs(plane.y)))),
+					_mm_mul_ps(extentZ, _mm_set1_ps(std::abs(plane.z))));
+
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, _mm_xor_ps(radius, signMask)));
+			}
+
+			int mask = _mm_movemask_ps(inside);
+			for (size_t j = 0; j < 4; j++)
+			{
+				visible[i + j] = (mask >> j) & 1;
+			}
+		}
+	}
+
+	uint32_t CullBoundingBoxes(const std::array<glm::vec4, 6>& planes, const BoundingBoxArray& boxes, std::vector<uint8_t>& visible)
+	{
+		HG_PROFILE_FUNCTION();
+
+		static const bool avx = SupportsAVX();
+
+		// The kernels write whole registers, the padding flags are cut off again afterwards
+		visible.resize(boxes.CenterX.size());
+		if (avx)
+		{
+			CullBoundingBoxesAVX(planes, boxes, visible.data());
+		}
+		else
+		{
+			CullBoundingBoxesSSE(planes, boxes, visible.data());
+		}
+		visible.resize(boxes.Size());
+
+		uint32_t visibleCount = 0;
+		for (uint8_t flag : visible)
+		{
+			visibleCount += flag;
+		}
+
+		return visibleCount;
+	}
+
 	bool EpsilonCompare(float a, float b)
 	{
 		return fabsf(a - b) < std::numeric_limits<float>::epsilon();
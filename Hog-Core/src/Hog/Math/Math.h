@@ -2,6 +2,9 @@
 
 #include <glm/glm.hpp>
 
+#include <array>
+#include <vector>
+
 namespace Hog::Math
 {
 
@@ -21,8 +24,49 @@ namespace Hog::Math
         static const glm::vec3 Backward;
 	};
 
+	struct BoundingBox
+	{
+		glm::vec3 Min = glm::vec3(0.0f);
+		glm::vec3 Max = glm::vec3(0.0f);
+
+		glm::vec3 GetCenter() const { return (Min + Max) * 0.5f; }
+		glm::vec3 GetExtents() const { return (Max - Min) * 0.5f; }
+		// Smallest axis aligned box around this one after transforming it
+		BoundingBox Transform(const glm::mat4& transform) const;
+		void Merge(const BoundingBox& other);
+	};
+
+	struct BoundingSphere
+	{
+		glm::vec3 Center = glm::vec3(0.0f);
+		float Radius = 0.0f;
+	};
+
+	// Boxes stored as centers and half extents in separate arrays, so the culling kernels load several boxes per register.
+	// The arrays are padded to a whole register, padding boxes are never reported.
+	class BoundingBoxArray
+	{
+	public:
+		static constexpr size_t Width = 8;
+	public:
+		void Resize(size_t count);
+		void Set(size_t index, const BoundingBox& box);
+		size_t Size() const { return m_Count; }
+	public:
+		std::vector<float> CenterX, CenterY, CenterZ;
+		std::vector<float> ExtentX, ExtentY, ExtentZ;
+	private:
+		size_t m_Count = 0;
+	};
+
 	bool DecomposeTransform(const glm::mat4& transform, glm::vec3& translation, glm::vec3& rotation, glm::vec3& scale);
 	void CalculateFrustrumCorners(std::vector<glm::vec3>& corners, glm::mat4 projection);
+	// Left, right, bottom, top, near and far planes of a view projection with a [0, 1] depth range. The normals
+	// point into the frustum and are normalized, so dot(plane.xyz, point) + plane.w is the signed distance.
+	std::array<glm::vec4, 6> ExtractFrustumPlanes(const glm::mat4& viewProjection);
+	// Tests the boxes against the frustum planes, eight at a time on CPUs with AVX or four at a time with SSE. Writes one
+	// flag per box to visible and returns the number of boxes that are at least partially inside.
+	uint32_t CullBoundingBoxes(const std::array<glm::vec4, 6>& planes, const BoundingBoxArray& boxes, std::vector<uint8_t>& visible);
 
     bool EpsilonCompare(float a, float b);
 }
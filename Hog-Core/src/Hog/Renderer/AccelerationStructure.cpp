@@ -2,7 +2,10 @@
 
 #include "AccelerationStructure.h"
 
+#include <glm/gtc/matrix_transform.hpp>
+
 #include "Hog/Renderer/GraphicsContext.h"
+#include "Hog/Renderer/GeometryBuffer.h"
 
 namespace Hog
 {
@@ -21,34 +24,52 @@ namespace Hog
 		std::vector<VkAccelerationStructureBuildRangeInfoKHR*> accelerationBuildStructureRangeInfoPointers;
 		std::vector<VkAccelerationStructureBuildRangeInfoKHR> accelerationBuildStructureRangeInfos;
 
+		// Instances of a mesh share its vertex and index regions, each one only needs its own transforms. Primitives get one
+		// each, which also turns compact vertex positions back into local space.
 		for (const auto& mesh : meshes)
 		{
-			glm::mat4 transformMatrix = mesh->GetModelMatrix();
-			auto transformBuffer = Buffer::Create(BufferDescription::Defaults::AccelerationStructureBuildInput, sizeof(VkTransformMatrixKHR));
-			transformBuffer->WriteData(&transformMatrix, sizeof(VkTransformMatrixKHR));
-			m_TransformBuffers.push_back(transformBuffer);
-
-			for (auto primitive = mesh->begin(); primitive != mesh->end(); primitive++)
+			for (const glm::mat4& instanceMatrix : mesh->GetInstances())
 			{
-				VkAccelerationStructureGeometryKHR accelerationStructureGeometry{};
-				accelerationStructureGeometry.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR;
-				accelerationStructureGeometry.flags = VK_GEOMETRY_OPAQUE_BIT_KHR;
-				accelerationStructureGeometry.geometryType = VK_GEOMETRY_TYPE_TRIANGLES_KHR;
-				accelerationStructureGeometry.geometry.triangles.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_TRIANGLES_DATA_KHR;
-				accelerationStructureGeometry.geometry.triangles.vertexFormat = VK_FORMAT_R32G32B32_SFLOAT;
-				accelerationStructureGeometry.geometry.triangles.vertexData.deviceAddress = mesh->GetVertexBuffer()->GetBufferDeviceAddress() + primitive->GetVertexOffset();
-				accelerationStructureGeometry.geometry.triangles.vertexStride = sizeof(Vertex);
-				accelerationStructureGeometry.geometry.triangles.maxVertex = static_cast<uint32_t>(primitive->GetVertexCount());
-				accelerationStructureGeometry.geometry.triangles.indexType = VK_INDEX_TYPE_UINT16;
-				accelerationStructureGeometry.geometry.triangles.indexData.deviceAddress = mesh->GetIndexBuffer()->GetBufferDeviceAddress();
-				accelerationStructureGeometry.geometry.triangles.transformData.deviceAddress = transformBuffer->GetBufferDeviceAddress();
-				accelerationStructureGeometries.push_back(accelerationStructureGeometry);
-				triangleCounts.push_back(static_cast<uint32_t>(primitive->GetIndexCount() / 3));
-
-				VkAccelerationStructureBuildRangeInfoKHR accelerationStructureBuildRangeInfo{};
-				accelerationStructureBuildRangeInfo.primitiveCount = static_cast<uint32_t>(primitive->GetIndexCount() / 3);
-				accelerationStructureBuildRangeInfo.primitiveOffset = static_cast<uint32_t>(primitive->GetIndexOffset());
-				accelerationBuildStructureRangeInfos.push_back(accelerationStructureBuildRangeInfo);
+				std::vector<VkTransformMatrixKHR> transforms;
+				for (const auto& primitive : *mesh)
+				{
+					glm::mat4 transform = glm::transpose(instanceMatrix * glm::translate(glm::mat4(1.0f), primitive.GetPositionOffset())
+						* glm::scale(glm::mat4(1.0f), primitive.GetPositionScale()));
+
+					// Row major, without the last row
+					VkTransformMatrixKHR& matrix = transforms.emplace_back();
+					std::memcpy(&matrix, &transform, sizeof(VkTransformMatrixKHR));
+				}
+
+				auto transformBuffer = Buffer::Create(BufferDescription::Defaults::AccelerationStructureBuildInput,
+					sizeof(VkTransformMatrixKHR) * std::max<size_t>(1, transforms.size()));
+				transformBuffer->WriteData(transforms.data(), sizeof(VkTransformMatrixKHR) * transforms.size());
+				m_TransformBuffers.push_back(transformBuffer);
+
+				uint32_t primitiveIndex = 0;
+				for (auto primitive = mesh->begin(); primitive != mesh->end(); primitive++, primitiveIndex++)
+				{
+					VkAccelerationStructureGeometryKHR accelerationStructureGeometry{};
+					accelerationStructureGeometry.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR;
+					accelerationStructureGeometry.flags = VK_GEOMETRY_OPAQUE_BIT_KHR;
+					accelerationStructureGeometry.geometryType = VK_GEOMETRY_TYPE_TRIANGLES_KHR;
+					accelerationStructureGeometry.geometry.triangles.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_TRIANGLES_DATA_KHR;
+					accelerationStructureGeometry.geometry.triangles.vertexFormat = GeometryBuffer::GetVertexAttribute(0)->format;
+					accelerationStructureGeometry.geometry.triangles.vertexData.deviceAddress = GeometryBuffer::GetVertexBuffer()->GetBufferDeviceAddress() + primitive->GetVertexOffset();
+					accelerationStructureGeometry.geometry.triangles.vertexStride = GeometryBuffer::GetVertexStride();
+					accelerationStructureGeometry.geometry.triangles.maxVertex = static_cast<uint32_t>(primitive->GetVertexCount());
+					accelerationStructureGeometry.geometry.triangles.indexType = primitive->GetIndexType();
+					accelerationStructureGeometry.geometry.triangles.indexData.deviceAddress = GeometryBuffer::GetIndexBuffer()->GetBufferDeviceAddress();
+					accelerationStructureGeometry.geometry.triangles.transformData.deviceAddress = transformBuffer->GetBufferDeviceAddress()
+						+ primitiveIndex * sizeof(VkTransformMatrixKHR);
+					accelerationStructureGeometries.push_back(accelerationStructureGeometry);
+					triangleCounts.push_back(static_cast<uint32_t>(primitive->GetIndexCount() / 3));
+
+					VkAccelerationStructureBuildRangeInfoKHR accelerationStructureBuildRangeInfo{};
+					accelerationStructureBuildRangeInfo.primitiveCount = static_cast<uint32_t>(primitive->GetIndexCount() / 3);
+					accelerationStructureBuildRangeInfo.primitiveOffset = static_cast<uint32_t>(primitive->GetIndexOffset());
+					accelerationBuildStructureRangeInfos.push_back(accelerationStructureBuildRangeInfo);
+				}
 			}
 		}
 
@@ -0,0 +1,129 @@
+#include "hgpch.h"
+
+#include "BarrierBatch.h"
+
+namespace Hog
+{
+	void BarrierBatch::AddImageBarrier(Image& image, const BarrierDescription& description, bool discard)
+	{
+		const VkImageLayout newLayout = static_cast<VkImageLayout>(description.NewLayout);
+		const bool dependency = description.SrcStage != PipelineStage::None || description.SrcAccessMask != AccessFlag::None;
+
+		uint32_t level = 0;
+		while (level < image.GetLevelCount())
+		{
+			// Group consecutive levels that share the same layout into one barrier
+			VkImageLayout oldLayout = image.GetImageLayout(level);
+			uint32_t levelCount = 1;
+			while (level + levelCount < image.GetLevelCount() && image.GetImageLayout(level + levelCount) == oldLayout)
+			{
+				levelCount++;
+			}
+
+			if (dependency || oldLayout != newLayout)
+			{
+				m_ImageBarriers.push_back({
+					.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+					.srcStageMask = static_cast<VkPipelineStageFlags2>(description.SrcStage),
+					.srcAccessMask = static_cast<VkAccessFlags2>(description.SrcAccessMask),
+					.dstStageMask = static_cast<VkPipelineStageFlags2>(description.DstStage),
+					.dstAccessMask = static_cast<VkAccessFlags2>(description.DstAccessMask),
+					.oldLayout = discard ? VK_IMAGE_LAYOUT_UNDEFINED : oldLayout,
+					.newLayout = newLayout,
+					.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+					.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+					.image = image.GetHandle(),
+					.subresourceRange = {
+						.aspectMask = image.GetDescription().ImageAspectFlags,
+						.baseMipLevel = level,
+						.levelCount = levelCount,
+						.baseArrayLayer = 0,
+						.layerCount = 1,
+					}
+				});
+
+				image.SetImageLayout(newLayout, level, levelCount);
+			}
+
+			level += levelCount;
+		}
+	}
+
+	void BarrierBatch::AddBufferBarrier(const Buffer& buffer, const BarrierDescription& description)
+	{
+		m_BufferBarriers.push_back({
+			.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2,
+			.srcStageMask = static_cast<VkPipelineStageFlags2>(description.SrcStage),
+			.srcAccessMask = static_cast<VkAccessFlags2>(description.SrcAccessMask),
+			.dstStageMask = static_cast<VkPipelineStageFlags2>(description.DstStage),
+			.dstAccessMask = static_cast<VkAccessFlags2>(description.DstAccessMask),
+			.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.buffer = buffer.GetHandle(),
+			.offset = 0,
+			.size = VK_WHOLE_SIZE,
+		});
+	}
+
+	void BarrierBatch::AddImageOwnershipTransfer(Image& image, const BarrierDescription& description, uint32_t srcQueueFamily, uint32_t dstQueueFamily)
+	{
+		const VkImageLayout newLayout = static_cast<VkImageLayout>(description.NewLayout);
+
+		m_ImageBarriers.push_back({
+			.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+			.srcStageMask = static_cast<VkPipelineStageFlags2>(description.SrcStage),
+			.srcAccessMask = static_cast<VkAccessFlags2>(description.SrcAccessMask),
+			.dstStageMask = static_cast<VkPipelineStageFlags2>(description.DstStage),
+			.dstAccessMask = static_cast<VkAccessFlags2>(description.DstAccessMask),
+			.oldLayout = static_cast<VkImageLayout>(description.OldLayout),
+			.newLayout = newLayout,
+			.srcQueueFamilyIndex = srcQueueFamily,
+			.dstQueueFamilyIndex = dstQueueFamily,
+			.image = image.GetHandle(),
+			.subresourceRange = {
+				.aspectMask = image.GetDescription().ImageAspectFlags,
+				.baseMipLevel = 0,
+				.levelCount = image.GetLevelCount(),
+				.baseArrayLayer = 0,
+				.layerCount = 1,
+			}
+		});
+
+		image.SetImageLayout(newLayout);
+	}
+
+	void BarrierBatch::AddBufferOwnershipTransfer(const Buffer& buffer, const BarrierDescription& description, uint32_t srcQueueFamily, uint32_t dstQueueFamily)
+	{
+		m_BufferBarriers.push_back({
+			.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2,
+			.srcStageMask = static_cast<VkPipelineStageFlags2>(description.SrcStage),
+			.srcAccessMask = static_cast<VkAccessFlags2>(description.SrcAccessMask),
+			.dstStageMask = static_cast<VkPipelineStageFlags2>(description.DstStage),
+			.dstAccessMask = static_cast<VkAccessFlags2>(description.DstAccessMask),
+			.srcQueueFamilyIndex = srcQueueFamily,
+			.dstQueueFamilyIndex = dstQueueFamily,
+			.buffer = buffer.GetHandle(),
+			.offset = 0,
+			.size = VK_WHOLE_SIZE,
+		});
+	}
+
+	void BarrierBatch::Flush(VkCommandBuffer commandBuffer)
+	{
+		if (Empty()) return;
+
+		VkDependencyInfo info =
+		{
+			.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+			.bufferMemoryBarrierCount = static_cast<uint32_t>(m_BufferBarriers.size()),
+			.pBufferMemoryBarriers = m_BufferBarriers.data(),
+			.imageMemoryBarrierCount = static_cast<uint32_t>(m_ImageBarriers.size()),
+			.pImageMemoryBarriers = m_ImageBarriers.data(),
+		};
+
+		vkCmdPipelineBarrier2(commandBuffer, &info);
+
+		m_ImageBarriers.clear();
+		m_BufferBarriers.clear();
+	}
+}
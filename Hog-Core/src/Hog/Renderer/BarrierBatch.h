@@ -0,0 +1,32 @@
+#pragma once
+
+#include "Hog/Renderer/Types.h"
+#include "Hog/Renderer/Image.h"
+#include "Hog/Renderer/Buffer.h"
+
+namespace Hog
+{
+	// Collects image and buffer barriers so that they can be recorded with a single vkCmdPipelineBarrier2.
+	class BarrierBatch
+	{
+	public:
+		// Transitions every mip level of the image to description.NewLayout. The old layout is taken from the layout
+		// tracked by the image for each level (or Undefined when discard is set) rather than from the description.
+		// Levels that are already in the requested layout are skipped unless the description carries a dependency.
+		void AddImageBarrier(Image& image, const BarrierDescription& description, bool discard = false);
+		void AddBufferBarrier(const Buffer& buffer, const BarrierDescription& description);
+
+		// Records one half of a queue family ownership transfer. Both halves have to describe the same layout
+		// transition, so the layouts are taken from the description instead of the tracked ones.
+		void AddImageOwnershipTransfer(Image& image, const BarrierDescription& description, uint32_t srcQueueFamily, uint32_t dstQueueFamily);
+		void AddBufferOwnershipTransfer(const Buffer& buffer, const BarrierDescription& description, uint32_t srcQueueFamily, uint32_t dstQueueFamily);
+
+		void Flush(VkCommandBuffer commandBuffer);
+
+		bool Empty() const { return m_ImageBarriers.empty() && m_BufferBarriers.empty(); }
+		uint32_t GetBarrierCount() const { return static_cast<uint32_t>(m_ImageBarriers.size() + m_BufferBarriers.size()); }
+	private:
+		std::vector<VkImageMemoryBarrier2> m_ImageBarriers;
+		std::vector<VkBufferMemoryBarrier2> m_BufferBarriers;
+	};
+}
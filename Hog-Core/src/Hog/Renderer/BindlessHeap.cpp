@@ -0,0 +1,274 @@
+#include "hgpch.h"
+#include "BindlessHeap.h"
+
+#include "Hog/Core/CVars.h"
+#include "Hog/Renderer/GraphicsContext.h"
+#include "Hog/Renderer/Image.h"
+#include "Hog/Utils/RendererUtils.h"
+
+AutoCVar_Int CVar_BindlessSampledImages("renderer.bindless.sampledImages", "Number of sampled image slots in the bindless heap", 16384, CVarFlags::EditReadOnly);
+AutoCVar_Int CVar_BindlessStorageImages("renderer.bindless.storageImages", "Number of storage image slots in the bindless heap", 1024, CVarFlags::EditReadOnly);
+AutoCVar_Int CVar_BindlessStorageBuffers("renderer.bindless.storageBuffers", "Number of storage buffer slots in the bindless heap", 4096, CVarFlags::EditReadOnly);
+
+namespace Hog {
+
+	static constexpr std::array<VkDescriptorType, BindlessHeap::BindingCount> s_DescriptorTypes = {
+		VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+		VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+		VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+	};
+
+	void BindlessHeap::InitializeImpl()
+	{
+		HG_PROFILE_FUNCTION();
+
+		m_Device = GraphicsContext::GetDevice();
+
+		// Every pipeline stage sees the whole heap, so the per stage limits are the ones that matter
+		const auto& properties = GraphicsContext::GetGPUInfo()->Vulkan12Properties;
+		m_Capacity[SampledImages] = std::min({ static_cast<uint32_t>(CVar_BindlessSampledImages.Get()),
+			properties.maxPerStageDescriptorUpdateAfterBindSampledImages, properties.maxPerStageDescriptorUpdateAfterBindSamplers });
+		m_Capacity[StorageImages] = std::min(static_cast<uint32_t>(CVar_BindlessStorageImages.Get()),
+			properties.maxPerStageDescriptorUpdateAfterBindStorageImages);
+		m_Capacity[StorageBuffers] = std::min(static_cast<uint32_t>(CVar_BindlessStorageBuffers.Get()),
+			properties.maxPerStageDescriptorUpdateAfterBindStorageBuffers);
+
+		std::array<VkDescriptorSetLayoutBinding, BindingCount> bindings;
+		std::array<VkDescriptorBindingFlags, BindingCount> bindingFlags;
+		std::array<VkDescriptorPoolSize, BindingCount> poolSizes;
+
+		for (uint32_t i = 0; i < BindingCount; i++)
+		{
+			bindings[i] = {
+				.binding = i,
+				.descriptorType = s_DescriptorTypes[i],
+				.descriptorCount = m_Capacity[i],
+				.stageFlags = VK_SHADER_STAGE_ALL,
+			};
+
+			bindingFlags[i] = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT
+				| VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT;
+
+			poolSizes[i] = { s_DescriptorTypes[i], m_Capacity[i] };
+		}
+
+		VkDescriptorSetLayoutBindingFlagsCreateInfo layoutBindingFlags = {
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO,
+			.bindingCount = BindingCount,
+			.pBindingFlags = bindingFlags.data(),
+		};
+
+		// Created outside of the layout cache, which does not tell layouts apart by their flags
+		VkDescriptorSetLayoutCreateInfo layoutInfo = {
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+			.pNext = &layoutBindingFlags,
+			.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT,
+			.bindingCount = BindingCount,
+			.pBindings = bindings.data(),
+		};
+
+		CheckVkResult(vkCreateDescriptorSetLayout(m_Device, &layoutInfo, nullptr, &m_Layout));
+
+		VkDescriptorPoolCreateInfo poolInfo = {
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+			.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT,
+			.maxSets = 1,
+			.poolSizeCount = BindingCount,
+			.pPoolSizes = poolSizes.data(),
+		};
+
+		CheckVkResult(vkCreateDescriptorPool(m_Device, &poolInfo, nullptr, &m_Pool));
+
+		VkDescriptorSetAllocateInfo allocInfo = {
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+			.descriptorPool = m_Pool,
+			.descriptorSetCount = 1,
+			.pSetLayouts = &m_Layout,
+		};
+
+		CheckVkResult(vkAllocateDescriptorSets(m_Device, &allocInfo, &m_Set));
+
+		HG_CORE_INFO("Bindless heap: {} sampled images, {} storage images, {} storage buffers",
+			m_Capacity[SampledImages], m_Capacity[StorageImages], m_Capacity[StorageBuffers]);
+
+		m_Initialized = true;
+	}
+
+	void BindlessHeap::DeinitializeImpl()
+	{
+		vkDestroyDescriptorPool(m_Device, m_Pool, nullptr);
+		vkDestroyDescriptorSetLayout(m_Device, m_Layout, nullptr);
+
+		m_Pool = VK_NULL_HANDLE;
+		m_Layout = VK_NULL_HANDLE;
+		m_Set = VK_NULL_HANDLE;
+		m_Used = {};
+		m_FreeSlots = {};
+		m_ImageSlots = {};
+		m_ReleasedSlots.clear();
+
+		m_Initialized = false;
+	}
+
+	uint32_t BindlessHeap::RegisterImageImpl(Binding binding, const Image* image, VkSampler sampler)
+	{
+		std::lock_guard lock(m_Mutex);
+
+		uint32_t index = AllocateSlot(binding);
+		if (index == InvalidIndex) return index;
+
+		auto& slots = m_ImageSlots[binding];
+		if (slots.size() <= index)
+		{
+			slots.resize(index + 1);
+		}
+
+		slots[index] = { image, sampler };
+		WriteImage(binding, index, image, sampler);
+
+		return index;
+	}
+
+	uint32_t BindlessHeap::RegisterBufferImpl(VkBuffer buffer)
+	{
+		std::lock_guard lock(m_Mutex);
+
+		uint32_t index = AllocateSlot(StorageBuffers);
+		if (index == InvalidIndex) return index;
+
+		WriteBuffer(index, buffer);
+
+		return index;
+	}
+
+	void BindlessHeap::UpdateImageImpl(const Image* image)
+	{
+		std::lock_guard lock(m_Mutex);
+
+		if (!m_Initialized) return;
+
+		for (uint32_t binding = SampledImages; binding <= StorageImages; binding++)
+		{
+			const auto& slots = m_ImageSlots[binding];
+			for (uint32_t index = 0; index < slots.size(); index++)
+			{
+				if (slots[index].Source == image)
+				{
+					WriteImage(static_cast<Binding>(binding), index, image, slots[index].Sampler);
+				}
+			}
+		}
+	}
+
+	void BindlessHeap::UpdateBufferImpl(uint32_t index, VkBuffer buffer)
+	{
+		std::lock_guard lock(m_Mutex);
+
+		if (!m_Initialized || index == InvalidIndex) return;
+
+		WriteBuffer(index, buffer);
+	}
+
+	void BindlessHeap::ReleaseImpl(Binding binding, uint32_t index)
+	{
+		std::lock_guard lock(m_Mutex);
+
+		// Resources that outlive the device have nothing left to release
+		if (!m_Initialized || index == InvalidIndex) return;
+
+		if (binding != StorageBuffers)
+		{
+			m_ImageSlots[binding][index] = {};
+		}
+
+		m_ReleasedSlots.push_back({ binding, index, m_Frame });
+	}
+
+	void BindlessHeap::AdvanceFrameImpl(uint32_t framesInFlight)
+	{
+		std::lock_guard lock(m_Mutex);
+
+		m_Frame++;
+
+		auto retired = std::partition(m_ReleasedSlots.begin(), m_ReleasedSlots.end(),
+			[this, framesInFlight](const ReleasedSlot& slot) { return slot.Frame + framesInFlight > m_Frame; });
+
+		for (auto it = retired; it != m_ReleasedSlots.end(); ++it)
+		{
+			m_FreeSlots[it->Array].push_back(it->Index);
+		}
+
+		m_ReleasedSlots.erase(retired, m_ReleasedSlots.end());
+	}
+
+	uint32_t BindlessHeap::ResetWriteCountImpl()
+	{
+		std::lock_guard lock(m_Mutex);
+
+		uint32_t count = m_WriteCount;
+		m_WriteCount = 0;
+		return count;
+	}
+
+	uint32_t BindlessHeap::AllocateSlot(Binding binding)
+	{
+		HG_CORE_ASSERT(m_Initialized, "Bindless heap used before GraphicsContext::Initialize");
+
+		auto& freeSlots = m_FreeSlots[binding];
+		if (!freeSlots.empty())
+		{
+			uint32_t index = freeSlots.back();
+			freeSlots.pop_back();
+			return index;
+		}
+
+		if (m_Used[binding] == m_Capacity[binding])
+		{
+			HG_CORE_WARN("Bindless heap ran out of slots for binding {}, raise its renderer.bindless CVar", static_cast<uint32_t>(binding));
+			return InvalidIndex;
+		}
+
+		return m_Used[binding]++;
+	}
+
+	void BindlessHeap::WriteImage(Binding binding, uint32_t index, const Image* image, VkSampler sampler)
+	{
+		// Sampled images are read in the layout the render graph moves them to for sampling
+		VkDescriptorImageInfo imageInfo = {
+			.sampler = sampler,
+			.imageView = image->GetImageView(),
+			.imageLayout = binding == SampledImages ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_GENERAL,
+		};
+
+		VkWriteDescriptorSet write = {
+			.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+			.dstSet = m_Set,
+			.dstBinding = binding,
+			.dstArrayElement = index,
+			.descriptorCount = 1,
+			.descriptorType = s_DescriptorTypes[binding],
+			.pImageInfo = &imageInfo,
+		};
+
+		vkUpdateDescriptorSets(m_Device, 1, &write, 0, nullptr);
+		m_WriteCount++;
+	}
+
+	void BindlessHeap::WriteBuffer(uint32_t index, VkBuffer buffer)
+	{
+		VkDescriptorBufferInfo bufferInfo = { buffer, 0, VK_WHOLE_SIZE };
+
+		VkWriteDescriptorSet write = {
+			.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+			.dstSet = m_Set,
+			.dstBinding = StorageBuffers,
+			.dstArrayElement = index,
+			.descriptorCount = 1,
+			.descriptorType = s_DescriptorTypes[StorageBuffers],
+			.pBufferInfo = &bufferInfo,
+		};
+
+		vkUpdateDescriptorSets(m_Device, 1, &write, 0, nullptr);
+		m_WriteCount++;
+	}
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <volk.h>
+
+#include <array>
+#include <vector>
+#include <mutex>
+
+#include "Hog/Core/Base.h"
+
+namespace Hog {
+
+	class Image;
+
+	// Single update after bind descriptor set holding every sampled image, storage image and storage buffer the
+	// application creates. Resources register themselves on creation and shaders reach them through the index
+	// they got, so stages only bind the heap next to their own set instead of writing descriptors for them.
+	class BindlessHeap
+	{
+	public:
+		// Descriptor set index the heap occupies in every pipeline layout
+		static constexpr uint32_t Set = 1;
+		static constexpr uint32_t InvalidIndex = UINT32_MAX;
+
+		enum Binding : uint32_t
+		{
+			SampledImages = 0,
+			StorageImages,
+			StorageBuffers,
+			BindingCount
+		};
+	public:
+		static BindlessHeap& Get()
+		{
+			static BindlessHeap instance;
+
+			return instance;
+		}
+
+		static void Initialize() { Get().InitializeImpl(); }
+		static void Deinitialize() { Get().DeinitializeImpl(); }
+
+		static uint32_t RegisterSampledImage(const Image* image, VkSampler sampler) { return Get().RegisterImageImpl(SampledImages, image, sampler); }
+		static uint32_t RegisterStorageImage(const Image* image) { return Get().RegisterImageImpl(StorageImages, image, VK_NULL_HANDLE); }
+		static uint32_t RegisterStorageBuffer(VkBuffer buffer) { return Get().RegisterBufferImpl(buffer); }
+		// Rewrites the slots of a resource whose handles were recreated, like after aliasing
+		static void UpdateImage(const Image* image) { Get().UpdateImageImpl(image); }
+		static void UpdateStorageBuffer(uint32_t index, VkBuffer buffer) { Get().UpdateBufferImpl(index, buffer); }
+		// The slot is only handed out again once the frames in flight that could still read it have finished
+		static void Release(Binding binding, uint32_t index) { Get().ReleaseImpl(binding, index); }
+		// Called once per frame after waiting for the oldest frame in flight
+		static void AdvanceFrame(uint32_t framesInFlight) { Get().AdvanceFrameImpl(framesInFlight); }
+
+		// Number of descriptors written since the last call, for new resources and for recreated ones
+		static uint32_t ResetWriteCount() { return Get().ResetWriteCountImpl(); }
+
+		static VkDescriptorSetLayout GetLayout() { return Get().m_Layout; }
+		static VkDescriptorSet GetDescriptorSet() { return Get().m_Set; }
+		static uint32_t GetCapacity(Binding binding) { return Get().m_Capacity[binding]; }
+	public:
+		BindlessHeap(BindlessHeap const&) = delete;
+		void operator=(BindlessHeap const&) = delete;
+	private:
+		BindlessHeap() = default;
+
+		void InitializeImpl();
+		void DeinitializeImpl();
+		uint32_t RegisterImageImpl(Binding binding, const Image* image, VkSampler sampler);
+		uint32_t RegisterBufferImpl(VkBuffer buffer);
+		void UpdateImageImpl(const Image* image);
+		void UpdateBufferImpl(uint32_t index, VkBuffer buffer);
+		void ReleaseImpl(Binding binding, uint32_t index);
+		void AdvanceFrameImpl(uint32_t framesInFlight);
+		uint32_t ResetWriteCountImpl();
+
+		uint32_t AllocateSlot(Binding binding);
+		void WriteImage(Binding binding, uint32_t index, const Image* image, VkSampler sampler);
+		void WriteBuffer(uint32_t index, VkBuffer buffer);
+	private:
+		struct ImageSlot
+		{
+			const Image* Source = nullptr;
+			VkSampler Sampler = VK_NULL_HANDLE;
+		};
+
+		struct ReleasedSlot
+		{
+			Binding Array;
+			uint32_t Index;
+			uint64_t Frame;
+		};
+
+		bool m_Initialized = false;
+		VkDevice m_Device = VK_NULL_HANDLE;
+		VkDescriptorPool m_Pool = VK_NULL_HANDLE;
+		VkDescriptorSetLayout m_Layout = VK_NULL_HANDLE;
+		VkDescriptorSet m_Set = VK_NULL_HANDLE;
+
+		std::array<uint32_t, BindingCount> m_Capacity = {};
+		std::array<uint32_t, BindingCount> m_Used = {};
+		std::array<std::vector<uint32_t>, BindingCount> m_FreeSlots;
+		std::vector<ReleasedSlot> m_ReleasedSlots;
+		// Images behind the sampled and storage image slots, kept to rewrite them when an image gets recreated
+		std::array<std::vector<ImageSlot>, 2> m_ImageSlots;
+		uint64_t m_Frame = 0;
+		uint32_t m_WriteCount = 0;
+
+		std::mutex m_Mutex;
+	};
+}
@@ -3,15 +3,25 @@
 #include "Buffer.h"
 
 #include "Hog/Renderer/GraphicsContext.h"
+#include "Hog/Renderer/BindlessHeap.h"
 #include "Hog/Utils/RendererUtils.h"
 
+#include <atomic>
+
 namespace Hog
 {
+	static std::atomic<uint64_t> s_UploadedBytes = 0;
+
 	Ref<Buffer> Buffer::Create(BufferDescription type, size_t size)
 	{
 		return CreateRef<Buffer>(type, size);
 	}
 
+	uint64_t Buffer::ResetUploadedBytes()
+	{
+		return s_UploadedBytes.exchange(0);
+	}
+
 	Buffer::Buffer(BufferDescription description, size_t size)
 		:m_Description(description), m_Size(size)
 	{
@@ -33,63 +43,99 @@ namespace Hog
 			&m_Handle,
 			&m_Allocation,
 			&m_AllocationInfo));
+
+		vmaGetAllocationMemoryProperties(GraphicsContext::GetAllocator(), m_Allocation, &m_MemoryProperties);
+
+		if (buffeCreateInfo.usage & VK_BUFFER_USAGE_STORAGE_BUFFER_BIT)
+		{
+			m_GPUIndex = static_cast<int32_t>(BindlessHeap::RegisterStorageBuffer(m_Handle));
+		}
 	}
 
 	Buffer::~Buffer()
 	{
-		vmaDestroyBuffer(GraphicsContext::GetAllocator(), m_Handle, m_Allocation);
+		if (m_GPUIndex != -1)
+			BindlessHeap::Release(BindlessHeap::StorageBuffers, m_GPUIndex);
+
+		if (m_Mapped)
+			vmaUnmapMemory(GraphicsContext::GetAllocator(), m_Allocation);
+
+		if (m_Aliased)
+			vkDestroyBuffer(GraphicsContext::GetDevice(), m_Handle, nullptr);
+		else
+			vmaDestroyBuffer(GraphicsContext::GetAllocator(), m_Handle, m_Allocation);
 	}
 
-	void Buffer::WriteData(void* data, size_t size, size_t bufferOffset, size_t dataOffset)
+	void Buffer::Alias(VmaAllocation allocation)
 	{
-		HG_ASSERT(size <= m_Size, "Invalid write command. Tried to write more data then can fit buffer.");
+		HG_CORE_ASSERT(!IsHostVisible(), "Only device local buffers can be aliased");
 
-		VkMemoryPropertyFlags memPropFlags;
-		vmaGetAllocationMemoryProperties(GraphicsContext::GetAllocator(), m_Allocation, &memPropFlags);
+		if (m_Aliased)
+			vkDestroyBuffer(GraphicsContext::GetDevice(), m_Handle, nullptr);
+		else
+			vmaDestroyBuffer(GraphicsContext::GetAllocator(), m_Handle, m_Allocation);
 
-		if (memPropFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
-		{
-			// Allocation ended up in a mappable memory and is already mapped - write to it directly.
+		VkBufferCreateInfo buffeCreateInfo = {
+			.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+			.size = m_Size,
+			.usage = static_cast<VkBufferUsageFlags>(m_Description),
+			.sharingMode = static_cast<VkSharingMode>(m_Description),
+		};
 
-			void* memoryLocation = nullptr;
+		CheckVkResult(vmaCreateAliasingBuffer(GraphicsContext::GetAllocator(), allocation, &buffeCreateInfo, &m_Handle));
 
-			if (!m_AllocationInfo.pMappedData)
-			{
-				vmaMapMemory(GraphicsContext::GetAllocator(), m_Allocation, &memoryLocation);
-			}
-			else
-			{
-				memoryLocation = m_AllocationInfo.pMappedData;
-			}
+		m_Allocation = allocation;
+		vmaGetAllocationInfo(GraphicsContext::GetAllocator(), m_Allocation, &m_AllocationInfo);
+		vmaGetAllocationMemoryProperties(GraphicsContext::GetAllocator(), m_Allocation, &m_MemoryProperties);
+		m_Aliased = true;
 
-			memcpy((void*)((size_t)memoryLocation + bufferOffset), (void*)((size_t)data + dataOffset), size);
+		BindlessHeap::UpdateStorageBuffer(m_GPUIndex, m_Handle);
+	}
 
-			VkBufferMemoryBarrier2 memoryBarrier = {
-				.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2,
-				.srcStageMask = VK_PIPELINE_STAGE_2_HOST_BIT,
-				.srcAccessMask = VK_ACCESS_2_HOST_WRITE_BIT,
-				.dstStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
-				.dstAccessMask = VK_ACCESS_2_MEMORY_READ_BIT,
-				.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-				.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-				.buffer = m_Handle,
-				.size = m_Size,
-			};
+	void Buffer::Flush(size_t size, size_t offset)
+	{
+		CheckVkResult(vmaFlushAllocation(GraphicsContext::GetAllocator(), m_Allocation, offset, size));
+	}
 
-			VkDependencyInfo depenedencyInfo = {
-				.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
-				.bufferMemoryBarrierCount = 1,
-				.pBufferMemoryBarriers = &memoryBarrier,
-			};
+	VkMemoryRequirements Buffer::GetMemoryRequirements() const
+	{
+		VkMemoryRequirements requirements;
+		vkGetBufferMemoryRequirements(GraphicsContext::GetDevice(), m_Handle, &requirements);
+		return requirements;
+	}
 
-			GraphicsContext::ImmediateSubmit([depenedencyInfo](VkCommandBuffer commandBuffer)
-			{
-				vkCmdPipelineBarrier2(commandBuffer, &depenedencyInfo);
-			});
+	bool Buffer::IsHostVisible() const
+	{
+		return m_MemoryProperties & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+	}
+
+	void* Buffer::Map()
+	{
+		// Buffers created without the mapped flag are mapped on first use and stay mapped until they are destroyed
+		if (!m_AllocationInfo.pMappedData)
+		{
+			CheckVkResult(vmaMapMemory(GraphicsContext::GetAllocator(), m_Allocation, &m_AllocationInfo.pMappedData));
+			m_Mapped = true;
+		}
+
+		return m_AllocationInfo.pMappedData;
+	}
+
+	void Buffer::WriteData(void* data, size_t size, size_t bufferOffset, size_t dataOffset)
+	{
+		HG_ASSERT(size <= m_Size, "Invalid write command. Tried to write more data then can fit buffer.");
 
-			if (memoryLocation != m_AllocationInfo.pMappedData)
+		if (m_MemoryProperties & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+		{
+			// Host writes are made visible to the device by the next queue submission, so there is nothing to record.
+			// Only non coherent memory has to be flushed first.
+			memcpy(static_cast<uint8_t*>(Map()) + bufferOffset, static_cast<uint8_t*>(data) + dataOffset, size);
+			// Device local buffers are written through a staging buffer, which lands here as well
+			s_UploadedBytes += size;
+
+			if (!(m_MemoryProperties & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT))
 			{
-				vmaUnmapMemory(GraphicsContext::GetAllocator(), m_Allocation);
+				Flush(size, bufferOffset);
 			}
 		}
 		else
@@ -136,38 +182,17 @@ namespace Hog
 	void Buffer::ReadData(void* data, size_t size, size_t bufferOffset, size_t dataOffset)
 	{
 		HG_ASSERT(size <= m_Size, "Invalid read command. Buffer contents do not fit in data.");
-		
-		VkMemoryPropertyFlags memPropFlags;
-		vmaGetAllocationMemoryProperties(GraphicsContext::GetAllocator(), m_Allocation, &memPropFlags);
 
-		if (memPropFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+		if (m_MemoryProperties & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
 		{
-			// Allocation ended up in a mappable memory and is already mapped - write to it directly.
-
-			VkBufferMemoryBarrier2 memoryBarrier = {
-				.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2,
-				.srcStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
-				.srcAccessMask = VK_ACCESS_2_MEMORY_WRITE_BIT,
-				.dstStageMask = VK_PIPELINE_STAGE_2_HOST_BIT,
-				.dstAccessMask = VK_ACCESS_2_HOST_READ_BIT,
-				.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-				.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-				.buffer = m_Handle,
-				.size = m_Size,
-			};
-
-			VkDependencyInfo depenedencyInfo = {
-				.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
-				.bufferMemoryBarrierCount = 1,
-				.pBufferMemoryBarriers = &memoryBarrier,
-			};
-
-			GraphicsContext::ImmediateSubmit([=](VkCommandBuffer commandBuffer)
+			// The device writes have to be done already. The renderer makes them available to the host at the end of
+			// every submission, so only non coherent memory has to be invalidated before reading.
+			if (!(m_MemoryProperties & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT))
 			{
-				vkCmdPipelineBarrier2(commandBuffer, &depenedencyInfo);
-			});
+				CheckVkResult(vmaInvalidateAllocation(GraphicsContext::GetAllocator(), m_Allocation, bufferOffset, size));
+			}
 
-			memcpy((void*)((size_t)data + dataOffset), (void*)((size_t)m_AllocationInfo.pMappedData + bufferOffset), m_Size);
+			memcpy(static_cast<uint8_t*>(data) + dataOffset, static_cast<uint8_t*>(Map()) + bufferOffset, size);
 		}
 		else
 		{
@@ -194,6 +219,21 @@ namespace Hog
 				.pBufferMemoryBarriers = &memoryBarrier,
 			};
 
+			// The staging buffer is read on the host right after the submission
+			VkMemoryBarrier2 readbackBarrier = {
+				.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+				.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT,
+				.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+				.dstStageMask = VK_PIPELINE_STAGE_2_HOST_BIT,
+				.dstAccessMask = VK_ACCESS_2_HOST_READ_BIT,
+			};
+
+			VkDependencyInfo readbackDependencyInfo = {
+				.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+				.memoryBarrierCount = 1,
+				.pMemoryBarriers = &readbackBarrier,
+			};
+
 			GraphicsContext::ImmediateSubmit([=](VkCommandBuffer commandBuffer)
 			{
 				vkCmdPipelineBarrier2(commandBuffer, &depenedencyInfo);
@@ -203,6 +243,8 @@ namespace Hog
 				copy.srcOffset = bufferOffset;
 				copy.size = stagingBuf->GetSize();
 				vkCmdCopyBuffer(commandBuffer, m_Handle, stagingBuf->GetHandle(), 1, &copy);
+
+				vkCmdPipelineBarrier2(commandBuffer, &readbackDependencyInfo);
 			});
 
 			stagingBuf->ReadData(data, size, 0, dataOffset);
@@ -14,26 +14,44 @@ namespace Hog {
 	{
 	public:
 		static Ref<Buffer> Create(BufferDescription description, size_t size);
+		// Bytes written to buffers through WriteData since the last call, summed over every buffer
+		static uint64_t ResetUploadedBytes();
 	public:
 		Buffer(BufferDescription description, size_t size);
 		~Buffer();
 
 		void WriteData(void* data, size_t size, size_t bufferOffset = 0, size_t dataOffset = 0);
 		void ReadData(void* data, size_t size, size_t bufferOffset = 0, size_t dataOffset = 0);
+		// Makes writes through the mapped pointer visible to the device, only does something on non coherent memory
+		void Flush(size_t size = VK_WHOLE_SIZE, size_t offset = 0);
 		const VkBuffer& GetHandle() const { return m_Handle; }
 		size_t GetSize() const { return m_Size; }
 		BufferDescription GetBufferDescription() const { return m_Description; }
 
 		VkDeviceAddress GetBufferDeviceAddress();
+		// Index of the buffer in the storage buffer array of the bindless heap, -1 for buffers without storage usage
+		int32_t GetGPUIndex() const { return m_GPUIndex; }
+
+		// Recreates the buffer on top of memory shared with other resources. Contents are lost.
+		void Alias(VmaAllocation allocation);
+		VkMemoryRequirements GetMemoryRequirements() const;
+		bool IsHostVisible() const;
+		// Persistent pointer to host visible memory, mapping it the first time it is asked for
+		void* Map();
 
 		operator void* () { return m_AllocationInfo.pMappedData; }
 	private:
 		VkBuffer m_Handle;
 		VmaAllocation m_Allocation;
 		VmaAllocationInfo m_AllocationInfo;
+		VkMemoryPropertyFlags m_MemoryProperties = 0;
 
 		BufferDescription m_Description;
 		size_t m_Size;
+		bool m_Aliased = false;
+		// Mapped by Map rather than created mapped, so it has to be unmapped on destruction
+		bool m_Mapped = false;
+		int32_t m_GPUIndex = -1;
 	};
 
 	class BufferRegion
@@ -47,6 +65,7 @@ namespace Hog {
 		void ReadData(void* data, size_t size, size_t bufferOffset = 0, size_t dataOffset = 0);
 		size_t GetSize() const { return m_Size; }
 		size_t GetOffset() const { return m_Offset; }
+		const Ref<Buffer>& GetBuffer() const { return m_Buffer; }
 	private:
 		Ref<Buffer> m_Buffer;
 		size_t m_Offset;
@@ -306,6 +306,183 @@ namespace Hog {
 	}
 
 
+	void DescriptorWriter::Begin(VkDescriptorSet set)
+	{
+		m_Set = set;
+		m_Writes.clear();
+		m_InfoOffsets.clear();
+		m_ImageInfos.clear();
+		m_BufferInfos.clear();
+		m_AccelerationStructureInfos.clear();
+		m_ArrayOpen = false;
+	}
+
+	DescriptorWriter& DescriptorWriter::WriteBuffer(uint32_t binding, VkDescriptorType type, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range)
+	{
+		m_ArrayOpen = false;
+
+		m_Writes.push_back({
+			.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+			.dstSet = m_Set,
+			.dstBinding = binding,
+			.descriptorCount = 1,
+			.descriptorType = type,
+		});
+		m_InfoOffsets.push_back(static_cast<uint32_t>(m_BufferInfos.size()));
+		m_BufferInfos.push_back({ buffer, offset, range });
+
+		return *this;
+	}
+
+	DescriptorWriter& DescriptorWriter::WriteImage(uint32_t binding, VkDescriptorType type, VkSampler sampler, VkImageView imageView, VkImageLayout layout)
+	{
+		// Elements of an open array write extend it instead of starting a new write
+		if (m_ArrayOpen && m_Writes.back().dstBinding == binding)
+		{
+			m_Writes.back().descriptorCount++;
+		}
+		else
+		{
+			m_ArrayOpen = false;
+			m_Writes.push_back({
+				.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+				.dstSet = m_Set,
+				.dstBinding = binding,
+				.descriptorCount = 1,
+				.descriptorType = type,
+			});
+			m_InfoOffsets.push_back(static_cast<uint32_t>(m_ImageInfos.size()));
+		}
+
+		m_ImageInfos.push_back({ sampler, imageView, layout });
+
+		return *this;
+	}
+
+	DescriptorWriter& DescriptorWriter::WriteImageArray(uint32_t binding, VkDescriptorType type)
+	{
+		m_Writes.push_back({
+			.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+			.dstSet = m_Set,
+			.dstBinding = binding,
+			.descriptorCount = 0,
+			.descriptorType = type,
+		});
+		m_InfoOffsets.push_back(static_cast<uint32_t>(m_ImageInfos.size()));
+		m_ArrayOpen = true;
+
+		return *this;
+	}
+
+	DescriptorWriter& DescriptorWriter::WriteAccelerationStructure(uint32_t binding, const VkAccelerationStructureKHR* accelerationStructure)
+	{
+		m_ArrayOpen = false;
+
+		m_Writes.push_back({
+			.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+			.dstSet = m_Set,
+			.dstBinding = binding,
+			.descriptorCount = 1,
+			.descriptorType = VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR,
+		});
+		m_InfoOffsets.push_back(static_cast<uint32_t>(m_AccelerationStructureInfos.size()));
+		m_AccelerationStructureInfos.push_back({
+			.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET_ACCELERATION_STRUCTURE_KHR,
+			.accelerationStructureCount = 1,
+			.pAccelerationStructures = accelerationStructure,
+		});
+
+		return *this;
+	}
+
+	void DescriptorWriter::Update(VkDevice device)
+	{
+		uint32_t writeCount = 0;
+		for (uint32_t i = 0; i < m_Writes.size(); i++)
+		{
+			VkWriteDescriptorSet& write = m_Writes[i];
+
+			switch (write.descriptorType)
+			{
+			case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER:
+			case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER:
+			case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC:
+			case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC:
+				write.pBufferInfo = &m_BufferInfos[m_InfoOffsets[i]];
+				break;
+			case VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR:
+				write.pNext = &m_AccelerationStructureInfos[m_InfoOffsets[i]];
+				break;
+			default:
+				write.pImageInfo = m_ImageInfos.data() + m_InfoOffsets[i];
+				break;
+			}
+
+			// An empty array has nothing to write
+			if (write.descriptorCount > 0)
+			{
+				m_Writes[writeCount++] = write;
+			}
+		}
+
+		vkUpdateDescriptorSets(device, writeCount, m_Writes.data(), 0, nullptr);
+	}
+
+
+	void DescriptorSetCache::Init(VkDevice newDevice)
+	{
+		m_Device = newDevice;
+		m_Allocator.Init(newDevice);
+	}
+
+	void DescriptorSetCache::Cleanup()
+	{
+		m_Allocator.Cleanup();
+		m_Sets.clear();
+	}
+
+	VkDescriptorSet DescriptorSetCache::Get(VkDescriptorSetLayout layout, const Key& key, const WriteFunction& write)
+	{
+		auto it = m_Sets.find(key);
+		if (it != m_Sets.end())
+		{
+			return it->second;
+		}
+
+		VkDescriptorSet set = VK_NULL_HANDLE;
+		bool success = m_Allocator.Allocate(&set, layout);
+		HG_CORE_ASSERT(success, "Failed to allocate descriptor set");
+
+		m_Writer.Begin(set);
+		write(m_Writer);
+		m_Writer.Update(m_Device);
+
+		m_Sets.emplace(key, set);
+		m_WriteCount++;
+
+		return set;
+	}
+
+	uint32_t DescriptorSetCache::ResetWriteCount()
+	{
+		uint32_t count = m_WriteCount;
+		m_WriteCount = 0;
+		return count;
+	}
+
+	std::size_t DescriptorSetCache::KeyHash::operator()(const Key& key) const
+	{
+		std::size_t result = std::hash<size_t>()(key.size());
+
+		for (uint64_t value : key)
+		{
+			result ^= std::hash<uint64_t>()(value) + 0x9e3779b9 + (result << 6) + (result >> 2);
+		}
+
+		return result;
+	}
+
+
 	bool DescriptorLayoutCache::DescriptorLayoutInfo::operator==(const DescriptorLayoutInfo& other) const
 	{
 		if (other.Bindings.size() != Bindings.size())
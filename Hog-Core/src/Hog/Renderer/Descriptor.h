@@ -7,6 +7,7 @@
 #include <vector>
 #include <array>
 #include <unordered_map>
+#include <functional>
 
 namespace Hog {
 
@@ -25,7 +26,7 @@ namespace Hog {
 				{ VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER, 1.f },
 				{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2.f },
 				{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2.f },
-				{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1.f },
+				{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 2.f },
 				{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1.f },
 				{ VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, 0.5f },
 				{ VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR, 1.f }
@@ -106,5 +107,64 @@ namespace Hog {
 		DescriptorLayoutCache* m_Cache;
 		DescriptorAllocator* m_Alloc;
 	};
+
+
+	// Collects the writes of a descriptor set. The infos live in arrays that are reused from one set to the next,
+	// so writing a set stops allocating once they have grown large enough.
+	class DescriptorWriter {
+	public:
+		void Begin(VkDescriptorSet set);
+
+		DescriptorWriter& WriteBuffer(uint32_t binding, VkDescriptorType type, VkBuffer buffer, VkDeviceSize offset = 0, VkDeviceSize range = VK_WHOLE_SIZE);
+		DescriptorWriter& WriteImage(uint32_t binding, VkDescriptorType type, VkSampler sampler, VkImageView imageView, VkImageLayout layout);
+		// Starts an array write, the elements are added with WriteImage on the same binding right after
+		DescriptorWriter& WriteImageArray(uint32_t binding, VkDescriptorType type);
+		DescriptorWriter& WriteAccelerationStructure(uint32_t binding, const VkAccelerationStructureKHR* accelerationStructure);
+
+		void Update(VkDevice device);
+	private:
+		VkDescriptorSet m_Set = VK_NULL_HANDLE;
+		std::vector<VkWriteDescriptorSet> m_Writes;
+		// Index of every write's first info, the pointers are only resolved in Update because the arrays can still grow before that
+		std::vector<uint32_t> m_InfoOffsets;
+		std::vector<VkDescriptorImageInfo> m_ImageInfos;
+		std::vector<VkDescriptorBufferInfo> m_BufferInfos;
+		std::vector<VkWriteDescriptorSetAccelerationStructureKHR> m_AccelerationStructureInfos;
+		bool m_ArrayOpen = false;
+	};
+
+
+	// Descriptor sets that outlive the frame they were created in. A set is looked up by its layout and every handle
+	// and image layout bound to it, it is only allocated and written the first time a combination shows up. Sets are
+	// never updated after that, so frames in flight can keep using them while a new combination gets its own set.
+	class DescriptorSetCache {
+	public:
+		// The key of a set, it has to start with the layout followed by everything bound to the set
+		using Key = std::vector<uint64_t>;
+		using WriteFunction = std::function<void(DescriptorWriter& writer)>;
+
+		void Init(VkDevice newDevice);
+		void Cleanup();
+
+		VkDescriptorSet Get(VkDescriptorSetLayout layout, const Key& key, const WriteFunction& write);
+
+		// Number of sets allocated and written since the last call
+		uint32_t ResetWriteCount();
+		size_t GetSetCount() const { return m_Sets.size(); }
+
+		template<typename T>
+		static uint64_t ToKey(T handle) { return (uint64_t)handle; }
+	private:
+		struct KeyHash
+		{
+			std::size_t operator()(const Key& key) const;
+		};
+
+		std::unordered_map<Key, VkDescriptorSet, KeyHash> m_Sets;
+		DescriptorAllocator m_Allocator;
+		DescriptorWriter m_Writer;
+		uint32_t m_WriteCount = 0;
+		VkDevice m_Device;
+	};
 }
 
@@ -0,0 +1,66 @@
+#include "hgpch.h"
+
+#include "FrameAllocator.h"
+
+#include "Hog/Renderer/GraphicsContext.h"
+
+namespace Hog
+{
+	static size_t AlignUp(size_t value, size_t alignment)
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+
+	void FrameAllocator::Init(size_t frameSize, uint32_t frameCount)
+	{
+		const auto& limits = GraphicsContext::GetGPUInfo()->DeviceProperties2.properties.limits;
+		m_Alignment = std::max<size_t>({ 1, limits.minUniformBufferOffsetAlignment, limits.minStorageBufferOffsetAlignment, limits.nonCoherentAtomSize });
+
+		// Every region starts aligned, so offsets inside of it only have to be aligned relative to its start
+		m_FrameSize = AlignUp(frameSize, m_Alignment);
+		m_Buffer = Buffer::Create(BufferDescription::Defaults::TransientBuffer, m_FrameSize * frameCount);
+		m_FrameBegin = 0;
+		m_Offset = 0;
+	}
+
+	void FrameAllocator::BeginFrame(uint32_t frameIndex)
+	{
+		m_FrameBegin = m_FrameSize * frameIndex;
+		m_Offset = m_FrameBegin;
+	}
+
+	FrameAllocator::Allocation FrameAllocator::Allocate(size_t size)
+	{
+		// Past its own region the allocation would overwrite data of another frame in flight, or run past the buffer
+		if (m_Offset + size > m_FrameBegin + m_FrameSize)
+		{
+			HG_CORE_CRITICAL("Frame allocator is out of memory, increase renderer.frameAllocatorSize");
+			std::abort();
+		}
+
+		Allocation allocation = {
+			.Buffer = m_Buffer->GetHandle(),
+			.Offset = m_Offset,
+			.Data = static_cast<uint8_t*>(static_cast<void*>(*m_Buffer)) + m_Offset,
+		};
+
+		m_Offset = AlignUp(m_Offset + size, m_Alignment);
+
+		return allocation;
+	}
+
+	void FrameAllocator::Flush()
+	{
+		if (m_Offset == m_FrameBegin) return;
+
+		m_Buffer->Flush(m_Offset - m_FrameBegin, m_FrameBegin);
+	}
+
+	void FrameAllocator::Cleanup()
+	{
+		m_Buffer.reset();
+		m_FrameSize = 0;
+		m_FrameBegin = 0;
+		m_Offset = 0;
+	}
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "Hog/Renderer/Buffer.h"
+
+namespace Hog
+{
+	// Linear allocator for data that only lives for one frame, like per frame uniforms. It owns a single persistently
+	// mapped buffer split into a region per frame in flight and bumps allocations off the region of the current frame,
+	// so writing them is a plain memcpy without any submission. A region is reused once its frame context is free again.
+	class FrameAllocator
+	{
+	public:
+		struct Allocation
+		{
+			VkBuffer Buffer = VK_NULL_HANDLE;
+			VkDeviceSize Offset = 0;
+			void* Data = nullptr;
+		};
+	public:
+		void Init(size_t frameSize, uint32_t frameCount);
+		// Starts handing out the region of the frame, the GPU has to be done with its previous allocations
+		void BeginFrame(uint32_t frameIndex);
+		// Allocations are aligned for both uniform and storage buffer offsets. Only meant for the main thread.
+		Allocation Allocate(size_t size);
+		// Makes the frame's allocations visible to the device, only does something on non coherent memory
+		void Flush();
+		void Cleanup();
+
+		const Ref<Buffer>& GetBuffer() const { return m_Buffer; }
+		size_t GetUsedSize() const { return m_Offset - m_FrameBegin; }
+	private:
+		Ref<Buffer> m_Buffer;
+		size_t m_FrameSize = 0;
+		size_t m_Alignment = 1;
+		size_t m_FrameBegin = 0;
+		size_t m_Offset = 0;
+	};
+}
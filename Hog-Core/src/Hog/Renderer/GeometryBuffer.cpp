@@ -0,0 +1,147 @@
+#include "hgpch.h"
+#include "GeometryBuffer.h"
+
+#include "Hog/Core/CVars.h"
+
+AutoCVar_Int CVar_GeometryVertexCapacity("renderer.geometry.vertexCapacity", "Number of vertices the shared vertex buffer holds", 1024 * 1024, CVarFlags::EditReadOnly);
+AutoCVar_Int CVar_GeometryIndexCapacity("renderer.geometry.indexCapacity", "Number of 16 bit indices the shared index buffer holds", 4 * 1024 * 1024, CVarFlags::EditReadOnly);
+AutoCVar_Int CVar_GeometryCompactVertices("renderer.geometry.compactVertices", "Store mesh vertices quantized and octahedral encoded, 20 bytes instead of 48", 0, CVarFlags::EditReadOnly);
+
+namespace Hog {
+
+	// Vertex shaders declare the attributes of either format as Position, TexCoords, Normal and Tangent at locations 0 to 3
+	static const std::array<VkVertexInputAttributeDescription, 4> s_VertexAttributes = { {
+		{ 0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, Position) },
+		{ 1, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(Vertex, TexCoords) },
+		{ 2, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, Normal) },
+		{ 3, 0, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(Vertex, Tangent) },
+	} };
+
+	static const std::array<VkVertexInputAttributeDescription, 4> s_CompactVertexAttributes = { {
+		{ 0, 0, VK_FORMAT_R16G16B16A16_SNORM, offsetof(CompactVertex, Position) },
+		{ 1, 0, VK_FORMAT_R16G16_SFLOAT, offsetof(CompactVertex, TexCoords) },
+		{ 2, 0, VK_FORMAT_R16G16_SNORM, offsetof(CompactVertex, Normal) },
+		{ 3, 0, VK_FORMAT_R16G16_SNORM, offsetof(CompactVertex, Tangent) },
+	} };
+
+	std::optional<VkVertexInputAttributeDescription> GeometryBuffer::GetVertexAttribute(uint32_t location)
+	{
+		const auto& attributes = UsesCompactVertices() ? s_CompactVertexAttributes : s_VertexAttributes;
+		if (location >= attributes.size()) return std::nullopt;
+
+		return attributes[location];
+	}
+
+	void GeometryBuffer::InitializeImpl()
+	{
+		HG_PROFILE_FUNCTION();
+
+		std::lock_guard lock(m_Mutex);
+
+		m_CompactVertices = CVar_GeometryCompactVertices.Get() != 0;
+		m_UnitSizes = { GetVertexStride(), sizeof(uint16_t) };
+		const std::array<size_t, KindCount> capacities = {
+			static_cast<size_t>(CVar_GeometryVertexCapacity.Get()),
+			static_cast<size_t>(CVar_GeometryIndexCapacity.Get()),
+		};
+
+		m_Buffers[Vertices] = Buffer::Create(BufferDescription::Defaults::VertexBuffer, capacities[Vertices] * m_UnitSizes[Vertices]);
+		m_Buffers[Indices] = Buffer::Create(BufferDescription::Defaults::IndexBuffer, capacities[Indices] * m_UnitSizes[Indices]);
+
+		for (uint32_t i = 0; i < KindCount; i++)
+		{
+			m_Allocators[i].Reset(capacities[i]);
+		}
+
+		m_ReleasedRanges.clear();
+		m_Frame = 0;
+		m_Initialized = true;
+
+		HG_CORE_INFO("Shared geometry buffers hold {0} vertices of {1} bytes and {2} indices of 16 bits", capacities[Vertices],
+			m_UnitSizes[Vertices], capacities[Indices]);
+	}
+
+	void GeometryBuffer::DeinitializeImpl()
+	{
+		std::lock_guard lock(m_Mutex);
+
+		m_Initialized = false;
+		m_ReleasedRanges.clear();
+
+		for (auto& buffer : m_Buffers)
+		{
+			buffer.reset();
+		}
+	}
+
+	Ref<BufferRegion> GeometryBuffer::AllocateImpl(Kind kind, size_t count, size_t elementSize)
+	{
+		std::lock_guard lock(m_Mutex);
+
+		HG_CORE_ASSERT(m_Initialized, "Geometry buffer used before GraphicsContext::Initialize");
+
+		// Elements wider than the allocator's unit start at a multiple of their own size
+		const size_t unitSize = m_UnitSizes[kind];
+		const uint64_t units = count * elementSize / unitSize;
+
+		auto offset = m_Allocators[kind].Allocate(units, elementSize / unitSize);
+		if (!offset && units != 0)
+		{
+			// Any region handed out instead would overlap another primitive's geometry
+			HG_CORE_CRITICAL(kind == Vertices ?
+				"Shared vertex buffer is out of memory, increase renderer.geometry.vertexCapacity" :
+				"Shared index buffer is out of memory, increase renderer.geometry.indexCapacity");
+			std::abort();
+		}
+
+		const uint64_t first = offset.value_or(0);
+
+		return Ref<BufferRegion>(new BufferRegion(m_Buffers[kind], first * unitSize, units * unitSize),
+			[this, kind, first, units](BufferRegion* region)
+			{
+				ReleaseImpl(kind, first, units);
+				delete region;
+			});
+	}
+
+	void GeometryBuffer::ReleaseImpl(Kind kind, uint64_t offset, uint64_t count)
+	{
+		std::lock_guard lock(m_Mutex);
+
+		// Meshes that outlive the device have nothing left to release
+		if (!m_Initialized || count == 0) return;
+
+		m_ReleasedRanges.push_back({ kind, offset, count, m_Frame });
+	}
+
+	void GeometryBuffer::AdvanceFrameImpl(uint32_t framesInFlight)
+	{
+		std::lock_guard lock(m_Mutex);
+
+		m_Frame++;
+
+		auto retired = std::partition(m_ReleasedRanges.begin(), m_ReleasedRanges.end(),
+			[this, framesInFlight](const ReleasedRange& range) { return range.Frame + framesInFlight > m_Frame; });
+
+		for (auto it = retired; it != m_ReleasedRanges.end(); ++it)
+		{
+			m_Allocators[it->Buffer].Free(it->Offset, it->Count);
+		}
+
+		m_ReleasedRanges.erase(retired, m_ReleasedRanges.end());
+	}
+
+	void GeometryBuffer::BindImpl(VkCommandBuffer commandBuffer)
+	{
+		VkBuffer vertexBuffer = m_Buffers[Vertices]->GetHandle();
+		VkDeviceSize offset = 0;
+
+		vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertexBuffer, &offset);
+		vkCmdBindIndexBuffer(commandBuffer, m_Buffers[Indices]->GetHandle(), 0, VK_INDEX_TYPE_UINT16);
+	}
+
+	void GeometryBuffer::BindIndicesImpl(VkCommandBuffer commandBuffer, VkIndexType indexType)
+	{
+		vkCmdBindIndexBuffer(commandBuffer, m_Buffers[Indices]->GetHandle(), 0, indexType);
+	}
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <array>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+#include "Hog/Renderer/Buffer.h"
+#include "Hog/Utils/FreeListAllocator.h"
+
+namespace Hog {
+
+	// One vertex buffer and one index buffer shared by every mesh. Primitives get regions of them, so a stage binds its
+	// geometry once and draws tell primitives apart by their first index and vertex offset, which also lets indirect
+	// draws and vertex pulling reach all of it. Regions are counted in whole vertices and indices.
+	//
+	// Every vertex has the same format, either Vertex or CompactVertex as renderer.geometry.compactVertices picks. Index
+	// width is up to the primitive, regions of 32 bit indices start at a multiple of four bytes so draws can reach them
+	// with the buffer bound as either type.
+	class GeometryBuffer
+	{
+	public:
+		// Specialization constant telling vertex shaders that their inputs are compact vertices
+		static constexpr uint32_t CompactVerticesConstantID = 100;
+	public:
+		static GeometryBuffer& Get()
+		{
+			static GeometryBuffer instance;
+
+			return instance;
+		}
+
+		static void Initialize() { Get().InitializeImpl(); }
+		static void Deinitialize() { Get().DeinitializeImpl(); }
+
+		// The region gives its range back when the last reference to it goes away
+		static Ref<BufferRegion> AllocateVertices(size_t count) { return Get().AllocateImpl(Vertices, count, GetVertexStride()); }
+		static Ref<BufferRegion> AllocateIndices(size_t count, VkIndexType indexType = VK_INDEX_TYPE_UINT16)
+		{
+			return Get().AllocateImpl(Indices, count, indexType == VK_INDEX_TYPE_UINT32 ? sizeof(uint32_t) : sizeof(uint16_t));
+		}
+		// Released ranges are only handed out again once the frames in flight that could still read them have finished
+		static void AdvanceFrame(uint32_t framesInFlight) { Get().AdvanceFrameImpl(framesInFlight); }
+
+		static const Ref<Buffer>& GetVertexBuffer() { return Get().m_Buffers[Vertices]; }
+		static const Ref<Buffer>& GetIndexBuffer() { return Get().m_Buffers[Indices]; }
+		// Binds both buffers at offset zero, the index buffer as 16 bit indices
+		static void Bind(VkCommandBuffer commandBuffer) { Get().BindImpl(commandBuffer); }
+		// Rebinds the index buffer for draws of primitives with the other index width
+		static void BindIndices(VkCommandBuffer commandBuffer, VkIndexType indexType) { Get().BindIndicesImpl(commandBuffer, indexType); }
+
+		static bool UsesCompactVertices() { return Get().m_CompactVertices; }
+		static uint32_t GetVertexStride() { return static_cast<uint32_t>(Get().m_CompactVertices ? sizeof(CompactVertex) : sizeof(Vertex)); }
+		// Format and offset of the vertex attribute vertex shaders declare at the location, if the vertex format has one
+		static std::optional<VkVertexInputAttributeDescription> GetVertexAttribute(uint32_t location);
+	public:
+		GeometryBuffer(GeometryBuffer const&) = delete;
+		void operator=(GeometryBuffer const&) = delete;
+	private:
+		enum Kind : uint32_t
+		{
+			Vertices = 0,
+			Indices,
+			KindCount
+		};
+
+		GeometryBuffer() = default;
+
+		void InitializeImpl();
+		void DeinitializeImpl();
+		Ref<BufferRegion> AllocateImpl(Kind kind, size_t count, size_t elementSize);
+		void ReleaseImpl(Kind kind, uint64_t offset, uint64_t count);
+		void AdvanceFrameImpl(uint32_t framesInFlight);
+		void BindImpl(VkCommandBuffer commandBuffer);
+		void BindIndicesImpl(VkCommandBuffer commandBuffer, VkIndexType indexType);
+	private:
+		struct ReleasedRange
+		{
+			Kind Buffer;
+			uint64_t Offset;
+			uint64_t Count;
+			uint64_t Frame;
+		};
+
+		bool m_Initialized = false;
+		bool m_CompactVertices = false;
+		std::array<Ref<Buffer>, KindCount> m_Buffers;
+		// Allocators count in vertices and in 16 bit indices
+		std::array<Util::FreeListAllocator, KindCount> m_Allocators;
+		std::array<size_t, KindCount> m_UnitSizes = {};
+		std::vector<ReleasedRange> m_ReleasedRanges;
+		uint64_t m_Frame = 0;
+
+		std::mutex m_Mutex;
+	};
+}
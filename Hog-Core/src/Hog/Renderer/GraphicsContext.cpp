@@ -3,11 +3,16 @@
 
 #include "Hog/Core/CVars.h"
 #include "Hog/Core/Application.h"
+#include "Hog/Renderer/BindlessHeap.h"
+#include "Hog/Renderer/UploadBatch.h"
+#include "Hog/Renderer/GeometryBuffer.h"
 #include "Hog/Utils/RendererUtils.h"
 
 AutoCVar_Int CVar_MSAA("renderer.enableMSAA", "Enables MSAA for renderer", 0, CVarFlags::EditReadOnly);
 AutoCVar_Int CVar_ValidationLayers("renderer.enableValidationLayers", "Enables Vulkan validation layers", 1, CVarFlags::EditReadOnly);
-AutoCVar_Int CVar_FrameCount("renderer.frameCount", "Number off frames being rendered", 2, CVarFlags::EditReadOnly);
+AutoCVar_Int CVar_FrameCount("renderer.frameCount", "Number of frames the CPU records while the GPU still executes earlier ones", 2, CVarFlags::EditReadOnly);
+AutoCVar_Int CVar_TransferQueue("renderer.transferQueue", "Uploads data on a dedicated transfer queue when the device exposes one", 1, CVarFlags::EditReadOnly);
+AutoCVar_Int CVar_SwapchainImageCount("renderer.swapchainImageCount", "Minimum number of swapchain images, independent of the frames in flight", 3, CVarFlags::EditReadOnly);
 
 namespace Hog {
 
@@ -149,6 +154,9 @@ namespace Hog {
 		CreateCommandPools();
 		CreateCommandBuffers();
 		CreateSwapChain();
+		BindlessHeap::Initialize();
+		UploadContext::Initialize();
+		GeometryBuffer::Initialize();
 
 		HG_PROFILE_GPU_INIT_VULKAN(&m_Device, &m_PhysicalDevice, &m_Queue, &m_QueueFamilyIndex, 1, nullptr);
 
@@ -168,6 +176,10 @@ namespace Hog {
 
 		vkDestroyCommandPool(m_Device, m_UploadCommandPool, nullptr);
 
+		GeometryBuffer::Deinitialize();
+		UploadContext::Deinitialize();
+		BindlessHeap::Deinitialize();
+
 		vmaDestroyAllocator(m_Allocator);
 
 		vkDestroyDevice(m_Device, nullptr);
@@ -279,6 +291,7 @@ namespace Hog {
 
 		vkWaitForFences(m_Device, 1, &UploadFence, true, 9999999999);
 		vkResetFences(m_Device, 1, &UploadFence);
+		m_ImmediateSubmitCount++;
 
 		//clear the command pool. This will free the command buffer too
 		vkResetCommandPool(m_Device, m_UploadCommandPool, 0);
@@ -310,27 +323,64 @@ namespace Hog {
 		return semaphore;
 	}
 
-	VkCommandPool GraphicsContext::CreateCommandPoolImpl()
+	VkSemaphore GraphicsContext::CreateTimelineSemaphoreImpl(uint64_t initialValue)
+	{
+		VkSemaphore semaphore;
+
+		VkSemaphoreTypeCreateInfo semaphoreTypeCreateInfo = {
+			.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+			.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+			.initialValue = initialValue,
+		};
+
+		VkSemaphoreCreateInfo semaphoreCreateInfo = {
+			.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+			.pNext = &semaphoreTypeCreateInfo,
+		};
+
+		CheckVkResult(vkCreateSemaphore(m_Device, &semaphoreCreateInfo, nullptr, &semaphore));
+
+		return semaphore;
+	}
+
+	VkQueryPool GraphicsContext::CreateQueryPoolImpl(VkQueryType type, uint32_t count, VkQueryPipelineStatisticFlags statistics)
+	{
+		VkQueryPool queryPool;
+
+		VkQueryPoolCreateInfo queryPoolCreateInfo = {
+			.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+			.queryType = type,
+			.queryCount = count,
+			.pipelineStatistics = statistics,
+		};
+
+		CheckVkResult(vkCreateQueryPool(m_Device, &queryPoolCreateInfo, nullptr, &queryPool));
+		vkResetQueryPool(m_Device, queryPool, 0, count);
+
+		return queryPool;
+	}
+
+	VkCommandPool GraphicsContext::CreateCommandPoolImpl(uint32_t queueFamily)
 	{
 		VkCommandPool commandPool;
 
 		VkCommandPoolCreateInfo commandPoolCreateInfo = {};
 		commandPoolCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
 		commandPoolCreateInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-		commandPoolCreateInfo.queueFamilyIndex = m_QueueFamilyIndex;
+		commandPoolCreateInfo.queueFamilyIndex = queueFamily;
 
 		CheckVkResult(vkCreateCommandPool(m_Device, &commandPoolCreateInfo, nullptr, &commandPool));
 
 		return commandPool;
 	}
 
-	VkCommandBuffer GraphicsContext::CreateCommandBufferImpl(VkCommandPool commandPool)
+	VkCommandBuffer GraphicsContext::CreateCommandBufferImpl(VkCommandPool commandPool, VkCommandBufferLevel level)
 	{
 		VkCommandBuffer commandBuffer;
 
 		VkCommandBufferAllocateInfo commandBufferAllocateInfo = {};
 		commandBufferAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-		commandBufferAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		commandBufferAllocateInfo.level = level;
 		commandBufferAllocateInfo.commandPool = commandPool;
 		commandBufferAllocateInfo.commandBufferCount = 1;
 
@@ -600,6 +650,43 @@ namespace Hog {
 			if (queueIdx >= 0)
 			{
 				m_QueueFamilyIndex = (uint32_t)queueIdx;
+
+				// A family without graphics support lets compute work run alongside rasterization
+				m_ComputeQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+				for (uint32_t j = 0; j < gpu->QueueFamilyProperties.size(); ++j)
+				{
+					VkQueueFamilyProperties& props = gpu->QueueFamilyProperties[j];
+					if (props.queueCount > 0 && props.queueFlags & VK_QUEUE_COMPUTE_BIT && !(props.queueFlags & VK_QUEUE_GRAPHICS_BIT))
+					{
+						m_ComputeQueueFamilyIndex = j;
+						break;
+					}
+				}
+
+				// A transfer only family copies uploads without taking time from either of them. Image copies are
+				// recorded for whole levels, so the family has to allow copies of any size.
+				m_TransferQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+				for (uint32_t j = 0; j < gpu->QueueFamilyProperties.size() && CVar_TransferQueue.Get(); ++j)
+				{
+					VkQueueFamilyProperties& props = gpu->QueueFamilyProperties[j];
+					VkExtent3D granularity = props.minImageTransferGranularity;
+					if (props.queueCount > 0 && props.queueFlags & VK_QUEUE_TRANSFER_BIT && !(props.queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))
+						&& granularity.width == 1 && granularity.height == 1 && granularity.depth == 1)
+					{
+						m_TransferQueueFamilyIndex = j;
+						break;
+					}
+				}
+
+				// Pipeline statistics are optional, the queries stay active while a stage executes its secondary command
+				// buffers so they are only enabled together with inherited queries
+				const auto& supported = gpu->PhysicalDeviceFeatures2.features;
+				if (supported.pipelineStatisticsQuery == VK_TRUE && supported.inheritedQueries == VK_TRUE)
+				{
+					m_DeviceFeatures.pipelineStatisticsQuery = VK_TRUE;
+					m_DeviceFeatures.inheritedQueries = VK_TRUE;
+				}
+
 				m_PhysicalDevice = gpu->Device;
 				m_GPU = gpu;
 				if (CVar_MSAA.Get())
@@ -636,6 +723,18 @@ namespace Hog {
 
 		devqInfo.push_back(qinfo);
 
+		if (m_ComputeQueueFamilyIndex != VK_QUEUE_FAMILY_IGNORED)
+		{
+			qinfo.queueFamilyIndex = m_ComputeQueueFamilyIndex;
+			devqInfo.push_back(qinfo);
+		}
+
+		if (m_TransferQueueFamilyIndex != VK_QUEUE_FAMILY_IGNORED)
+		{
+			qinfo.queueFamilyIndex = m_TransferQueueFamilyIndex;
+			devqInfo.push_back(qinfo);
+		}
+
 		// Put it all together.
 		VkDeviceCreateInfo info = {};
 		info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
@@ -662,6 +761,16 @@ namespace Hog {
 
 		// Now get the queues from the devie we just created.
 		vkGetDeviceQueue(m_Device, m_QueueFamilyIndex, 0, &m_Queue);
+
+		if (m_ComputeQueueFamilyIndex != VK_QUEUE_FAMILY_IGNORED)
+		{
+			vkGetDeviceQueue(m_Device, m_ComputeQueueFamilyIndex, 0, &m_ComputeQueue);
+		}
+
+		if (m_TransferQueueFamilyIndex != VK_QUEUE_FAMILY_IGNORED)
+		{
+			vkGetDeviceQueue(m_Device, m_TransferQueueFamilyIndex, 0, &m_TransferQueue);
+		}
 	}
 
 	void GraphicsContext::InitializeAllocator()
@@ -754,8 +863,14 @@ namespace Hog {
 		info.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
 		info.surface = m_Surface;
 
-		// double buffer again!
-		info.minImageCount = CVar_FrameCount.Get();
+		// The presentation engine may hand out more images than asked for, a max image count of zero means there is no limit
+		const VkSurfaceCapabilitiesKHR& capabilities = gpu.SurfaceCapabilities;
+		uint32_t imageCount = std::max(static_cast<uint32_t>(CVar_SwapchainImageCount.Get()), capabilities.minImageCount);
+		if (capabilities.maxImageCount > 0)
+		{
+			imageCount = std::min(imageCount, capabilities.maxImageCount);
+		}
+		info.minImageCount = imageCount;
 
 		info.imageFormat = surfaceFormat.format;
 		info.imageColorSpace = surfaceFormat.colorSpace;
@@ -795,22 +910,22 @@ namespace Hog {
 
 		// First call gets numImages.
 		uint32_t numImages = 0;
-		std::vector<VkImage> swapchainImages(CVar_FrameCount.Get());
 		CheckVkResult(vkGetSwapchainImagesKHR(m_Device, m_Swapchain, &numImages, nullptr));
 		HG_ASSERT(numImages > 0, "vkGetSwapchainImagesKHR returned a zero image count.")
 
-			// Second call uses numImages
-			CheckVkResult(vkGetSwapchainImagesKHR(m_Device, m_Swapchain, &numImages, swapchainImages.data()));
+		// Second call uses numImages
+		std::vector<VkImage> swapchainImages(numImages);
+		CheckVkResult(vkGetSwapchainImagesKHR(m_Device, m_Swapchain, &numImages, swapchainImages.data()));
 		HG_ASSERT(numImages > 0, "vkGetSwapchainImagesKHR returned a zero image count.");
 
-		m_SwapchainImages.resize(CVar_FrameCount.Get());
+		m_SwapchainImages.resize(numImages);
 
 		// New concept - Image Views
 		// Much like the logical device is an interface to the physical device,
 		// image views are interfaces to actual images.  Think of it as this.
 		// The image exists outside of you.  But the view is your personal view 
 		// ( how you perceive ) the image.
-		for (int i = 0; i < CVar_FrameCount.Get(); ++i) {
+		for (uint32_t i = 0; i < numImages; ++i) {
 			VkImageViewCreateInfo info = {};
 			info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
 
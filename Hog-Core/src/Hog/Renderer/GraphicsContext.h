@@ -3,6 +3,8 @@
 #include <volk.h>
 #include <vk_mem_alloc.h>
 
+#include <atomic>
+
 #include "Hog/Renderer/Image.h"
 #include "Hog/Core/Base.h"
 
@@ -146,17 +148,31 @@ namespace Hog {
 		static VkFormat GetSwapchainFormat() { return Get().m_SwapchainFormat; }
 		static VkQueue GetQueue() { return Get().m_Queue; }
 		static uint32_t GetQueueFamily() { return Get().m_QueueFamilyIndex; }
+		// Queue of a compute only family, VK_NULL_HANDLE when the device does not expose one
+		static VkQueue GetComputeQueue() { return Get().m_ComputeQueue; }
+		static uint32_t GetComputeQueueFamily() { return Get().m_ComputeQueueFamilyIndex; }
+		// Queue of a transfer only family, VK_NULL_HANDLE when the device does not expose one
+		static VkQueue GetTransferQueue() { return Get().m_TransferQueue; }
+		static uint32_t GetTransferQueueFamily() { return Get().m_TransferQueueFamilyIndex; }
 		static VkSampleCountFlagBits GetMSAASamples() { return Get().m_MSAASamples; }
+		// Pipeline statistics queries, including while secondary command buffers execute inside them
+		static bool SupportsPipelineStatistics() { return Get().m_DeviceFeatures.pipelineStatisticsQuery == VK_TRUE; }
 		static GPUInfo* GetGPUInfo() { return Get().m_GPU; }
 
-		static VkCommandPool CreateCommandPool() { return Get().CreateCommandPoolImpl(); }
-		static VkCommandBuffer CreateCommandBuffer(VkCommandPool commandPool) { return Get().CreateCommandBufferImpl(commandPool); }
+		static VkCommandPool CreateCommandPool() { return Get().CreateCommandPoolImpl(Get().m_QueueFamilyIndex); }
+		static VkCommandPool CreateCommandPool(uint32_t queueFamily) { return Get().CreateCommandPoolImpl(queueFamily); }
+		static VkCommandBuffer CreateCommandBuffer(VkCommandPool commandPool, VkCommandBufferLevel level = VK_COMMAND_BUFFER_LEVEL_PRIMARY) { return Get().CreateCommandBufferImpl(commandPool, level); }
 		static VkFence CreateFence(bool signaled) { return Get().CreateFenceImpl(signaled); }
 		static VkSemaphore CreateVkSemaphore() { return Get().CreateSemaphoreImpl(); }
+		static VkSemaphore CreateTimelineSemaphore(uint64_t initialValue = 0) { return Get().CreateTimelineSemaphoreImpl(initialValue); }
+		// The pool comes back already reset from the host, so its queries can be written right away
+		static VkQueryPool CreateQueryPool(VkQueryType type, uint32_t count, VkQueryPipelineStatisticFlags statistics = 0) { return Get().CreateQueryPoolImpl(type, count, statistics); }
 
 		static std::vector<const char*>& GetInstanceExtensions() { return Get().GetInstanceExtensionsImpl(); }
 
 		static void ImmediateSubmit(std::function<void(VkCommandBuffer commandBuffer)>&& function) { return Get().ImmediateSubmitImpl(std::move(function)); }
+		// Number of immediate submits since the last call, each one stalls the CPU until the GPU is done with it
+		static uint32_t ResetImmediateSubmitCount() { return Get().m_ImmediateSubmitCount.exchange(0); }
 	public:
 		GraphicsContext(GraphicsContext const&) = delete;
 		void operator=(GraphicsContext const&) = delete;
@@ -171,10 +187,12 @@ namespace Hog {
 		void DestroyImGuiDescriptorPoolImpl();
 		void ImmediateSubmitImpl(std::function<void(VkCommandBuffer commandBuffer)>&& function);
 
-		VkCommandPool CreateCommandPoolImpl();
-		VkCommandBuffer CreateCommandBufferImpl(VkCommandPool commandPool);
+		VkCommandPool CreateCommandPoolImpl(uint32_t queueFamily);
+		VkCommandBuffer CreateCommandBufferImpl(VkCommandPool commandPool, VkCommandBufferLevel level);
 		VkFence CreateFenceImpl(bool signaled);
 		VkSemaphore CreateSemaphoreImpl();
+		VkSemaphore CreateTimelineSemaphoreImpl(uint64_t initialValue);
+		VkQueryPool CreateQueryPoolImpl(VkQueryType type, uint32_t count, VkQueryPipelineStatisticFlags statistics);
 		VkSampleCountFlagBits GetMaxMSAASampleCount();
 
 		std::vector<const char*>& GetInstanceExtensionsImpl() { return m_InstanceExtensions; }
@@ -204,8 +222,12 @@ namespace Hog {
 		VkDevice m_Device = VK_NULL_HANDLE;
 
 		uint32_t m_QueueFamilyIndex;
+		uint32_t m_ComputeQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		uint32_t m_TransferQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
 
 		VkQueue m_Queue = VK_NULL_HANDLE;
+		VkQueue m_ComputeQueue = VK_NULL_HANDLE;
+		VkQueue m_TransferQueue = VK_NULL_HANDLE;
 
 		VkSurfaceKHR m_Surface = VK_NULL_HANDLE;
 
@@ -222,6 +244,7 @@ namespace Hog {
 		VkCommandPool m_UploadCommandPool;
 
 		VkFence UploadFence;
+		std::atomic<uint32_t> m_ImmediateSubmitCount = 0;
 
 		VkSampleCountFlagBits m_MSAASamples = VK_SAMPLE_COUNT_1_BIT;
 
@@ -272,12 +295,14 @@ namespace Hog {
 			.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES,
 			.pNext = &m_AccelerationStructureFeatures,
 			.synchronization2 = VK_TRUE,
+			.dynamicRendering = VK_TRUE,
 			.maintenance4 = VK_TRUE,
 		};
 
 		VkPhysicalDeviceVulkan12Features m_DeviceFeatures12 = {
 			.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
 			.pNext = &m_DeviceFeatures13,
+			.drawIndirectCount = VK_TRUE,
 	        .descriptorIndexing = VK_TRUE,
 	        .shaderInputAttachmentArrayDynamicIndexing = VK_TRUE,
 	        .shaderUniformTexelBufferArrayDynamicIndexing = VK_TRUE,
@@ -299,6 +324,8 @@ namespace Hog {
 	        .descriptorBindingPartiallyBound = VK_TRUE,
 	        .descriptorBindingVariableDescriptorCount = VK_TRUE,
 	        .runtimeDescriptorArray = VK_TRUE,
+			.hostQueryReset = VK_TRUE,
+			.timelineSemaphore = VK_TRUE,
 			.bufferDeviceAddress = VK_TRUE,
 		};
 
@@ -313,6 +340,8 @@ namespace Hog {
 			.imageCubeArray = VK_TRUE,
 			.geometryShader = VK_TRUE,
 			.sampleRateShading = VK_TRUE,
+			.multiDrawIndirect = VK_TRUE,
+			.drawIndirectFirstInstance = VK_TRUE,
 			.depthClamp = VK_TRUE,
 			.depthBiasClamp = VK_TRUE,
 			.fillModeNonSolid = VK_TRUE,
@@ -320,6 +349,8 @@ namespace Hog {
 			.samplerAnisotropy = VK_TRUE,
 			.textureCompressionBC = VK_TRUE,
 			.shaderSampledImageArrayDynamicIndexing = VK_TRUE,
+			.shaderStorageBufferArrayDynamicIndexing = VK_TRUE,
+			.shaderStorageImageArrayDynamicIndexing = VK_TRUE,
 		};
 
 		std::vector<const char*> m_InstanceExtensions = {
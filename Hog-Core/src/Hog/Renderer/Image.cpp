@@ -6,12 +6,20 @@
 
 #include "Hog/Renderer/GraphicsContext.h"
 #include "Hog/Renderer/Buffer.h"
+#include "Hog/Renderer/UploadBatch.h"
+#include "Hog/Renderer/BindlessHeap.h"
 #include "Hog/Utils/RendererUtils.h"
 #include "Hog/Core/CVars.h"
 
 namespace Hog
 {
 	Ref<Image> Image::LoadFromFile(const std::string& filepath)
+	{
+		UploadBatch batch;
+		return LoadFromFile(filepath, batch);
+	}
+
+	Ref<Image> Image::LoadFromFile(const std::string& filepath, UploadBatch& batch)
 	{
 		std::filesystem::path path(filepath);
 		std::string name;
@@ -40,7 +48,7 @@ namespace Hog
 
 		Ref<Image> image = Image::Create(ImageDescription::Defaults::Texture, width, height, mipLevels, format);
 
-		image->SetData(pixels, imageSize);
+		image->SetData(batch, pixels, imageSize);
 
 		stbi_image_free(pixels);
 
@@ -79,6 +87,7 @@ namespace Hog
 		m_ImageCreateInfo.usage = static_cast<VkImageUsageFlags>(m_Description);
 		m_ImageCreateInfo.samples = m_Samples;
 		m_ImageCreateInfo.mipLevels = m_LevelCount;
+		m_LevelLayouts.resize(m_LevelCount, m_Description.ImageLayout);
 
 		//for the depth image, we want to allocate it from GPU local memory
 		VmaAllocationCreateInfo imageAllocationInfo = {};
@@ -90,6 +99,11 @@ namespace Hog
 			&imageAllocationInfo, &m_Handle, &m_Allocation, nullptr));
 
 		CreateViewForImage();
+
+		if (m_ImageCreateInfo.usage & VK_IMAGE_USAGE_STORAGE_BIT)
+		{
+			m_GPUIndex = static_cast<int32_t>(BindlessHeap::RegisterStorageImage(this));
+		}
 	}
 
 	Image::Image(VkImage image, ImageDescription type, VkFormat format, VkExtent2D extent,
@@ -97,127 +111,197 @@ namespace Hog
 		: m_Handle(image), m_InternalFormat(format), m_Format(format), m_Description(type)
 		, m_Width(extent.width), m_Height(extent.height), m_Allocated(false), m_ViewCreateInfo(viewCreateInfo)
 	{
+		m_LevelLayouts.resize(m_LevelCount, m_Description.ImageLayout);
 		CreateViewForImage();
 	}
 
 	Image::~Image()
 	{
+		if (m_GPUIndex != -1)
+			BindlessHeap::Release(BindlessHeap::StorageImages, m_GPUIndex);
+
 		vkDestroyImageView(GraphicsContext::GetDevice(), m_View, nullptr);
 		if (m_Allocated)
 			vmaDestroyImage(GraphicsContext::GetAllocator(), m_Handle, m_Allocation);
+		else if (m_Aliased)
+			vkDestroyImage(GraphicsContext::GetDevice(), m_Handle, nullptr);
 	}
 
 	void Image::SetData(void* data, uint32_t size)
 	{
-		auto buffer = Buffer::Create(BufferDescription::Defaults::TransferSourceBuffer, size);
-		buffer->WriteData(data, size);
+		UploadBatch batch;
+		SetData(batch, data, size);
+	}
 
-		GraphicsContext::ImmediateSubmit([&](VkCommandBuffer commandBuffer)
-		{
-			VkImageMemoryBarrier barrier = {};
-			barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-
-			barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-			barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-
-			barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-			barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-			barrier.image = m_Handle;
-			barrier.subresourceRange.aspectMask = m_Description.ImageAspectFlags;
-			barrier.subresourceRange.baseMipLevel = 0;
-			barrier.subresourceRange.levelCount = m_LevelCount;
-			barrier.subresourceRange.layerCount = 1;
-			barrier.subresourceRange.baseArrayLayer = 0;
-
-			barrier.srcAccessMask = 0;
-			barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-
-			//barrier the image into the transfer-receive layout
-			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
-				0, nullptr, 0, nullptr, 1, &barrier);
-
-			VkBufferImageCopy copyRegion = {};
-			copyRegion.bufferOffset = 0;
-			copyRegion.bufferRowLength = 0;
-			copyRegion.bufferImageHeight = 0;
-
-			copyRegion.imageSubresource.aspectMask = m_Description.ImageAspectFlags;
-			copyRegion.imageSubresource.mipLevel = 0;
-			copyRegion.imageSubresource.baseArrayLayer = 0;
-			copyRegion.imageSubresource.layerCount = 1;
-			copyRegion.imageExtent = m_ImageCreateInfo.extent;
-
-			//copy the buffer into the image
-			vkCmdCopyBufferToImage(commandBuffer, buffer->GetHandle(), m_Handle, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copyRegion);
-
-			//mip map generation
-
-			int32_t mipWidth = m_Width;
-			int32_t mipHeight = m_Height;
-
-			for (uint32_t i = 1; i < m_LevelCount; i++) {
-				barrier.subresourceRange.levelCount = 1;
-				barrier.subresourceRange.baseMipLevel = i - 1;
-				barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-				barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-				barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-				barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-
-				vkCmdPipelineBarrier(commandBuffer,
-					VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
-					0, nullptr,
-					0, nullptr,
-					1, &barrier);
-
-				VkImageBlit blit{};
-				blit.srcOffsets[0] = { 0, 0, 0 };
-				blit.srcOffsets[1] = { mipWidth, mipHeight, 1 };
-				blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-				blit.srcSubresource.mipLevel = i - 1;
-				blit.srcSubresource.baseArrayLayer = 0;
-				blit.srcSubresource.layerCount = 1;
-				blit.dstOffsets[0] = { 0, 0, 0 };
-				blit.dstOffsets[1] = { mipWidth > 1 ? mipWidth / 2 : 1, mipHeight > 1 ? mipHeight / 2 : 1, 1 };
-				blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-				blit.dstSubresource.mipLevel = i;
-				blit.dstSubresource.baseArrayLayer = 0;
-				blit.dstSubresource.layerCount = 1;
-
-				vkCmdBlitImage(commandBuffer,
-					m_Handle, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-					m_Handle, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-					1, &blit,
-					VK_FILTER_LINEAR);
-
-				barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-				barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-				barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-				barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-
-				vkCmdPipelineBarrier(commandBuffer,
-					VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
-					0, nullptr,
-					0, nullptr,
-					1, &barrier);
-
-				if (mipWidth > 1) mipWidth /= 2;
-				if (mipHeight > 1) mipHeight /= 2;
-			}
+	void Image::SetData(UploadBatch& batch, void* data, uint32_t size)
+	{
+		batch.WriteImage(*this, data, size);
+	}
 
-			barrier.subresourceRange.baseMipLevel = m_LevelCount - 1;
+	void Image::RecordUpload(VkCommandBuffer commandBuffer, VkBuffer source, VkDeviceSize sourceOffset)
+	{
+		RecordCopy(commandBuffer, source, sourceOffset);
+		RecordMipGeneration(commandBuffer);
+	}
 
-			barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-			barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	void Image::RecordCopy(VkCommandBuffer commandBuffer, VkBuffer source, VkDeviceSize sourceOffset)
+	{
+		VkImageMemoryBarrier barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+
+		barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.image = m_Handle;
+		barrier.subresourceRange.aspectMask = m_Description.ImageAspectFlags;
+		barrier.subresourceRange.baseMipLevel = 0;
+		barrier.subresourceRange.levelCount = m_LevelCount;
+		barrier.subresourceRange.layerCount = 1;
+		barrier.subresourceRange.baseArrayLayer = 0;
+
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+		//barrier the image into the transfer-receive layout
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+			0, nullptr, 0, nullptr, 1, &barrier);
+
+		VkBufferImageCopy copyRegion = {};
+		copyRegion.bufferOffset = sourceOffset;
+		copyRegion.bufferRowLength = 0;
+		copyRegion.bufferImageHeight = 0;
+
+		copyRegion.imageSubresource.aspectMask = m_Description.ImageAspectFlags;
+		copyRegion.imageSubresource.mipLevel = 0;
+		copyRegion.imageSubresource.baseArrayLayer = 0;
+		copyRegion.imageSubresource.layerCount = 1;
+		copyRegion.imageExtent = m_ImageCreateInfo.extent;
+
+		//copy the buffer into the image
+		vkCmdCopyBufferToImage(commandBuffer, source, m_Handle, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copyRegion);
+	}
+
+	void Image::RecordMipGeneration(VkCommandBuffer commandBuffer)
+	{
+		VkImageMemoryBarrier barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
 
+		barrier.image = m_Handle;
+		barrier.subresourceRange.aspectMask = m_Description.ImageAspectFlags;
+		barrier.subresourceRange.levelCount = 1;
+		barrier.subresourceRange.layerCount = 1;
+		barrier.subresourceRange.baseArrayLayer = 0;
+
+		//mip map generation
+
+		int32_t mipWidth = m_Width;
+		int32_t mipHeight = m_Height;
+
+		for (uint32_t i = 1; i < m_LevelCount; i++) {
+			barrier.subresourceRange.levelCount = 1;
+			barrier.subresourceRange.baseMipLevel = i - 1;
+			barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+			barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
 			barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+			vkCmdPipelineBarrier(commandBuffer,
+				VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+				0, nullptr,
+				0, nullptr,
+				1, &barrier);
+
+			VkImageBlit blit{};
+			blit.srcOffsets[0] = { 0, 0, 0 };
+			blit.srcOffsets[1] = { mipWidth, mipHeight, 1 };
+			blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			blit.srcSubresource.mipLevel = i - 1;
+			blit.srcSubresource.baseArrayLayer = 0;
+			blit.srcSubresource.layerCount = 1;
+			blit.dstOffsets[0] = { 0, 0, 0 };
+			blit.dstOffsets[1] = { mipWidth > 1 ? mipWidth / 2 : 1, mipHeight > 1 ? mipHeight / 2 : 1, 1 };
+			blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			blit.dstSubresource.mipLevel = i;
+			blit.dstSubresource.baseArrayLayer = 0;
+			blit.dstSubresource.layerCount = 1;
+
+			vkCmdBlitImage(commandBuffer,
+				m_Handle, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+				m_Handle, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+				1, &blit,
+				VK_FILTER_LINEAR);
+
+			barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+			barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
 			barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
 
-			//barrier the image into the shader readable layout
-			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
-				0, nullptr, 0, nullptr, 1, &barrier);
-		});
+			vkCmdPipelineBarrier(commandBuffer,
+				VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+				0, nullptr,
+				0, nullptr,
+				1, &barrier);
 
-		m_Description.ImageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			if (mipWidth > 1) mipWidth /= 2;
+			if (mipHeight > 1) mipHeight /= 2;
+		}
+
+		barrier.subresourceRange.baseMipLevel = m_LevelCount - 1;
+
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+		//barrier the image into the shader readable layout
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+			0, nullptr, 0, nullptr, 1, &barrier);
+	}
+
+	void Image::Alias(VmaAllocation allocation)
+	{
+		HG_CORE_ASSERT(m_Allocated || m_Aliased, "Swapchain images can not be aliased");
+
+		vkDestroyImageView(GraphicsContext::GetDevice(), m_View, nullptr);
+		if (m_Allocated)
+			vmaDestroyImage(GraphicsContext::GetAllocator(), m_Handle, m_Allocation);
+		else
+			vkDestroyImage(GraphicsContext::GetDevice(), m_Handle, nullptr);
+
+		CheckVkResult(vmaCreateAliasingImage(GraphicsContext::GetAllocator(), allocation, &m_ImageCreateInfo, &m_Handle));
+
+		m_Allocation = allocation;
+		m_Allocated = false;
+		m_Aliased = true;
+
+		CreateViewForImage();
+		SetImageLayout(VK_IMAGE_LAYOUT_UNDEFINED);
+
+		// Storage slots and the sampled slots of textures still point at the old view
+		BindlessHeap::UpdateImage(this);
+	}
+
+	VkMemoryRequirements Image::GetMemoryRequirements() const
+	{
+		VkMemoryRequirements requirements;
+		vkGetImageMemoryRequirements(GraphicsContext::GetDevice(), m_Handle, &requirements);
+		return requirements;
+	}
+
+	void Image::SetImageLayout(VkImageLayout layout, uint32_t baseLevel, uint32_t levelCount)
+	{
+		std::fill_n(m_LevelLayouts.begin() + baseLevel, levelCount, layout);
+
+		if (baseLevel == 0)
+		{
+			m_Description.ImageLayout = layout;
+		}
 	}
 
 	void Image::ExecuteBarrier(VkCommandBuffer commandBuffer, const BarrierDescription& description)
@@ -252,7 +336,7 @@ namespace Hog
 
 		vkCmdPipelineBarrier2(commandBuffer, &info);
 		
-		m_Description.ImageLayout = memoryBarrier.newLayout;
+		SetImageLayout(memoryBarrier.newLayout);
 	}
 
 	void Image::CreateViewForImage()
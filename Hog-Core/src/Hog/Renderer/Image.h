@@ -7,10 +7,14 @@
 
 namespace Hog
 {
+	class UploadBatch;
+
 	class Image
 	{
 	public:
 		static Ref<Image> LoadFromFile(const std::string& filepath);
+		// Records the upload into the batch, the image can be used by work submitted after the batch
+		static Ref<Image> LoadFromFile(const std::string& filepath, UploadBatch& batch);
 		static Ref<Image> Create(ImageDescription description, uint32_t width, uint32_t height, uint32_t levelCount, VkFormat format, VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT);
 		static Ref<Image> Create(ImageDescription description, uint32_t levelCount, VkFormat format, VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT);
 		static Ref<Image> Create(ImageDescription description, uint32_t levelCount, VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT);
@@ -21,19 +25,35 @@ namespace Hog
 		~Image();
 
 		void SetData(void* data, uint32_t size);
+		void SetData(UploadBatch& batch, void* data, uint32_t size);
+		// Copies the first level from the buffer, generates the other levels and transitions all of them for sampling
+		void RecordUpload(VkCommandBuffer commandBuffer, VkBuffer source, VkDeviceSize sourceOffset);
+		// The two halves of RecordUpload. The copy leaves every level in the transfer destination layout, it is the only
+		// part a transfer queue can record, generating the levels needs blits and has to run on the graphics queue.
+		void RecordCopy(VkCommandBuffer commandBuffer, VkBuffer source, VkDeviceSize sourceOffset);
+		void RecordMipGeneration(VkCommandBuffer commandBuffer);
+
+		// Recreates the image on top of memory shared with other images. Contents and layout are lost.
+		void Alias(VmaAllocation allocation);
+		VkMemoryRequirements GetMemoryRequirements() const;
 
-		void SetImageLayout(VkImageLayout layout) { m_Description.ImageLayout = layout; }
+		void SetImageLayout(VkImageLayout layout) { SetImageLayout(layout, 0, m_LevelCount); }
+		void SetImageLayout(VkImageLayout layout, uint32_t baseLevel, uint32_t levelCount);
 		void ExecuteBarrier(VkCommandBuffer commandBuffer, const BarrierDescription& description);
 
+		VkImage GetHandle() const { return m_Handle; }
 		VkImageView GetImageView() const { return m_View; }
 		VkFormat GetFormat() const { return m_Description.Format; }
 		const ImageDescription& GetDescription() const {return m_Description;}
 		VkSampleCountFlagBits GetSamples() const { return m_Samples; }
 		VkExtent2D GetExtent() const { return VkExtent2D(m_Width, m_Height); }
 		VkImageLayout GetImageLayout() const { return m_Description.ImageLayout; }
+		VkImageLayout GetImageLayout(uint32_t level) const { return m_LevelLayouts[level]; }
 		uint32_t GetLevelCount() const { return m_LevelCount; }
 		uint32_t GetWidth() const { return m_Width; }
 		uint32_t GetHeight() const { return m_Height; }
+		// Index of the image in the storage image array of the bindless heap, -1 for images without storage usage
+		int32_t GetGPUIndex() const { return m_GPUIndex; }
 	private:
 		void CreateViewForImage();
 	private:
@@ -45,10 +65,13 @@ namespace Hog
 		VmaAllocation m_Allocation;
 		ImageDescription m_Description;
 		uint32_t m_LevelCount = 1;
+		std::vector<VkImageLayout> m_LevelLayouts;
 		uint32_t m_Width;
 		uint32_t m_Height;
 		bool m_IsSwapChainImage;
 		bool m_Allocated;
+		bool m_Aliased = false;
+		int32_t m_GPUIndex = -1;
 
 		VkImageCreateInfo m_ImageCreateInfo = {
 				.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
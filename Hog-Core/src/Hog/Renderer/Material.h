@@ -63,20 +63,20 @@ namespace Hog
 		glm::vec4 DiffuseColor = glm::vec4(0.0f);
 
 		glm::vec3 SpecularColor = glm::vec3(0.0f);
-		int32_t SpecularTexture = 0;
+		int32_t SpecularTexture = -1;
 
-		int32_t SpecularHighlightTexture = 0;
+		int32_t SpecularHighlightTexture = -1;
 		float Specularity = 0.0f;
 		float IOR = 0.0f;
 		float Dissolve = 0.0f;
 
 		glm::vec3 EmissiveColor = glm::vec3(0.0f);
-		int32_t AlphaMap = 1;
+		int32_t AlphaMap = -1;
 
 		glm::vec3 TransmittanceFilter = glm::vec3(0.0f);
-		int32_t BumpMap = 0;
+		int32_t BumpMap = -1;
 
-		int32_t DisplacementMap = 0;
+		int32_t DisplacementMap = -1;
 		int32_t IlluminationModel = 0;
 
 		float EmissiveStrength = 0.0f;
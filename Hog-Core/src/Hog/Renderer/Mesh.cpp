@@ -2,20 +2,120 @@
 
 #include "Mesh.h"
 
+#include <glm/gtc/packing.hpp>
+
+#include "Hog/Renderer/GeometryBuffer.h"
+
 namespace Hog
 {
-	MeshPrimitive::MeshPrimitive(const std::vector<Vertex>& vertexData, const std::vector<uint16_t>& indexData)
-		: m_Vertices(vertexData), m_Indices(indexData)
+	// Folds the unit vector onto the octahedron |x| + |y| + |z| = 1 and unfolds the lower half over the upper one
+	static glm::vec2 EncodeOctahedral(glm::vec3 vector)
+	{
+		float length = std::abs(vector.x) + std::abs(vector.y) + std::abs(vector.z);
+		if (length == 0.0f) return glm::vec2(0.0f);
+
+		vector /= length;
+		if (vector.z >= 0.0f) return glm::vec2(vector.x, vector.y);
+
+		glm::vec2 signs(vector.x >= 0.0f ? 1.0f : -1.0f, vector.y >= 0.0f ? 1.0f : -1.0f);
+		return (1.0f - glm::abs(glm::vec2(vector.y, vector.x))) * signs;
+	}
+
+	static int16_t PackSnorm(float value)
+	{
+		return static_cast<int16_t>(glm::packSnorm1x16(value));
+	}
+
+	static CompactVertex EncodeVertex(const Vertex& vertex, const glm::vec3& positionOffset, const glm::vec3& positionScale)
+	{
+		glm::vec3 position = (vertex.Position - positionOffset) / positionScale;
+		glm::vec2 normal = EncodeOctahedral(vertex.Normal);
+		glm::vec2 tangent = EncodeOctahedral(glm::vec3(vertex.Tangent));
+
+		return {
+			.Position = { PackSnorm(position.x), PackSnorm(position.y), PackSnorm(position.z), PackSnorm(vertex.Tangent.w < 0.0f ? -1.0f : 1.0f) },
+			.TexCoords = { glm::packHalf1x16(vertex.TexCoords.x), glm::packHalf1x16(vertex.TexCoords.y) },
+			.Normal = { PackSnorm(normal.x), PackSnorm(normal.y) },
+			.Tangent = { PackSnorm(tangent.x), PackSnorm(tangent.y) },
+		};
+	}
+
+	MeshPrimitive::MeshPrimitive(const std::vector<Vertex>& vertexData, const std::vector<uint32_t>& indexData, int32_t materialIndex,
+		const std::optional<Math::BoundingBox>& bounds)
+		: m_Vertices(vertexData), m_Indices(indexData), m_MaterialIndex(materialIndex)
+	{
+		if (m_Vertices.size() > std::numeric_limits<uint16_t>::max() + size_t(1))
+		{
+			m_IndexType = VK_INDEX_TYPE_UINT32;
+		}
+
+		if (m_Vertices.empty()) return;
+
+		if (bounds)
+		{
+			m_Bounds = *bounds;
+		}
+		else
+		{
+			m_Bounds = { m_Vertices.front().Position, m_Vertices.front().Position };
+			for (const auto& vertex : m_Vertices)
+			{
+				m_Bounds.Min = glm::min(m_Bounds.Min, vertex.Position);
+				m_Bounds.Max = glm::max(m_Bounds.Max, vertex.Position);
+			}
+		}
+
+		// Centered on the box, the farthest vertex gives a tighter radius than the box's corners
+		m_BoundingSphere.Center = m_Bounds.GetCenter();
+		for (const auto& vertex : m_Vertices)
+		{
+			m_BoundingSphere.Radius = std::max(m_BoundingSphere.Radius, glm::distance(m_BoundingSphere.Center, vertex.Position));
+		}
+	}
+
+	void MeshPrimitive::Build(UploadBatch& batch)
 	{
+		m_VertexRegion = GeometryBuffer::AllocateVertices(m_Vertices.size());
+		if (GeometryBuffer::UsesCompactVertices())
+		{
+			// Flat axes keep a scale of one so their positions do not divide by zero
+			m_PositionOffset = m_Bounds.GetCenter();
+			m_PositionScale = m_Bounds.GetExtents();
+			m_PositionScale = glm::mix(m_PositionScale, glm::vec3(1.0f), glm::equal(m_PositionScale, glm::vec3(0.0f)));
+
+			std::vector<CompactVertex> vertices(m_Vertices.size());
+			for (size_t i = 0; i < m_Vertices.size(); i++)
+			{
+				vertices[i] = EncodeVertex(m_Vertices[i], m_PositionOffset, m_PositionScale);
+			}
+
+			batch.WriteBuffer(*m_VertexRegion, vertices.data(), m_VertexRegion->GetSize());
+		}
+		else
+		{
+			batch.WriteBuffer(*m_VertexRegion, m_Vertices.data(), m_VertexRegion->GetSize());
+		}
+
+		m_IndexRegion = GeometryBuffer::AllocateIndices(m_Indices.size(), m_IndexType);
+		if (m_IndexType == VK_INDEX_TYPE_UINT16)
+		{
+			std::vector<uint16_t> indices(m_Indices.begin(), m_Indices.end());
+			batch.WriteBuffer(*m_IndexRegion, indices.data(), m_IndexRegion->GetSize());
+		}
+		else
+		{
+			batch.WriteBuffer(*m_IndexRegion, m_Indices.data(), m_IndexRegion->GetSize());
+		}
+	}
+
+	uint64_t MeshPrimitive::GetVertexDataSize() const
+	{
+		return m_Vertices.size() * GeometryBuffer::GetVertexStride();
 	}
 
-	void MeshPrimitive::Build(Ref<Buffer> vertexBuffer, uint64_t vertexOffset, Ref<Buffer> indexBuffer,
-		uint64_t indexOffset)
+	int32_t MeshPrimitive::GetFirstVertex() const
 	{
-		m_VertexRegion = BufferRegion::Create(vertexBuffer, vertexOffset, sizeof(Vertex) * m_Vertices.size());
-		m_VertexRegion->WriteData(m_Vertices.data(), m_VertexRegion->GetSize());
-		m_IndexRegion = BufferRegion::Create(indexBuffer, indexOffset, sizeof(uint16_t) * m_Indices.size());
-		m_IndexRegion->WriteData(m_Indices.data(), m_IndexRegion->GetSize());
+		return static_cast<int32_t>(m_VertexRegion->GetOffset() / GeometryBuffer::GetVertexStride());
 	}
 
 	Ref<Mesh> Mesh::Create(const std::string& name)
@@ -23,40 +123,56 @@ namespace Hog
 		return CreateRef<Mesh>(name);
 	}
 
-	void Mesh::AddPrimitive(const std::vector<Vertex>& vertexData, const std::vector<uint16_t>& indexData)
+	void Mesh::AddPrimitive(const std::vector<Vertex>& vertexData, const std::vector<uint32_t>& indexData, int32_t materialIndex,
+		const std::optional<Math::BoundingBox>& bounds)
 	{
-		m_Primitives.emplace_back(vertexData, indexData);
-		m_IndexOffsets.push_back(m_IndexBufferSize);
-		m_VertexOffsets.push_back(m_VertexBufferSize);
+		m_Primitives.emplace_back(vertexData, indexData, materialIndex, bounds);
 
-		m_IndexBufferSize += indexData.size() * sizeof(uint16_t);
-		m_VertexBufferSize += vertexData.size() * sizeof(Vertex);
+		if (m_Primitives.size() == 1)
+			m_Bounds = m_Primitives.back().GetBounds();
+		else
+			m_Bounds.Merge(m_Primitives.back().GetBounds());
 	}
 
 	void Mesh::Build()
 	{
-		m_IndexBuffer = Buffer::Create(BufferDescription::Defaults::IndexBuffer, m_IndexBufferSize);
-		m_VertexBuffer = Buffer::Create(BufferDescription::Defaults::VertexBuffer, m_VertexBufferSize);
+		UploadBatch batch;
+		Build(batch);
+	}
 
-		for (int i = 0; i < m_Primitives.size(); ++i)
+	void Mesh::Build(UploadBatch& batch)
+	{
+		for (auto& primitive : m_Primitives)
 		{
-			m_Primitives[i].Build(m_VertexBuffer, m_VertexOffsets[i], m_IndexBuffer, m_IndexOffsets[i]);
+			primitive.Build(batch);
 		}
 	}
 
-	void Mesh::Draw(VkCommandBuffer commandBuffer)
+	void Mesh::Draw(VkCommandBuffer commandBuffer, uint32_t firstInstance)
 	{
 		HG_PROFILE_FUNCTION()
 
-		for (auto && primitive: m_Primitives)
-		{
-			VkBuffer vertexBuffers[] = { m_VertexBuffer->GetHandle() };
-			VkDeviceSize offsets[] = { primitive.GetVertexOffset() };
+		GeometryBuffer::Bind(commandBuffer);
+		VkIndexType boundIndexType = VK_INDEX_TYPE_UINT16;
 
-			vkCmdBindIndexBuffer(commandBuffer, m_IndexBuffer->GetHandle(), primitive.GetIndexOffset(), VK_INDEX_TYPE_UINT16);
-			vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+		for (size_t i = 0; i < m_Primitives.size(); i++)
+		{
+			if (m_Primitives[i].GetIndexType() != boundIndexType)
+			{
+				boundIndexType = m_Primitives[i].GetIndexType();
+				GeometryBuffer::BindIndices(commandBuffer, boundIndexType);
+			}
 
-			vkCmdDrawIndexed(commandBuffer,  static_cast<uint32_t>(primitive.GetIndexCount()), 1, 0, 0, 0);
+			DrawPrimitive(commandBuffer, i, firstInstance);
+			firstInstance += GetInstanceCount();
 		}
 	}
+
+	void Mesh::DrawPrimitive(VkCommandBuffer commandBuffer, size_t index, uint32_t firstInstance) const
+	{
+		const auto& primitive = m_Primitives[index];
+
+		vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(primitive.GetIndexCount()), GetInstanceCount(),
+			primitive.GetFirstIndex(), primitive.GetFirstVertex(), firstInstance);
+	}
 }
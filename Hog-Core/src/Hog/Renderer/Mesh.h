@@ -1,39 +1,71 @@
 #pragma once
 
+#include <optional>
+
 #include <Hog/Renderer/Buffer.h>
+#include <Hog/Renderer/UploadBatch.h>
+#include <Hog/Math/Math.h>
 
 namespace Hog
 {
 	class MeshPrimitive
 	{
 	public:
-		MeshPrimitive(const std::vector<Vertex>& vertexData, const std::vector<uint16_t>& indexData);
+		// Bounds are computed from the vertices unless they are given, like the ones glTF stores with the positions.
+		// Indices are stored as 16 bit ones whenever the vertex count allows it, whatever width they are given in.
+		MeshPrimitive(const std::vector<Vertex>& vertexData, const std::vector<uint32_t>& indexData, int32_t materialIndex = -1,
+			const std::optional<Math::BoundingBox>& bounds = std::nullopt);
+		MeshPrimitive(const std::vector<Vertex>& vertexData, const std::vector<uint16_t>& indexData, int32_t materialIndex = -1,
+			const std::optional<Math::BoundingBox>& bounds = std::nullopt)
+			: MeshPrimitive(vertexData, std::vector<uint32_t>(indexData.begin(), indexData.end()), materialIndex, bounds) {}
 
-		void Build(Ref<Buffer> vertexBuffer, uint64_t vertexOffset, Ref<Buffer> indexBuffer, uint64_t indexOffset);
+		// Allocates the primitive's regions of the shared geometry buffers and records their uploads into the batch,
+		// encoding the vertices when the buffers hold compact ones
+		void Build(UploadBatch& batch);
 
-		uint64_t GetVertexDataSize() const { return m_Vertices.size() * sizeof(Vertex); }
-		uint64_t GetIndexDataSize() const { return m_Indices.size() * sizeof(uint16_t); }
+		uint64_t GetVertexDataSize() const;
+		uint64_t GetIndexDataSize() const { return m_Indices.size() * GetIndexSize(); }
 
 		size_t GetVertexCount() const { return m_Vertices.size(); }
 		size_t GetIndexCount() const { return m_Indices.size(); }
+		VkIndexType GetIndexType() const { return m_IndexType; }
+		uint32_t GetIndexSize() const { return m_IndexType == VK_INDEX_TYPE_UINT32 ? sizeof(uint32_t) : sizeof(uint16_t); }
 
+		// Byte offsets within the shared geometry buffers
 		uint64_t GetVertexOffset() const { return m_VertexRegion->GetOffset(); }
 		uint64_t GetIndexOffset() const { return m_IndexRegion->GetOffset(); }
+		// The same offsets counted in vertices and indices, as draws take them
+		int32_t GetFirstVertex() const;
+		uint32_t GetFirstIndex() const { return static_cast<uint32_t>(m_IndexRegion->GetOffset() / GetIndexSize()); }
+		// What draws of the primitive turn the positions in the geometry buffer back into local space with, an offset
+		// and a scale per axis. Identity unless the vertices are compact.
+		const glm::vec3& GetPositionOffset() const { return m_PositionOffset; }
+		const glm::vec3& GetPositionScale() const { return m_PositionScale; }
 
 		Ref<BufferRegion> GetVertexRegion() { return m_VertexRegion; }
 		Ref<BufferRegion> GetIndexRegion() { return m_IndexRegion; }
 
 		void SetVertexRegion(Ref<BufferRegion> vertexRegion) { m_VertexRegion = std::move(vertexRegion); }
-		void SetIndexRegion(Ref<BufferRegion> indexRegion) { m_VertexRegion = std::move(indexRegion); }
+		void SetIndexRegion(Ref<BufferRegion> indexRegion) { m_IndexRegion = std::move(indexRegion); }
 
 		const std::vector<Vertex>& GetVertices() const { return m_Vertices; }
-		const std::vector<uint16_t>& GetIndices() const { return m_Indices; }
+		const std::vector<uint32_t>& GetIndices() const { return m_Indices; }
+		int32_t GetMaterialIndex() const { return m_MaterialIndex; }
+		// Bounds of the vertex positions, in the mesh's local space
+		const Math::BoundingBox& GetBounds() const { return m_Bounds; }
+		const Math::BoundingSphere& GetBoundingSphere() const { return m_BoundingSphere; }
 	public:
 		std::vector<Vertex> m_Vertices;
-		std::vector<uint16_t> m_Indices;
+		std::vector<uint32_t> m_Indices;
+		VkIndexType m_IndexType = VK_INDEX_TYPE_UINT16;
 
 		Ref<BufferRegion> m_VertexRegion;
 		Ref<BufferRegion> m_IndexRegion;
+		int32_t m_MaterialIndex = -1;
+		Math::BoundingBox m_Bounds;
+		Math::BoundingSphere m_BoundingSphere;
+		glm::vec3 m_PositionOffset = glm::vec3(0.0f);
+		glm::vec3 m_PositionScale = glm::vec3(1.0f);
 	};
 
 	class Mesh
@@ -45,17 +77,34 @@ namespace Hog
 			: m_Name(name) {}
 		~Mesh() = default;
 
-		void AddPrimitive(const std::vector<Vertex>& vertexData, const std::vector<uint16_t>& indexData);
+		void AddPrimitive(const std::vector<Vertex>& vertexData, const std::vector<uint32_t>& indexData, int32_t materialIndex = -1,
+			const std::optional<Math::BoundingBox>& bounds = std::nullopt);
+		void AddPrimitive(const std::vector<Vertex>& vertexData, const std::vector<uint16_t>& indexData, int32_t materialIndex = -1,
+			const std::optional<Math::BoundingBox>& bounds = std::nullopt)
+		{
+			AddPrimitive(vertexData, std::vector<uint32_t>(indexData.begin(), indexData.end()), materialIndex, bounds);
+		}
 		size_t GetPrimitiveCount() const { return m_Primitives.size(); }
+		const MeshPrimitive& GetPrimitive(size_t index) const { return m_Primitives[index]; }
 		void Build();
-
-		void SetModelMatrix(glm::mat4 matrix) { m_ModelMatrix = matrix; }
-		glm::mat4 GetModelMatrix() const { return m_ModelMatrix; }
-
-		Ref<Buffer> GetVertexBuffer() { return m_VertexBuffer; }
-		Ref<Buffer> GetIndexBuffer() { return m_IndexBuffer; }
-
-		void Draw(VkCommandBuffer commandBuffer);
+		// Records the vertex and index uploads into the batch, the mesh can be drawn by work submitted after it
+		void Build(UploadBatch& batch);
+
+		// A mesh is drawn once per instance, it starts out with a single one at the origin. The renderer sizes its
+		// instance buffers when it gets initialized, so instances have to be added before that.
+		void SetModelMatrix(glm::mat4 matrix) { m_Instances.front() = matrix; }
+		glm::mat4 GetModelMatrix() const { return m_Instances.front(); }
+		void AddInstance(glm::mat4 matrix) { m_Instances.push_back(matrix); }
+		uint32_t GetInstanceCount() const { return static_cast<uint32_t>(m_Instances.size()); }
+		const std::vector<glm::mat4>& GetInstances() const { return m_Instances; }
+		// Bounds of all primitives in local space
+		const Math::BoundingBox& GetBounds() const { return m_Bounds; }
+
+		// Draws every instance of every primitive, the instances of a primitive follow each other starting at firstInstance
+		void Draw(VkCommandBuffer commandBuffer, uint32_t firstInstance);
+		// Draws all instances of a single primitive, expects the shared geometry buffers to be bound with the primitive's
+		// index type
+		void DrawPrimitive(VkCommandBuffer commandBuffer, size_t index, uint32_t firstInstance) const;
 		
 		std::vector<MeshPrimitive>::iterator begin() { return m_Primitives.begin(); }
 		std::vector<MeshPrimitive>::iterator end() { return m_Primitives.end(); }
@@ -65,15 +114,7 @@ namespace Hog
 		std::string m_Name;
 		std::vector<MeshPrimitive> m_Primitives;
 
-		Ref<Buffer> m_VertexBuffer;
-		Ref<Buffer> m_IndexBuffer;
-
-		std::vector<uint64_t> m_VertexOffsets;
-		std::vector<uint64_t> m_IndexOffsets;
-
-		size_t m_VertexBufferSize = 0;
-		size_t m_IndexBufferSize = 0;
-
-		glm::mat4 m_ModelMatrix = glm::mat4(1.0f);
+		std::vector<glm::mat4> m_Instances = { glm::mat4(1.0f) };
+		Math::BoundingBox m_Bounds;
 	};
 }
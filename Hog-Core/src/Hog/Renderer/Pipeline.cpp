@@ -4,10 +4,30 @@
 
 #include <Hog/Utils/RendererUtils.h>
 #include <Hog/Renderer/GraphicsContext.h>
+#include <Hog/Renderer/GeometryBuffer.h>
 #include <Hog/Renderer/Shader.h>
 
 namespace Hog
 {
+	// Reflection packs the vertex inputs tightly by their declared types. Mesh pipelines whose shaders only take mesh vertex
+	// attributes read them in the format of the shared geometry buffer instead, which also skips the ones they leave out.
+	static void UseMeshVertexFormat(ShaderReflection::ReflectionData& data)
+	{
+		std::vector<VkVertexInputAttributeDescription> attributes;
+		for (const auto& reflected : data.VertexInputAttributeDescriptions)
+		{
+			auto attribute = GeometryBuffer::GetVertexAttribute(reflected.location);
+			if (!attribute) return;
+
+			attributes.push_back(*attribute);
+		}
+
+		if (attributes.empty()) return;
+
+		data.VertexInputAttributeDescriptions = std::move(attributes);
+		data.VertexInputBindingDescriptions.front().stride = GeometryBuffer::GetVertexStride();
+	}
+
 	Pipeline::~Pipeline()
 	{
 		for (auto& [type, module] : m_ShaderModules)
@@ -134,9 +154,13 @@ namespace Hog
 	{
 	}
 
-	void GraphicsPipeline::Generate(VkRenderPass renderPass, VkSpecializationInfo* specializationInfo)
+	void GraphicsPipeline::Generate(VkRenderPass renderPass, VkSpecializationInfo* specializationInfo, uint32_t subpass)
 	{
 		auto data = ShaderReflection::ReflectPipelineLayout(m_ShaderSources);
+		if (m_MeshVertexInput)
+		{
+			UseMeshVertexFormat(data);
+		}
 
 		for (const auto& [stage, source] : m_ShaderSources)
 		{
@@ -164,10 +188,26 @@ namespace Hog
 		m_GraphicsPipelineCreateInfo.pStages = m_ShaderStageCreateInfos.data();
 		m_GraphicsPipelineCreateInfo.layout = m_PipelineLayout;
 		m_GraphicsPipelineCreateInfo.renderPass = renderPass;
+		m_GraphicsPipelineCreateInfo.subpass = subpass;
 
 		CheckVkResult(vkCreateGraphicsPipelines(GraphicsContext::GetDevice(), VK_NULL_HANDLE, 1, &m_GraphicsPipelineCreateInfo, nullptr, &m_Handle));
 	}
 
+	void GraphicsPipeline::Generate(const RenderingFormats& formats, VkSpecializationInfo* specializationInfo)
+	{
+		m_RenderingFormats = formats;
+
+		m_RenderingCreateInfo.colorAttachmentCount = static_cast<uint32_t>(m_RenderingFormats.ColorFormats.size());
+		m_RenderingCreateInfo.pColorAttachmentFormats = m_RenderingFormats.ColorFormats.data();
+		m_RenderingCreateInfo.depthAttachmentFormat = m_RenderingFormats.DepthFormat;
+		m_RenderingCreateInfo.stencilAttachmentFormat = m_RenderingFormats.StencilFormat;
+
+		// Only looked at when the pipeline is created without a render pass
+		m_GraphicsPipelineCreateInfo.pNext = &m_RenderingCreateInfo;
+
+		Generate(VK_NULL_HANDLE, specializationInfo);
+	}
+
 	void GraphicsPipeline::Bind(VkCommandBuffer commandBuffer)
 	{
 		HG_PROFILE_FUNCTION();
@@ -190,7 +230,7 @@ namespace Hog
 	{
 	}
 
-	void ComputePipeline::Generate(VkRenderPass renderPass, VkSpecializationInfo* specializationInfo)
+	void ComputePipeline::Generate(VkRenderPass renderPass, VkSpecializationInfo* specializationInfo, uint32_t subpass)
 	{
 		auto data = ShaderReflection::ReflectPipelineLayout(m_ShaderSources);
 
@@ -237,7 +277,7 @@ namespace Hog
 			});
 	}
 
-	void RayTracingPipeline::Generate(VkRenderPass renderPass, VkSpecializationInfo* specializationInfo)
+	void RayTracingPipeline::Generate(VkRenderPass renderPass, VkSpecializationInfo* specializationInfo, uint32_t subpass)
 	{
 		auto data = ShaderReflection::ReflectPipelineLayout(m_ShaderSources);
 
@@ -7,16 +7,28 @@
 
 namespace Hog
 {
+	// Attachment formats a graphics pipeline renders to when it is used with dynamic rendering instead of a render pass
+	struct RenderingFormats
+	{
+		std::vector<VkFormat> ColorFormats;
+		VkFormat DepthFormat = VK_FORMAT_UNDEFINED;
+		VkFormat StencilFormat = VK_FORMAT_UNDEFINED;
+	};
+
 	class Pipeline
 	{
 	public:
 		~Pipeline();
 
-		virtual void Generate(VkRenderPass renderPass, VkSpecializationInfo* specializationInfo) = 0;
+		virtual void Generate(VkRenderPass renderPass, VkSpecializationInfo* specializationInfo, uint32_t subpass = 0) = 0;
+		virtual void Generate(const RenderingFormats& formats, VkSpecializationInfo* specializationInfo) { Generate(VK_NULL_HANDLE, specializationInfo); }
 		virtual void Bind(VkCommandBuffer commandBuffer) = 0;
 
 		VkPipeline GetHandle() { return m_Handle; }
 		VkPipelineLayout GetPipelineLayout() { return m_PipelineLayout; }
+		// Pipelines of mesh stages read their vertex inputs in the format of the shared geometry buffer instead of the
+		// one reflected from the shaders, takes effect on the next Generate
+		void SetMeshVertexInput(bool meshVertexInput) { m_MeshVertexInput = meshVertexInput; }
 	protected:
 		void AddShader(std::string shader);
 		void AddShaderStage(ShaderType type, VkShaderModule shaderModule, VkSpecializationInfo* specializationInfo, const char* main = "main");
@@ -26,6 +38,7 @@ namespace Hog
 		std::vector<VkPipelineShaderStageCreateInfo> m_ShaderStageCreateInfos;
 		VkPipelineLayout m_PipelineLayout = VK_NULL_HANDLE;;
 		VkPipeline m_Handle = VK_NULL_HANDLE;
+		bool m_MeshVertexInput = false;
 	};
 
 	class GraphicsPipeline : public Pipeline
@@ -123,10 +136,16 @@ namespace Hog
 		GraphicsPipeline(const Configuration& configuration);
 		~GraphicsPipeline();
 
-		virtual void Generate(VkRenderPass renderPass, VkSpecializationInfo* specializationInfo) override;
+		virtual void Generate(VkRenderPass renderPass, VkSpecializationInfo* specializationInfo, uint32_t subpass = 0) override;
+		virtual void Generate(const RenderingFormats& formats, VkSpecializationInfo* specializationInfo) override;
 		virtual void Bind(VkCommandBuffer commandBuffer) override;
 	private:
 		Configuration m_Config;
+		RenderingFormats m_RenderingFormats;
+
+		VkPipelineRenderingCreateInfo m_RenderingCreateInfo = {
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO,
+		};
 
 		VkPipelineVertexInputStateCreateInfo m_VertexInputStateCreateInfo = {
 			.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
@@ -215,7 +234,7 @@ namespace Hog
 		ComputePipeline(const Configuration& configuration);
 		~ComputePipeline();
 
-		virtual void Generate(VkRenderPass renderPass, VkSpecializationInfo* specializationInfo) override;
+		virtual void Generate(VkRenderPass renderPass, VkSpecializationInfo* specializationInfo, uint32_t subpass = 0) override;
 		virtual void Bind(VkCommandBuffer commandBuffer) override;
 	private:
 		Configuration m_Config;
@@ -238,7 +257,7 @@ namespace Hog
 	public:
 		RayTracingPipeline(const Configuration& configuration);
 
-		virtual void Generate(VkRenderPass renderPass, VkSpecializationInfo* specializationInfo) override;
+		virtual void Generate(VkRenderPass renderPass, VkSpecializationInfo* specializationInfo, uint32_t subpass = 0) override;
 		virtual void Bind(VkCommandBuffer commandBuffer) override;
 	private:
 		Configuration m_Config;
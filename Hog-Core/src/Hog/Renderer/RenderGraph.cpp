@@ -2,8 +2,256 @@
 
 #include "RenderGraph.h"
 
+#include "Hog/Core/CVars.h"
+
 namespace Hog
 {
+	struct ResourceUsage
+	{
+		Ref<Image> Image;
+		Ref<Buffer> Buffer;
+		VkPipelineStageFlags2 Stages = VK_PIPELINE_STAGE_2_NONE;
+		VkAccessFlags2 Access = VK_ACCESS_2_NONE;
+		VkImageLayout Layout = VK_IMAGE_LAYOUT_UNDEFINED;
+		bool Discard = false;
+	};
+
+	struct ResourceState
+	{
+		// Stages of the last write or layout transition and the accesses it performed
+		VkPipelineStageFlags2 WriteStages = VK_PIPELINE_STAGE_2_NONE;
+		VkAccessFlags2 WriteAccess = VK_ACCESS_2_NONE;
+		// Stages that read the resource since the last write
+		VkPipelineStageFlags2 ReadStages = VK_PIPELINE_STAGE_2_NONE;
+		// Stages and accesses the last write has already been made visible to
+		VkPipelineStageFlags2 VisibleStages = VK_PIPELINE_STAGE_2_NONE;
+		VkAccessFlags2 VisibleAccess = VK_ACCESS_2_NONE;
+		VkImageLayout Layout = VK_IMAGE_LAYOUT_UNDEFINED;
+		VkImageLayout InitialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		// Queue and plan index of the last stage that used the resource
+		RenderQueue Queue = RenderQueue::Graphics;
+		int32_t LastStage = -1;
+	};
+
+	static VkAccessFlags2 ToStorageAccess(ResourceAccess access)
+	{
+		switch (access)
+		{
+			case ResourceAccess::Read:		return VK_ACCESS_2_SHADER_STORAGE_READ_BIT;
+			case ResourceAccess::Write:		return VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+			case ResourceAccess::ReadWrite:	return VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+		}
+
+		return VK_ACCESS_2_NONE;
+	}
+
+	static void AddUsage(std::vector<ResourceUsage>& usages, const ResourceUsage& usage)
+	{
+		for (auto& existing : usages)
+		{
+			if (existing.Image == usage.Image && existing.Buffer == usage.Buffer)
+			{
+				existing.Stages |= usage.Stages;
+				existing.Access |= usage.Access;
+				existing.Discard = existing.Discard && usage.Discard;
+				if (existing.Layout != usage.Layout)
+				{
+					existing.Layout = VK_IMAGE_LAYOUT_GENERAL;
+				}
+
+				return;
+			}
+		}
+
+		usages.push_back(usage);
+	}
+
+	static const void* GetResourceKey(const Ref<Image>& image, const Ref<Buffer>& buffer)
+	{
+		return image ? static_cast<const void*>(image.get()) : static_cast<const void*>(buffer.get());
+	}
+
+	static std::vector<ResourceUsage> GatherUsages(const StageDescription& stage)
+	{
+		std::vector<ResourceUsage> usages;
+
+		for (const auto& attachment : stage.Attachments)
+		{
+			// The swapchain image is transitioned by the frame that owns it
+			if (!attachment.Image) continue;
+
+			switch (attachment.Type)
+			{
+				case AttachmentType::Color:
+				{
+					AddUsage(usages, {
+						.Image = attachment.Image,
+						.Stages = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+						.Access = attachment.Clear ? VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT : (VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT),
+						.Layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+						.Discard = attachment.Clear,
+					});
+				}break;
+				case AttachmentType::Depth:
+				case AttachmentType::DepthStencil:
+				{
+					AddUsage(usages, {
+						.Image = attachment.Image,
+						.Stages = VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+						.Access = VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+						.Layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+						.Discard = attachment.Clear,
+					});
+				}break;
+				default: break;
+			}
+		}
+
+		for (const auto& resource : stage.Resources)
+		{
+			VkPipelineStageFlags2 stages = ToPipelineStageFlags(resource.BindLocation);
+
+			switch (resource.Type)
+			{
+				case ResourceType::Sampler:
+				{
+					AddUsage(usages, {
+						.Image = resource.Texture->GetImage(),
+						.Stages = stages,
+						.Access = VK_ACCESS_2_SHADER_SAMPLED_READ_BIT,
+						.Layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+					});
+				}break;
+				case ResourceType::SamplerArray:
+				{
+					for (const auto& texture : resource.Textures)
+					{
+						AddUsage(usages, {
+							.Image = texture->GetImage(),
+							.Stages = stages,
+							.Access = VK_ACCESS_2_SHADER_SAMPLED_READ_BIT,
+							.Layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+						});
+					}
+				}break;
+				case ResourceType::InputAttachment:
+				{
+					AddUsage(usages, {
+						.Image = resource.Texture->GetImage(),
+						.Stages = VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
+						.Access = VK_ACCESS_2_INPUT_ATTACHMENT_READ_BIT,
+						.Layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+					});
+				}break;
+				case ResourceType::StorageImage:
+				{
+					AddUsage(usages, {
+						.Image = resource.StorageImage,
+						.Stages = stages,
+						.Access = ToStorageAccess(resource.Access),
+						.Layout = VK_IMAGE_LAYOUT_GENERAL,
+						.Discard = resource.Access == ResourceAccess::Write,
+					});
+				}break;
+				case ResourceType::Storage:
+				{
+					AddUsage(usages, {
+						.Buffer = resource.Buffer,
+						.Stages = stages,
+						.Access = ToStorageAccess(resource.Access),
+						.Discard = resource.Access == ResourceAccess::Write,
+					});
+				}break;
+				case ResourceType::Uniform:
+				{
+					AddUsage(usages, {
+						.Buffer = resource.Buffer,
+						.Stages = stages,
+						.Access = VK_ACCESS_2_UNIFORM_READ_BIT,
+					});
+				}break;
+				default: break;
+			}
+		}
+
+		return usages;
+	}
+
+	static bool PresentsToSwapchain(const StageDescription& stage)
+	{
+		if (stage.StageType == RendererStageType::ImGui || stage.StageType == RendererStageType::Blit) return true;
+
+		return stage.Attachments.ContainsType(AttachmentType::Swapchain);
+	}
+
+	static bool CanShareRenderPass(const StageDescription& stage)
+	{
+		if (stage.StageType != RendererStageType::ForwardGraphics && stage.StageType != RendererStageType::DeferredGraphics &&
+			stage.StageType != RendererStageType::ScreenSpacePass) return false;
+
+		// Stages toggled on their own cannot be part of a render pass that runs as a whole, and the
+		// swapchain image changes every frame while a shared framebuffer is only created once.
+		return stage.Attachments.size() > 0 && stage.EnableCVar.empty() && !stage.Attachments.ContainsType(AttachmentType::Swapchain);
+	}
+
+	static bool IsInputAttachmentRead(const ResourceUsage& usage)
+	{
+		return usage.Access == VK_ACCESS_2_INPUT_ATTACHMENT_READ_BIT;
+	}
+
+	// Updates the tracked state of a resource for a new usage and fills in the barrier
+	// that has to precede it. Returns false when the usage needs no synchronization.
+	static bool ResolveUsage(ResourceState& state, const ResourceUsage& usage, BarrierDescription& barrier)
+	{
+		const VkAccessFlags2 writeAccess = GetWriteAccess(usage.Access);
+		const bool layoutChange = usage.Image && state.Layout != usage.Layout;
+
+		VkPipelineStageFlags2 srcStages = VK_PIPELINE_STAGE_2_NONE;
+		VkAccessFlags2 srcAccess = VK_ACCESS_2_NONE;
+		bool needed = false;
+
+		if (writeAccess || layoutChange)
+		{
+			// Writes and layout transitions have to wait for every access since the last write
+			srcStages = state.WriteStages | state.ReadStages;
+			srcAccess = state.WriteAccess;
+			needed = layoutChange || srcStages != VK_PIPELINE_STAGE_2_NONE;
+
+			// A layout transition behaves like a write that is visible to the stages of this usage
+			state.WriteStages = usage.Stages;
+			state.WriteAccess = writeAccess;
+			state.ReadStages = writeAccess ? VK_PIPELINE_STAGE_2_NONE : usage.Stages;
+			state.VisibleStages = usage.Stages;
+			state.VisibleAccess = usage.Access;
+		}
+		else
+		{
+			// Read after read needs nothing, read after write needs the write to be visible to this usage
+			if (state.WriteStages != VK_PIPELINE_STAGE_2_NONE &&
+				((usage.Stages & ~state.VisibleStages) || (usage.Access & ~state.VisibleAccess)))
+			{
+				srcStages = state.WriteStages;
+				srcAccess = state.WriteAccess;
+				needed = true;
+
+				state.VisibleStages |= usage.Stages;
+				state.VisibleAccess |= usage.Access;
+			}
+
+			state.ReadStages |= usage.Stages;
+		}
+
+		barrier = {
+			static_cast<PipelineStage>(srcStages), static_cast<AccessFlag>(srcAccess),
+			static_cast<PipelineStage>(usage.Stages), static_cast<AccessFlag>(usage.Access),
+			static_cast<ImageLayout>(state.Layout), static_cast<ImageLayout>(usage.Layout),
+		};
+
+		state.Layout = usage.Layout;
+
+		return needed;
+	}
+
 	bool AttachmentLayout::ContainsType(AttachmentType type) const
 	{
 		for (const auto& elem : m_Elements)
@@ -26,110 +274,795 @@ namespace Hog
 
 	void RenderGraph::Cleanup()
 	{
+		// Break the parent/child links up front so that long chains are not
+		// released through deeply recursive destructor calls.
+		for (auto& node : m_Nodes)
+		{
+			node->Cleanup();
+		}
+
 		m_StartingPoints.clear();
+		m_Nodes.clear();
+		m_ExecutionPlan.clear();
+		m_PlanIndices.clear();
+		m_EnableCVars.clear();
+		m_ActiveStages.clear();
+		m_StageBarriers.clear();
+		m_TransientResources.clear();
+		m_StageSchedules.clear();
+		m_StageSubpasses.clear();
+		m_RenderPassLocalImages.clear();
+		m_AliasingGroups.clear();
+		m_AliasingGroupKeys.clear();
+		m_Dirty = true;
+		m_ActiveDirty = true;
 	}
 
 	Ref<Node> RenderGraph::AddStage(Ref<Node> parent, const StageDescription& stageInfo)
 	{
+		Ref<Node> ref;
 		if (parent == nullptr)
 		{
-			auto ref = Node::Create(stageInfo);
+			ref = Node::Create(stageInfo);
 			m_StartingPoints.push_back(ref);
-			return ref;
 		}
 		else
 		{
-			auto ref = Node::Create(parent, stageInfo);
-			return ref;
+			ref = Node::Create(parent, stageInfo);
 		}
+
+		m_Nodes.push_back(ref);
+		m_Dirty = true;
+		return ref;
 	}
 
 	Ref<Node> RenderGraph::AddStage(const std::vector<Ref<Node>>& parents, const StageDescription& stageInfo)
 	{
-		return Node::Create(parents, stageInfo);
+		auto ref = Node::Create(parents, stageInfo);
+		if (parents.empty())
+		{
+			m_StartingPoints.push_back(ref);
+		}
+
+		m_Nodes.push_back(ref);
+		m_Dirty = true;
+		return ref;
 	}
 
-	std::vector<Ref<Node>> RenderGraph::GetStages()
+	const std::vector<Ref<Node>>& RenderGraph::Compile()
 	{
-		std::vector<Ref<Node>> stages;
-		std::queue<Ref<Node>> toVisit;
-		for (auto node : m_StartingPoints)
+		if (!m_Dirty && !m_ActiveDirty) return m_ExecutionPlan;
+
+		HG_PROFILE_FUNCTION();
+
+		if (m_Dirty)
+		{
+			SortStages();
+			MergeSubpasses();
+			FindTransientResources();
+
+			m_Dirty = false;
+		}
+
+		CullStages();
+		AssignQueues();
+		InferBarriers();
+
+		m_ActiveDirty = false;
+		return m_ExecutionPlan;
+	}
+
+	const std::vector<uint32_t>& RenderGraph::GetActiveStages()
+	{
+		Compile();
+		return m_ActiveStages;
+	}
+
+	void RenderGraph::SetStageEnabled(const Ref<Node>& node, bool enabled)
+	{
+		if (node->Enabled == enabled) return;
+
+		node->Enabled = enabled;
+		m_ActiveDirty = true;
+	}
+
+	bool RenderGraph::UpdateEnabledStages()
+	{
+		for (auto [node, value] : m_EnableCVars)
+		{
+			if (node->Enabled != (*value != 0))
+			{
+				node->Enabled = *value != 0;
+				m_ActiveDirty = true;
+			}
+		}
+
+		if (!m_ActiveDirty) return false;
+
+		auto previous = m_ActiveStages;
+		Compile();
+		return previous != m_ActiveStages;
+	}
+
+	void RenderGraph::SetAsyncCompute(bool enabled)
+	{
+		if (m_AsyncCompute == enabled) return;
+
+		m_AsyncCompute = enabled;
+		m_ActiveDirty = true;
+	}
+
+	const std::vector<StageSchedule>& RenderGraph::GetStageSchedules()
+	{
+		Compile();
+		return m_StageSchedules;
+	}
+
+	void RenderGraph::SetSubpassMerging(bool enabled)
+	{
+		if (m_SubpassMerging == enabled) return;
+
+		m_SubpassMerging = enabled;
+		m_Dirty = true;
+	}
+
+	const std::vector<StageSubpass>& RenderGraph::GetStageSubpasses()
+	{
+		Compile();
+		return m_StageSubpasses;
+	}
+
+	bool RenderGraph::IsRenderPassLocal(const Ref<Image>& image)
+	{
+		Compile();
+		return m_RenderPassLocalImages.contains(image.get());
+	}
+
+	void RenderGraph::SortStages()
+	{
+		// Insertion order doubles as the tie breaker, so stages that are independent
+		// of each other always execute in the order they were added to the graph.
+		std::vector<Ref<Node>> nodes = m_Nodes;
+		std::unordered_map<Node*, uint32_t> indices;
+		indices.reserve(nodes.size());
+		for (uint32_t i = 0; i < nodes.size(); ++i)
+		{
+			indices.emplace(nodes[i].get(), i);
+		}
+
+		// Pick up children that were linked to the graph without going through AddStage
+		for (size_t i = 0; i < nodes.size(); ++i)
+		{
+			for (const auto& child : nodes[i]->ChildList)
+			{
+				if (indices.emplace(child.get(), static_cast<uint32_t>(nodes.size())).second)
+				{
+					nodes.push_back(child);
+				}
+			}
+		}
+
+		std::vector<uint32_t> inDegree(nodes.size(), 0);
+		for (const auto& node : nodes)
+		{
+			for (const auto& child : node->ChildList)
+			{
+				inDegree[indices[child.get()]]++;
+			}
+		}
+
+		std::priority_queue<uint32_t, std::vector<uint32_t>, std::greater<uint32_t>> ready;
+		for (uint32_t i = 0; i < nodes.size(); ++i)
 		{
-			toVisit.push(node);
+			if (inDegree[i] == 0) ready.push(i);
 		}
 
-		while (!toVisit.empty())
+		m_ExecutionPlan.clear();
+		m_ExecutionPlan.reserve(nodes.size());
+		while (!ready.empty())
 		{
-			Ref<Node> visiting = toVisit.front();
+			uint32_t index = ready.top();
+			ready.pop();
+
+			m_ExecutionPlan.push_back(nodes[index]);
 
-			if (std::find(stages.begin(), stages.end(), visiting) == stages.end())
+			for (const auto& child : nodes[index]->ChildList)
 			{
-				stages.push_back(visiting);
+				uint32_t childIndex = indices[child.get()];
+				if (--inDegree[childIndex] == 0) ready.push(childIndex);
 			}
+		}
 
-			for (auto child : visiting->ChildList)
+		if (m_ExecutionPlan.size() != nodes.size())
+		{
+			for (uint32_t i = 0; i < nodes.size(); ++i)
 			{
-				toVisit.push(child);
+				if (inDegree[i] != 0)
+				{
+					HG_CORE_ERROR("Render graph stage \"{}\" is part of a dependency cycle", nodes[i]->StageInfo.Name);
+				}
 			}
 
-			toVisit.pop();
+			HG_CORE_ASSERT(false, "Render graph contains a cycle and cannot be compiled");
 		}
 
-		return stages;
+		m_PlanIndices.clear();
+		m_EnableCVars.clear();
+		for (uint32_t i = 0; i < m_ExecutionPlan.size(); ++i)
+		{
+			Node* node = m_ExecutionPlan[i].get();
+			m_PlanIndices.emplace(node, i);
+
+			const auto& name = node->StageInfo.EnableCVar;
+			if (name.empty()) continue;
+
+			int32_t* value = CVarSystem::Get()->GetIntCVar(name.c_str());
+			if (!value)
+			{
+				CVarSystem::Get()->CreateIntCVar(name.c_str(), "Enables a render graph stage", 1, 1);
+				value = CVarSystem::Get()->GetIntCVar(name.c_str());
+			}
+
+			node->Enabled = *value != 0;
+			m_EnableCVars.push_back({ node, value });
+		}
 	}
 
-	std::vector<Ref<Node>> RenderGraph::GetFinalStages()
+	const std::vector<StageBarriers>& RenderGraph::GetStageBarriers()
 	{
-		std::vector<Ref<Node>> stages;
-		std::stack<Ref<Node>> toVisit;
-		for (auto node : m_StartingPoints)
+		Compile();
+		return m_StageBarriers;
+	}
+
+	const std::vector<TransientResource>& RenderGraph::GetTransientResources()
+	{
+		Compile();
+		return m_TransientResources;
+	}
+
+	void RenderGraph::AddAliasingGroup(const std::vector<TransientResource>& resources)
+	{
+		HG_CORE_ASSERT(!resources.empty(), "Aliasing group is empty");
+
+		for (const auto& resource : resources)
 		{
-			toVisit.push(node);
+			m_AliasingGroups[GetResourceKey(resource.Image, resource.Buffer)] = static_cast<uint32_t>(m_AliasingGroupKeys.size());
 		}
 
-		while (!toVisit.empty())
+		m_AliasingGroupKeys.push_back(GetResourceKey(resources[0].Image, resources[0].Buffer));
+		m_ActiveDirty = true;
+	}
+
+	void RenderGraph::MergeSubpasses()
+	{
+		HG_PROFILE_FUNCTION();
+
+		const uint32_t count = static_cast<uint32_t>(m_ExecutionPlan.size());
+		m_StageSubpasses.clear();
+		m_StageSubpasses.resize(count);
+		m_RenderPassLocalImages.clear();
+
+		std::vector<std::vector<ResourceUsage>> usages(count);
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			usages[i] = GatherUsages(m_ExecutionPlan[i]->StageInfo);
+			m_StageSubpasses[i].RenderPassStage = i;
+		}
+
+		if (!m_SubpassMerging) return;
+
+		// A stage joins the render pass of the stage before it when it renders at the same size, reads at least one
+		// of the render pass's color attachments through input attachments and touches nothing else the render pass
+		// uses. Input attachments only ever read the texel of the current fragment, so the stage needs no other
+		// synchronization than the dependency between the subpasses.
+		uint32_t owner = 0;
+		VkExtent2D extent = {};
+		std::unordered_set<const void*> colorAttachments;
+		std::unordered_map<const void*, bool> renderPassResources;
+		for (uint32_t i = 0; i < count; ++i)
 		{
-			Ref<Node> visiting = toVisit.top();
-			toVisit.pop();
+			const auto& stage = m_ExecutionPlan[i]->StageInfo;
+
+			bool merge = i > 0 && CanShareRenderPass(stage) && CanShareRenderPass(m_ExecutionPlan[owner]->StageInfo) &&
+				stage.Resources.ContainsType(ResourceType::InputAttachment);
+
+			for (const auto& attachment : stage.Attachments)
+			{
+				if (!merge) break;
+
+				VkExtent2D attachmentExtent = attachment.Image->GetExtent();
+				merge = attachmentExtent.width == extent.width && attachmentExtent.height == extent.height;
+			}
+
+			for (const auto& usage : usages[i])
+			{
+				if (!merge) break;
+
+				const void* key = GetResourceKey(usage.Image, usage.Buffer);
+				if (IsInputAttachmentRead(usage))
+				{
+					merge = colorAttachments.contains(key);
+				}
+				else
+				{
+					auto resource = renderPassResources.find(key);
+					merge = resource == renderPassResources.end() || (!resource->second && !GetWriteAccess(usage.Access));
+				}
+			}
 
-			if (visiting->IsEndNode() &&
-				std::find(stages.begin(), stages.end(), visiting) == stages.end())
+			if (merge)
 			{
-				stages.push_back(visiting);
+				m_StageSubpasses[i] = { owner, m_StageSubpasses[owner].SubpassCount++ };
+			}
+			else
+			{
+				const auto& attachments = stage.Attachments.GetElements();
+
+				owner = i;
+				extent = !attachments.empty() && attachments[0].Image ? attachments[0].Image->GetExtent() : VkExtent2D{};
+				colorAttachments.clear();
+				renderPassResources.clear();
 			}
 
-			for (auto child : visiting->ChildList)
+			for (const auto& attachment : stage.Attachments)
 			{
-				toVisit.push(child);
+				if (attachment.Type == AttachmentType::Color && attachment.Image) colorAttachments.insert(attachment.Image.get());
+			}
+
+			for (const auto& usage : usages[i])
+			{
+				bool& written = renderPassResources[GetResourceKey(usage.Image, usage.Buffer)];
+				written = written || GetWriteAccess(usage.Access);
 			}
 		}
 
-		return stages;
+		// Attachments of a merged render pass that get cleared and are used nowhere else never have to leave tile
+		// memory. Anything used outside of the render pass or loaded across frames still has to be stored.
+		std::unordered_map<const void*, std::pair<uint32_t, uint32_t>> lifetimes;
+		std::unordered_set<const void*> discarded;
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			for (const auto& usage : usages[i])
+			{
+				const void* key = GetResourceKey(usage.Image, usage.Buffer);
+				auto [it, firstUse] = lifetimes.try_emplace(key, i, i);
+				it->second.second = i;
+				if (firstUse && usage.Discard) discarded.insert(key);
+			}
+		}
+
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			const auto& subpass = m_StageSubpasses[i];
+			const uint32_t first = subpass.RenderPassStage;
+			const uint32_t last = first + m_StageSubpasses[first].SubpassCount - 1;
+			if (first == last) continue;
+
+			for (const auto& attachment : m_ExecutionPlan[i]->StageInfo.Attachments)
+			{
+				const auto& lifetime = lifetimes[attachment.Image.get()];
+				if (lifetime.first >= first && lifetime.second <= last && discarded.contains(attachment.Image.get()))
+				{
+					m_RenderPassLocalImages.insert(attachment.Image.get());
+				}
+			}
+
+			if (subpass.Subpass > 0)
+			{
+				HG_CORE_INFO("Render graph stage \"{}\" runs as subpass {} of \"{}\"", m_ExecutionPlan[i]->StageInfo.Name,
+					subpass.Subpass, m_ExecutionPlan[first]->StageInfo.Name);
+			}
+		}
 	}
 
-	bool RenderGraph::ContainsStageType(RendererStageType type) const
+	void RenderGraph::FindTransientResources()
+	{
+		HG_PROFILE_FUNCTION();
+
+		// Lifetimes are taken with every stage enabled, toggling stages later only ever shortens them
+		m_TransientResources.clear();
+		std::unordered_map<const void*, int32_t> transientIndices;
+		for (uint32_t i = 0; i < m_ExecutionPlan.size(); ++i)
+		{
+			for (const auto& usage : GatherUsages(m_ExecutionPlan[i]->StageInfo))
+			{
+				auto [it, firstUse] = transientIndices.try_emplace(GetResourceKey(usage.Image, usage.Buffer), -1);
+				if (firstUse && usage.Discard)
+				{
+					it->second = static_cast<int32_t>(m_TransientResources.size());
+					m_TransientResources.push_back({ usage.Image, usage.Buffer, i, i });
+				}
+
+				if (it->second != -1)
+				{
+					m_TransientResources[it->second].LastStage = i;
+				}
+			}
+		}
+
+		// The attachments of a shared render pass are all bound for as long as the render pass runs
+		for (auto& resource : m_TransientResources)
+		{
+			resource.FirstStage = m_StageSubpasses[resource.FirstStage].RenderPassStage;
+
+			const uint32_t lastOwner = m_StageSubpasses[resource.LastStage].RenderPassStage;
+			resource.LastStage = lastOwner + m_StageSubpasses[lastOwner].SubpassCount - 1;
+		}
+	}
+
+	void RenderGraph::CullStages()
 	{
-		std::queue<Ref<Node>> toVisit;
-		for (auto node : m_StartingPoints)
+		HG_PROFILE_FUNCTION();
+
+		const size_t count = m_ExecutionPlan.size();
+		std::vector<std::vector<ResourceUsage>> usages(count);
+		for (size_t i = 0; i < count; ++i)
+		{
+			usages[i] = GatherUsages(m_ExecutionPlan[i]->StageInfo);
+		}
+
+		// Stages sharing a render pass run as a unit, disabling any of them disables the whole render pass
+		std::vector<bool> enabled(count);
+		for (size_t i = 0; i < count; ++i)
+		{
+			enabled[i] = m_ExecutionPlan[i]->Enabled;
+		}
+
+		for (size_t i = 0; i < count; ++i)
 		{
-			toVisit.push(node);
+			const uint32_t owner = m_StageSubpasses[i].RenderPassStage;
+			enabled[owner] = enabled[owner] && enabled[i];
 		}
 
-		while (!toVisit.empty())
+		for (size_t i = 0; i < count; ++i)
 		{
-			Ref<Node> visiting = toVisit.front();
+			enabled[i] = enabled[m_StageSubpasses[i].RenderPassStage];
+		}
 
-			if (visiting->StageInfo.StageType == type)
+		// Walks the plan backwards marking every enabled stage that is final, presents, or produces something a
+		// live stage consumes, either through a graph edge or by writing a resource it reads. Disabled stages
+		// do not consume anything themselves but pass liveness through to their parents, and reads that
+		// happen before the write in the plan consume the previous frame's results, hence the repeated walks.
+		std::vector<bool> live(count, false);
+		std::vector<bool> reachesLive(count, false);
+		std::vector<bool> renderPassLive(count, false);
+		std::unordered_set<const void*> consumed;
+		bool changed = true;
+		while (changed)
+		{
+			changed = false;
+			for (size_t i = count; i-- > 0;)
 			{
-				return true;
+				const auto& node = m_ExecutionPlan[i];
+
+				bool childReachesLive = std::any_of(node->ChildList.begin(), node->ChildList.end(), [&](const Ref<Node>& child) {
+					return reachesLive[m_PlanIndices[child.get()]];
+				});
+
+				const uint32_t owner = m_StageSubpasses[i].RenderPassStage;
+
+				if (enabled[i] && !live[i])
+				{
+					bool isLive = node->IsEndNode() || PresentsToSwapchain(node->StageInfo) || childReachesLive || renderPassLive[owner] ||
+						std::any_of(usages[i].begin(), usages[i].end(), [&](const ResourceUsage& usage) {
+							return GetWriteAccess(usage.Access) && consumed.contains(GetResourceKey(usage.Image, usage.Buffer));
+						});
+
+					if (isLive)
+					{
+						live[i] = true;
+						renderPassLive[owner] = true;
+						changed = true;
+
+						for (const auto& usage : usages[i])
+						{
+							if (usage.Access & ~GetWriteAccess(usage.Access))
+							{
+								consumed.insert(GetResourceKey(usage.Image, usage.Buffer));
+							}
+						}
+					}
+				}
+
+				reachesLive[i] = live[i] || (!enabled[i] && childReachesLive);
 			}
+		}
 
-			for (auto child : visiting->ChildList)
+		m_ActiveStages.clear();
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			if (live[i])
+			{
+				m_ActiveStages.push_back(i);
+			}
+			else if (enabled[i])
 			{
-				toVisit.push(child);
+				HG_CORE_INFO("Render graph stage \"{}\" is culled, nothing consumes its results", m_ExecutionPlan[i]->StageInfo.Name);
 			}
+		}
+	}
+
+	void RenderGraph::AssignQueues()
+	{
+		HG_PROFILE_FUNCTION();
+
+		m_StageSchedules.clear();
+		m_StageSchedules.resize(m_ExecutionPlan.size());
+		if (!m_AsyncCompute) return;
 
-			toVisit.pop();
+		// Resources that share memory conflict with each other like a single resource would
+		auto memoryKey = [&](const Ref<Image>& image, const Ref<Buffer>& buffer) {
+			const void* key = GetResourceKey(image, buffer);
+			auto group = m_AliasingGroups.find(key);
+			return group != m_AliasingGroups.end() ? m_AliasingGroupKeys[group->second] : key;
+		};
+
+		std::vector<std::vector<ResourceUsage>> usages(m_ExecutionPlan.size());
+		std::vector<bool> active(m_ExecutionPlan.size(), false);
+		std::unordered_set<const void*> written;
+		for (uint32_t index : m_ActiveStages)
+		{
+			active[index] = true;
+			usages[index] = GatherUsages(m_ExecutionPlan[index]->StageInfo);
+			for (const auto& usage : usages[index])
+			{
+				if (GetWriteAccess(usage.Access)) written.insert(memoryKey(usage.Image, usage.Buffer));
+			}
+		}
+
+		// Resources nothing in the graph writes are only ever read, they do not order the queues against each other
+		std::unordered_set<const void*> graphicsResources;
+		std::unordered_set<const void*> computeResources;
+		std::vector<bool> afterGraphics(m_ExecutionPlan.size(), false);
+		std::vector<bool> afterCompute(m_ExecutionPlan.size(), false);
+		for (uint32_t i = 0; i < m_ExecutionPlan.size(); ++i)
+		{
+			const auto& node = m_ExecutionPlan[i];
+
+			// Inactive stages still order their parents before their children
+			bool parentGraphics = false;
+			bool parentCompute = false;
+			for (const auto& parent : node->ParentList)
+			{
+				uint32_t parentIndex = m_PlanIndices[parent.lock().get()];
+				parentGraphics |= afterGraphics[parentIndex];
+				parentCompute |= afterCompute[parentIndex];
+			}
+
+			if (!active[i])
+			{
+				afterGraphics[i] = parentGraphics;
+				afterCompute[i] = parentCompute;
+				continue;
+			}
+
+			bool sharesGraphics = false;
+			bool sharesCompute = false;
+			for (const auto& usage : usages[i])
+			{
+				const void* key = memoryKey(usage.Image, usage.Buffer);
+				if (!written.contains(key)) continue;
+
+				sharesGraphics |= graphicsResources.contains(key);
+				sharesCompute |= computeResources.contains(key);
+			}
+
+			const auto type = node->StageInfo.StageType;
+			const bool compute = type == RendererStageType::ForwardCompute || type == RendererStageType::DeferredCompute || type == RendererStageType::RayTracing;
+
+			auto& schedule = m_StageSchedules[i];
+			if (compute && !parentGraphics && !sharesGraphics)
+			{
+				schedule.Queue = RenderQueue::AsyncCompute;
+				afterCompute[i] = true;
+			}
+			else
+			{
+				schedule.WaitsForAsyncCompute = parentCompute || sharesCompute;
+				afterGraphics[i] = true;
+				afterCompute[i] = parentCompute;
+			}
+
+			auto& resources = schedule.Queue == RenderQueue::AsyncCompute ? computeResources : graphicsResources;
+			for (const auto& usage : usages[i])
+			{
+				resources.insert(memoryKey(usage.Image, usage.Buffer));
+			}
+		}
+	}
+
+	void RenderGraph::InferBarriers()
+	{
+		HG_PROFILE_FUNCTION();
+
+		std::vector<std::vector<ResourceUsage>> usages(m_ExecutionPlan.size());
+		std::unordered_set<const void*> written;
+		for (uint32_t index : m_ActiveStages)
+		{
+			usages[index] = GatherUsages(m_ExecutionPlan[index]->StageInfo);
+			for (const auto& usage : usages[index])
+			{
+				if (GetWriteAccess(usage.Access)) written.insert(GetResourceKey(usage.Image, usage.Buffer));
+			}
+		}
+
+		m_StageBarriers.clear();
+		m_StageBarriers.resize(m_ExecutionPlan.size());
+
+		struct AliasingState
+		{
+			const void* Occupant = nullptr;
+			RenderQueue Queue = RenderQueue::Graphics;
+			VkPipelineStageFlags2 Stages = VK_PIPELINE_STAGE_2_NONE;
+			VkAccessFlags2 WriteAccess = VK_ACCESS_2_NONE;
+		};
+
+		// The plan runs every frame, so the first pass only establishes the state resources are in at
+		// the end of a frame. The second pass then synchronizes the first stages of a frame against
+		// the last stages of the previous one as well as against each other.
+		std::unordered_map<const void*, ResourceState> states;
+		std::vector<AliasingState> aliasingStates(m_AliasingGroupKeys.size());
+		std::unordered_set<const void*> used;
+		for (uint32_t pass = 0; pass < 2; ++pass)
+		{
+			for (uint32_t index : m_ActiveStages)
+			{
+				const RenderQueue queue = m_StageSchedules[index].Queue;
+
+				for (const auto& usage : usages[index])
+				{
+					const void* key = GetResourceKey(usage.Image, usage.Buffer);
+
+					auto [it, inserted] = states.try_emplace(key);
+					ResourceState& state = it->second;
+					if (inserted && usage.Image)
+					{
+						state.Layout = usage.Image->GetImageLayout();
+						state.InitialLayout = state.Layout;
+					}
+
+					// Work on the other queue is ordered through the semaphores between the queues,
+					// only the ownership of resources the graph writes has to follow it around.
+					const bool crossQueue = state.LastStage != -1 && state.Queue != queue && written.contains(key);
+					const RenderQueue previousQueue = state.Queue;
+					const int32_t previousStage = state.LastStage;
+					const VkPipelineStageFlags2 previousStages = state.WriteStages | state.ReadStages;
+					const VkAccessFlags2 previousAccess = state.WriteAccess;
+					state.Queue = queue;
+					state.LastStage = static_cast<int32_t>(index);
+
+					BarrierDescription barrier;
+					bool needed = ResolveUsage(state, usage, barrier);
+					bool discard = usage.Discard;
+
+					if (crossQueue)
+					{
+						// Later uses on this queue only have to wait for the acquire
+						state.WriteStages = usage.Stages;
+						state.WriteAccess = GetWriteAccess(usage.Access);
+						state.ReadStages = state.WriteAccess ? VK_PIPELINE_STAGE_2_NONE : usage.Stages;
+						state.VisibleStages = usage.Stages;
+						state.VisibleAccess = usage.Access;
+					}
+
+					// Memory shared with other resources has to wait for the previous occupant to be done with it
+					auto group = m_AliasingGroups.find(key);
+					if (group != m_AliasingGroups.end())
+					{
+						auto& aliasing = aliasingStates[group->second];
+						if (aliasing.Occupant != key)
+						{
+							if (aliasing.Occupant)
+							{
+								if (aliasing.Queue == queue)
+								{
+									barrier.SrcStage = static_cast<PipelineStage>(static_cast<VkPipelineStageFlags2>(barrier.SrcStage) | aliasing.Stages);
+									barrier.SrcAccessMask = static_cast<AccessFlag>(static_cast<VkAccessFlags2>(barrier.SrcAccessMask) | aliasing.WriteAccess);
+									needed = true;
+								}
+
+								discard = true;
+							}
+
+							aliasing = { key, queue };
+						}
+
+						aliasing.Stages |= usage.Stages;
+						aliasing.WriteAccess |= GetWriteAccess(usage.Access);
+					}
+
+					if (pass == 0) continue;
+
+					// Within a shared render pass the subpass dependencies make the earlier attachments readable
+					if (m_StageSubpasses[index].Subpass > 0 && IsInputAttachmentRead(usage)) continue;
+
+					bool firstUse = used.insert(key).second;
+
+					if (crossQueue)
+					{
+						const auto dstStage = static_cast<PipelineStage>(usage.Stages);
+						const auto dstAccess = static_cast<AccessFlag>(usage.Access);
+
+						if (discard)
+						{
+							// Nothing to carry over, the new queue takes the resource as is. The wait on
+							// the other queue covers every stage so the transition can chain onto it.
+							if (usage.Image)
+							{
+								m_StageBarriers[index].Images.push_back({ usage.Image,
+									{ PipelineStage::AllCommands, AccessFlag::None, dstStage, dstAccess, ImageLayout::Undefined, barrier.NewLayout }, true, queue, queue });
+							}
+							else
+							{
+								m_StageBarriers[index].Buffers.push_back({ usage.Buffer,
+									{ PipelineStage::AllCommands, AccessFlag::None, dstStage, dstAccess }, queue, queue });
+							}
+							continue;
+						}
+
+						const BarrierDescription release = {
+							static_cast<PipelineStage>(previousStages), static_cast<AccessFlag>(previousAccess), PipelineStage::None, AccessFlag::None,
+							barrier.OldLayout, barrier.NewLayout,
+						};
+						const BarrierDescription acquire = { PipelineStage::None, AccessFlag::None, dstStage, dstAccess, barrier.OldLayout, barrier.NewLayout };
+						if (usage.Image)
+						{
+							m_StageBarriers[previousStage].ReleaseImages.push_back({ usage.Image, release, false, previousQueue, queue });
+							m_StageBarriers[index].Images.push_back({ usage.Image, acquire, false, previousQueue, queue });
+						}
+						else
+						{
+							m_StageBarriers[previousStage].ReleaseBuffers.push_back({ usage.Buffer, release, previousQueue, queue });
+							m_StageBarriers[index].Buffers.push_back({ usage.Buffer, acquire, previousQueue, queue });
+						}
+						continue;
+					}
+
+					if (usage.Image)
+					{
+						// Images that start out in a different layout than the one they settle in still need
+						// a transition on their first use, it is skipped at record time once the layouts match.
+						if (needed || (firstUse && state.InitialLayout != usage.Layout))
+						{
+							m_StageBarriers[index].Images.push_back({ usage.Image, barrier, discard, queue, queue });
+						}
+					}
+					else if (needed)
+					{
+						m_StageBarriers[index].Buffers.push_back({ usage.Buffer, barrier, queue, queue });
+					}
+				}
+			}
+		}
+	}
+
+	const std::vector<Ref<Node>>& RenderGraph::GetStages()
+	{
+		return Compile();
+	}
+
+	std::vector<Ref<Node>> RenderGraph::GetFinalStages()
+	{
+		std::vector<Ref<Node>> stages;
+		for (const auto& node : Compile())
+		{
+			if (node->IsEndNode())
+			{
+				stages.push_back(node);
+			}
+		}
+
+		return stages;
+	}
+
+	bool RenderGraph::ContainsStageType(RendererStageType type) const
+	{
+		for (const auto& node : m_Nodes)
+		{
+			if (node->StageInfo.StageType == type)
+			{
+				return true;
+			}
 		}
 
 		return false;
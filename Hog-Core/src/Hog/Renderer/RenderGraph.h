@@ -16,13 +16,12 @@ namespace Hog
 		AttachmentType Type;
 		Ref<Image> Image;
 		bool Clear = false;
-		BarrierDescription Barrier;
 
 		AttachmentElement() = default;
-		AttachmentElement(std::string name, AttachmentType type, Ref<Hog::Image> image, bool clear = false, BarrierDescription barrier = {})
-			: Name(name), Type(type), Image(image), Clear(clear), Barrier(barrier) {}
-		AttachmentElement(std::string name, AttachmentType type, bool clear = false, BarrierDescription barrier = {})
-			: Name(name), Type(type), Clear(clear), Barrier(barrier) {}
+		AttachmentElement(std::string name, AttachmentType type, Ref<Hog::Image> image, bool clear = false)
+			: Name(name), Type(type), Image(image), Clear(clear) {}
+		AttachmentElement(std::string name, AttachmentType type, bool clear = false)
+			: Name(name), Type(type), Clear(clear) {}
 	};
 
 	class AttachmentLayout
@@ -159,22 +158,23 @@ namespace Hog
 		uint32_t Binding = 0;
 		uint32_t Set = 0;
 		uint32_t ArrayMaxCount = 0;
-		BarrierDescription Barrier;
+		// Only meaningful for Storage and StorageImage resources, every other type is read only
+		ResourceAccess Access = ResourceAccess::ReadWrite;
 
-		ResourceElement(const std::string& name, ResourceType type, ShaderType bindLocation, Ref<Hog::Buffer> buffer, uint32_t set, uint32_t binding, BarrierDescription barrier = {})
-			: Name(name), Type(type), BindLocation(bindLocation), Buffer(buffer), Binding(binding), Set(set), Barrier(barrier) {}
+		ResourceElement(const std::string& name, ResourceType type, ShaderType bindLocation, Ref<Hog::Buffer> buffer, uint32_t set, uint32_t binding, ResourceAccess access = ResourceAccess::ReadWrite)
+			: Name(name), Type(type), BindLocation(bindLocation), Buffer(buffer), Binding(binding), Set(set), Access(access) {}
 
-		ResourceElement(const std::string& name, ResourceType type, ShaderType bindLocation, Ref<Hog::Texture> texture, uint32_t set, uint32_t binding, BarrierDescription barrier = {})
-			: Name(name), Type(type), BindLocation(bindLocation), Texture(texture), Binding(binding), Set(set), Barrier(barrier) {}
+		ResourceElement(const std::string& name, ResourceType type, ShaderType bindLocation, Ref<Hog::Texture> texture, uint32_t set, uint32_t binding)
+			: Name(name), Type(type), BindLocation(bindLocation), Texture(texture), Binding(binding), Set(set) {}
 		
-		ResourceElement(const std::string& name, ResourceType type, ShaderType bindLocation, Ref<Hog::Image> image, uint32_t set, uint32_t binding, BarrierDescription barrier = {})
-			: Name(name), Type(type), BindLocation(bindLocation), StorageImage(image), Binding(binding), Set(set), Barrier(barrier) {}
+		ResourceElement(const std::string& name, ResourceType type, ShaderType bindLocation, Ref<Hog::Image> image, uint32_t set, uint32_t binding, ResourceAccess access = ResourceAccess::ReadWrite)
+			: Name(name), Type(type), BindLocation(bindLocation), StorageImage(image), Binding(binding), Set(set), Access(access) {}
 
-		ResourceElement(const std::string& name, ResourceType type, ShaderType bindLocation, Ref<Hog::AccelerationStructure> tlas, uint32_t set, uint32_t binding, BarrierDescription barrier = {})
-			: Name(name), Type(type), BindLocation(bindLocation), TLAS(tlas), Binding(binding), Set(set), Barrier(barrier) {}
+		ResourceElement(const std::string& name, ResourceType type, ShaderType bindLocation, Ref<Hog::AccelerationStructure> tlas, uint32_t set, uint32_t binding)
+			: Name(name), Type(type), BindLocation(bindLocation), TLAS(tlas), Binding(binding), Set(set) {}
 
-		ResourceElement(const std::string& name, ResourceType type, ShaderType bindLocation, const std::vector<Ref<Hog::Texture>>& textures, uint32_t set, uint32_t binding, uint32_t arrayMaxCount,  BarrierDescription barrier = {})
-			: Name(name), Type(type), BindLocation(bindLocation), Textures(textures), Binding(binding), Set(set), ArrayMaxCount(arrayMaxCount), Barrier(barrier) {}
+		ResourceElement(const std::string& name, ResourceType type, ShaderType bindLocation, const std::vector<Ref<Hog::Texture>>& textures, uint32_t set, uint32_t binding, uint32_t arrayMaxCount)
+			: Name(name), Type(type), BindLocation(bindLocation), Textures(textures), Binding(binding), Set(set), ArrayMaxCount(arrayMaxCount) {}
 
 		ResourceElement(const std::string& name, ResourceType type, ShaderType bindLocation, uint32_t constantID, size_t constantSize, void* dataPointer)
 			: Name(name), Type(type), BindLocation(bindLocation), ConstantID(constantID), ConstantSize(constantSize), ConstantDataPointer(dataPointer) {}
@@ -182,6 +182,10 @@ namespace Hog
 		ResourceElement(const std::string& name, ResourceType type, ShaderType bindLocation, size_t constantSize, void* dataPointer)
 			: Name(name), Type(type), BindLocation(bindLocation), ConstantSize(constantSize), ConstantDataPointer(dataPointer) {}
 
+		// Frame uniforms are read from the data pointer every frame, so the application only has to keep the data up to date
+		ResourceElement(const std::string& name, ResourceType type, ShaderType bindLocation, size_t size, void* dataPointer, uint32_t set, uint32_t binding)
+			: Name(name), Type(type), BindLocation(bindLocation), ConstantSize(size), ConstantDataPointer(dataPointer), Binding(binding), Set(set) {}
+
 		ResourceElement() = default;
 	};
 
@@ -219,6 +223,14 @@ namespace Hog
 		Ref<Buffer> DispatchBuffer;
 		BarrierDescription BarrierDescription;
 		Ref<Hog::ShaderBindingTable> ShaderBindingTable;
+		// Name of an int CVar that switches the stage on and off at runtime, created enabled if it does not exist
+		std::string EnableCVar;
+		// View projection the meshes of the stage are frustum culled against, owned and kept up to date by the
+		// application. Stages without one draw every mesh.
+		const glm::mat4* CullingViewProjection = nullptr;
+		// Blended meshes are drawn back to front instead of grouped by their buffers and material. Depth is
+		// measured with the culling view projection, without one the meshes are drawn in the order they were given.
+		bool SortBackToFront = false;
 
 		StageDescription(const std::string& name, RendererStageType type, Ref<Hog::Pipeline> pipeline, std::initializer_list<ResourceElement> resources, glm::ivec3 groupCounts)
 			: Name(name), Pipeline(pipeline), StageType(type), Resources(resources), GroupCounts(groupCounts) {}
@@ -239,6 +251,62 @@ namespace Hog
 		StageDescription() = default;
 	};
 
+	struct ImageBarrier
+	{
+		Ref<Image> Image;
+		BarrierDescription Barrier;
+		// The previous contents are not needed, transition from an undefined layout
+		bool Discard = false;
+		// Differing queues make this one half of a queue family ownership transfer
+		RenderQueue SrcQueue = RenderQueue::Graphics;
+		RenderQueue DstQueue = RenderQueue::Graphics;
+	};
+
+	struct BufferBarrier
+	{
+		Ref<Buffer> Buffer;
+		BarrierDescription Barrier;
+		RenderQueue SrcQueue = RenderQueue::Graphics;
+		RenderQueue DstQueue = RenderQueue::Graphics;
+	};
+
+	struct StageBarriers
+	{
+		std::vector<ImageBarrier> Images;
+		std::vector<BufferBarrier> Buffers;
+		// Ownership releases recorded after the stage, for resources the other queue uses next
+		std::vector<ImageBarrier> ReleaseImages;
+		std::vector<BufferBarrier> ReleaseBuffers;
+	};
+
+	struct StageSchedule
+	{
+		RenderQueue Queue = RenderQueue::Graphics;
+		// Graphics stages that consume results of the frame's async compute work have to wait for it
+		bool WaitsForAsyncCompute = false;
+	};
+
+	// Place of a stage within a render pass that several consecutive stages of the plan share as subpasses
+	struct StageSubpass
+	{
+		// Execution plan index of the stage that owns the render pass, the first subpass
+		uint32_t RenderPassStage = 0;
+		uint32_t Subpass = 0;
+		// Number of subpasses in the render pass, only set on the owning stage
+		uint32_t SubpassCount = 1;
+	};
+
+	// A resource whose contents are discarded by its first use every frame, so its memory
+	// can be shared with other transient resources that are never alive at the same time.
+	struct TransientResource
+	{
+		Ref<Image> Image;
+		Ref<Buffer> Buffer;
+		// Execution plan indices of the first and last stage that use the resource with every stage enabled
+		uint32_t FirstStage = 0;
+		uint32_t LastStage = 0;
+	};
+
 	struct Node
 	{
 		static Ref<Node> Create(const std::vector<Ref<Node>>& parents, StageDescription stageInfo)
@@ -271,6 +339,7 @@ namespace Hog
 		std::vector<Ref<Node>> ChildList;
 		std::vector<WeakRef<Node>> ParentList;
 		StageDescription StageInfo;
+		bool Enabled = true;
 
 		Node(const StageDescription& stageInfo)
 			:StageInfo(stageInfo) {}
@@ -305,11 +374,64 @@ namespace Hog
 
 		Ref<Node> AddStage(Ref<Node> parent, const StageDescription& stageInfo);
 		Ref<Node> AddStage(const std::vector<Ref<Node>>& parents, const StageDescription& stageInfo);
-		std::vector<Ref<Node>> GetStages();
+
+		// Topologically sorts the graph into an execution plan. The plan is cached
+		// and only rebuilt after the graph is modified through AddStage.
+		const std::vector<Ref<Node>>& Compile();
+		bool IsCompiled() const { return !m_Dirty && !m_ActiveDirty; }
+
+		// Indices into the execution plan of the stages that run every frame. Stages that are
+		// disabled or whose results never reach a final stage or the swapchain are culled.
+		const std::vector<uint32_t>& GetActiveStages();
+		void SetStageEnabled(const Ref<Node>& node, bool enabled);
+		// Picks up changes to the stage enable CVars, returns true when the active stages changed
+		bool UpdateEnabledStages();
+
+		// Lets compute and ray tracing stages that do not depend on the frame's graphics work run on a separate queue
+		void SetAsyncCompute(bool enabled);
+		const std::vector<StageSchedule>& GetStageSchedules();
+
+		// Lets graphics stages that only read earlier attachments through input attachments become subpasses of the
+		// render pass that writes them. Stages sharing a render pass are always enabled and culled together.
+		void SetSubpassMerging(bool enabled);
+		const std::vector<StageSubpass>& GetStageSubpasses();
+		// True for images that never leave the render pass they are rendered in, so they do not have to be stored
+		bool IsRenderPassLocal(const Ref<Image>& image);
+
+		// Barriers to record before each stage of the execution plan, indexed like the plan itself
+		const std::vector<StageBarriers>& GetStageBarriers();
+		const std::vector<TransientResource>& GetTransientResources();
+		// Marks resources that were placed in the same memory, so each one waits for the previous occupant
+		void AddAliasingGroup(const std::vector<TransientResource>& resources);
+
+		const std::vector<Ref<Node>>& GetStages();
 		std::vector<Ref<Node>> GetFinalStages();
 
 		bool ContainsStageType(RendererStageType type) const;
+	private:
+		void SortStages();
+		void MergeSubpasses();
+		void FindTransientResources();
+		void CullStages();
+		void AssignQueues();
+		void InferBarriers();
 	private:
 		std::vector<Ref<Node>> m_StartingPoints;
+		std::vector<Ref<Node>> m_Nodes;
+		std::vector<Ref<Node>> m_ExecutionPlan;
+		std::unordered_map<Node*, uint32_t> m_PlanIndices;
+		std::vector<std::pair<Node*, int32_t*>> m_EnableCVars;
+		std::vector<uint32_t> m_ActiveStages;
+		std::vector<StageSchedule> m_StageSchedules;
+		std::vector<StageSubpass> m_StageSubpasses;
+		std::unordered_set<const void*> m_RenderPassLocalImages;
+		std::vector<StageBarriers> m_StageBarriers;
+		std::vector<TransientResource> m_TransientResources;
+		std::unordered_map<const void*, uint32_t> m_AliasingGroups;
+		std::vector<const void*> m_AliasingGroupKeys;
+		bool m_AsyncCompute = false;
+		bool m_SubpassMerging = false;
+		bool m_Dirty = true;
+		bool m_ActiveDirty = true;
 	};
 }
\ No newline at end of file
@@ -4,22 +4,93 @@
 #include "Hog/Core/Application.h"
 #include "Hog/Renderer/GraphicsContext.h"
 #include "Hog/Renderer/Buffer.h"
+#include "Hog/Renderer/BindlessHeap.h"
+#include "Hog/Renderer/FrameAllocator.h"
+#include "Hog/Renderer/GeometryBuffer.h"
+#include "Hog/Renderer/UploadBatch.h"
 #include "Hog/Utils/RendererUtils.h"
+#include "Hog/Math/Math.h"
+#include "Hog/Utils/RadixSort.h"
 #include "Hog/Core/CVars.h"
+#include "Hog/Core/Timer.h"
 #include "Hog/ImGui/ImGuiLayer.h"
 
+#include <imgui.h>
+
 AutoCVar_Int CVar_ImageMipLevels("renderer.enableMipMapping", "Enable mip mapping for textures", 0, CVarFlags::None);
+AutoCVar_Int CVar_AsyncCompute("renderer.asyncCompute", "Run compute stages that do not depend on the frame's graphics work on a dedicated compute queue", 1, CVarFlags::EditReadOnly);
+AutoCVar_Int CVar_AliasTransientResources("renderer.aliasTransientResources", "Share memory between render graph resources with non overlapping lifetimes", 1, CVarFlags::EditReadOnly);
+AutoCVar_Int CVar_DynamicRendering("renderer.dynamicRendering", "Begin graphics stages with dynamic rendering instead of render pass and framebuffer objects", 0, CVarFlags::EditReadOnly);
+AutoCVar_Int CVar_MergeSubpasses("renderer.mergeSubpasses", "Merge graphics stages that read earlier attachments through input attachments into subpasses of one render pass", 1, CVarFlags::EditReadOnly);
+AutoCVar_Int CVar_RecordingThreads("renderer.recordingThreads", "Number of threads recording command buffers, 0 uses every hardware thread", 0, CVarFlags::None);
+AutoCVar_Int CVar_MeshesPerRecordingJob("renderer.meshesPerRecordingJob", "Number of draws recorded into one secondary command buffer", 128, CVarFlags::None);
+AutoCVar_Int CVar_SortDraws("renderer.sortDraws", "Sort the draws of mesh stages by their buffers, material and depth", 1, CVarFlags::None);
+AutoCVar_Int CVar_StatsOverlay("renderer.statsOverlay", "Show the renderer stats of the last frames in an ImGui window", 1, CVarFlags::None);
+AutoCVar_Int CVar_GPUTimestamps("renderer.gpuTimestamps", "Time the stages on the GPU with timestamp queries, for the stats and the profiling trace", 1, CVarFlags::EditReadOnly);
+AutoCVar_Int CVar_PipelineStatistics("renderer.pipelineStatistics", "Count the vertices, primitives and shader invocations of every stage with pipeline statistics queries", 0, CVarFlags::EditReadOnly);
+AutoCVar_Int CVar_FrameAllocatorSize("renderer.frameAllocatorSize", "Bytes of per frame data, like frame uniforms, every frame in flight can allocate", 1024 * 1024, CVarFlags::EditReadOnly);
+AutoCVar_Int CVar_GPUCulling("renderer.gpuCulling", "Frustum cull mesh stages that have a culling view projection in a compute pass and draw the survivors with one indirect draw", 1, CVarFlags::EditReadOnly);
 
 namespace Hog
 {
+	// The draw counts of the 16 and 32 bit index draws sit at the start of an indirect buffer, the draw commands follow
+	// them. Commands of 16 bit index draws come first.
+	static constexpr VkDeviceSize IndirectCommandOffset = 16;
+
+	// Push constants of Culling.compute
+	struct CullingConstants
+	{
+		std::array<glm::vec4, 6> FrustumPlanes;
+		uint32_t DrawCount;
+		int32_t DrawBuffer;
+		int32_t InstanceBuffer;
+		int32_t IndirectBuffer;
+		// First command of the 32 bit index draws
+		uint32_t WideDrawOffset;
+	};
+
+	// Resources that belong to a swapchain image rather than to a frame in flight
+	struct SwapchainTarget
+	{
+		Ref<Image> SwapchainImage;
+		Ref<FrameBuffer> FrameBuffer;
+		VkSemaphore RenderSemaphore = VK_NULL_HANDLE;
+	};
+
 	struct RendererData
 	{
 		RenderGraph Graph;
 		std::vector<RendererFrame> Frames;
+		std::vector<SwapchainTarget> SwapchainTargets;
 		std::vector<RendererStage> Stages;
 		bool Present = false;
 		DescriptorLayoutCache DescriptorLayoutCache;
+		DescriptorSetCache DescriptorSetCache;
+		FrameAllocator FrameAllocator;
 		Ref<ImGuiLayer> ImGuiLayer;
+		std::vector<VmaAllocation> TransientAllocations;
+
+		bool AsyncCompute = false;
+		bool DynamicRendering = false;
+		VkSemaphore GraphicsTimeline = VK_NULL_HANDLE;
+		VkSemaphore ComputeTimeline = VK_NULL_HANDLE;
+		uint64_t FrameSerial = 0;
+
+		bool GPUTimestamps = false;
+		bool ComputeTimestamps = false;
+		// Nanoseconds per timestamp tick, and the CPU time in microseconds the GPU's timestamp zero lines up with
+		double TimestampPeriod = 0.0;
+		double TimestampOffset = 0.0;
+		bool PipelineStatistics = false;
+		// Resources released by one queue that the other queue has not acquired yet
+		std::unordered_set<const void*> ReleasedResources;
+
+		Scope<ThreadPool> RecordingPool;
+
+		Ref<Pipeline> CullingPipeline;
+
+		Renderer::RendererStats Stats;
+		std::vector<Renderer::NamedStatistic> StatsHistory;
 
 		uint32_t FrameIndex = 0;
 		uint32_t MaxFrameCount = 2;
@@ -32,24 +103,399 @@ namespace Hog
 
 	static RendererData s_Data;
 
+	using StatGetter = float(*)(const Renderer::RendererStats& stats);
+
+	// Stats kept in the rolling history, the recording times of the stages follow them
+	static const std::pair<const char*, StatGetter> s_HistoryStats[] = {
+		{ "Frame wait (ms)", [](const Renderer::RendererStats& stats) { return stats.FrameWaitTime; } },
+		{ "Recording (ms)", [](const Renderer::RendererStats& stats) { return stats.RecordingTime; } },
+		{ "GPU (ms)", [](const Renderer::RendererStats& stats) { return stats.GPUTime; } },
+		{ "Draw calls", [](const Renderer::RendererStats& stats) { return static_cast<float>(stats.DrawCalls); } },
+		{ "Dispatches", [](const Renderer::RendererStats& stats) { return static_cast<float>(stats.Dispatches); } },
+		{ "Instances", [](const Renderer::RendererStats& stats) { return static_cast<float>(stats.Instances); } },
+		{ "Triangles", [](const Renderer::RendererStats& stats) { return static_cast<float>(stats.Triangles); } },
+		{ "Pipeline binds", [](const Renderer::RendererStats& stats) { return static_cast<float>(stats.PipelineBinds); } },
+		{ "Buffer binds", [](const Renderer::RendererStats& stats) { return static_cast<float>(stats.BufferBinds); } },
+		{ "Barriers", [](const Renderer::RendererStats& stats) { return static_cast<float>(stats.Barriers); } },
+		{ "Descriptor set writes", [](const Renderer::RendererStats& stats) { return static_cast<float>(stats.DescriptorSetWrites); } },
+		{ "Bindless writes", [](const Renderer::RendererStats& stats) { return static_cast<float>(stats.BindlessWrites); } },
+		{ "Bytes uploaded", [](const Renderer::RendererStats& stats) { return static_cast<float>(stats.BytesUploaded); } },
+		{ "Immediate submits", [](const Renderer::RendererStats& stats) { return static_cast<float>(stats.ImmediateSubmits); } },
+		{ "Upload submits", [](const Renderer::RendererStats& stats) { return static_cast<float>(stats.UploadSubmits); } },
+		{ "Visible meshes", [](const Renderer::RendererStats& stats) { return static_cast<float>(stats.VisibleMeshes); } },
+		{ "Culled meshes", [](const Renderer::RendererStats& stats) { return static_cast<float>(stats.CulledMeshes); } },
+	};
+
+	static void UpdateStatsHistory()
+	{
+		const auto& stats = s_Data.Stats;
+
+		size_t index = 0;
+		for (const auto& [name, getter] : s_HistoryStats)
+		{
+			s_Data.StatsHistory[index++].Statistic.Add(getter(stats));
+		}
+
+		for (const auto& stage : stats.Stages)
+		{
+			s_Data.StatsHistory[index++].Statistic.Add(stage.RecordingTime);
+			s_Data.StatsHistory[index++].Statistic.Add(stage.GPUTime);
+		}
+	}
+
+	// Statistics the graphics queue collects for every stage, the async compute queue only counts compute invocations.
+	// The results of a query come back in the order of the flag bits.
+	static constexpr VkQueryPipelineStatisticFlags GraphicsStatistics =
+		VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_VERTICES_BIT |
+		VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT |
+		VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+		VK_QUERY_PIPELINE_STATISTIC_CLIPPING_INVOCATIONS_BIT |
+		VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+		VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT |
+		VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT;
+	static constexpr uint32_t GraphicsStatisticCount = 7;
+
+	// Results are followed by their availability, statistics of a query that never finished stay zero
+	static Renderer::RendererStats::PipelineStatistics ToPipelineStatistics(const uint64_t* results, RenderQueue queue)
+	{
+		if (queue == RenderQueue::AsyncCompute)
+		{
+			if (!results[1]) return {};
+			return { .ComputeShaderInvocations = results[0] };
+		}
+
+		if (!results[GraphicsStatisticCount]) return {};
+		return {
+			.InputAssemblyVertices = results[0],
+			.InputAssemblyPrimitives = results[1],
+			.VertexShaderInvocations = results[2],
+			.ClippingInvocations = results[3],
+			.ClippingPrimitives = results[4],
+			.FragmentShaderInvocations = results[5],
+			.ComputeShaderInvocations = results[6],
+		};
+	}
+
+	static GPUProfileResult::ArgList ToTraceArgs(const Renderer::RendererStats::PipelineStatistics& statistics)
+	{
+		return {
+			{ "InputAssemblyVertices", statistics.InputAssemblyVertices },
+			{ "InputAssemblyPrimitives", statistics.InputAssemblyPrimitives },
+			{ "VertexShaderInvocations", statistics.VertexShaderInvocations },
+			{ "ClippingInvocations", statistics.ClippingInvocations },
+			{ "ClippingPrimitives", statistics.ClippingPrimitives },
+			{ "FragmentShaderInvocations", statistics.FragmentShaderInvocations },
+			{ "ComputeShaderInvocations", statistics.ComputeShaderInvocations },
+		};
+	}
+
+	static bool SupportsTimestamps(uint32_t queueFamily)
+	{
+		return GraphicsContext::GetGPUInfo()->QueueFamilyProperties[queueFamily].timestampValidBits > 0;
+	}
+
+	// Pairs a timestamp written on the graphics queue with the CPU time around its submission, so that the GPU events
+	// line up with the CPU events in the trace. The alignment is only as good as the submission latency.
+	static void CalibrateTimestamps()
+	{
+		VkQueryPool queryPool = GraphicsContext::CreateQueryPool(VK_QUERY_TYPE_TIMESTAMP, 1);
+
+		auto submitted = std::chrono::steady_clock::now();
+		GraphicsContext::ImmediateSubmit([&](VkCommandBuffer commandBuffer)
+		{
+			vkCmdWriteTimestamp2(commandBuffer, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, queryPool, 0);
+		});
+		auto finished = std::chrono::steady_clock::now();
+
+		uint64_t timestamp = 0;
+		CheckVkResult(vkGetQueryPoolResults(GraphicsContext::GetDevice(), queryPool, 0, 1, sizeof(timestamp), &timestamp,
+			sizeof(timestamp), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT));
+		vkDestroyQueryPool(GraphicsContext::GetDevice(), queryPool, nullptr);
+
+		FloatingPointMicroseconds cpuTime = submitted.time_since_epoch() + (finished - submitted) / 2;
+		s_Data.TimestampOffset = cpuTime.count() - timestamp * s_Data.TimestampPeriod / 1000.0;
+	}
+
+	static uint32_t GetQueueFamily(RenderQueue queue)
+	{
+		return queue == RenderQueue::AsyncCompute ? GraphicsContext::GetComputeQueueFamily() : GraphicsContext::GetQueueFamily();
+	}
+
+	static uint32_t GetRecordingThreadCount()
+	{
+		int32_t threadCount = *CVarSystem::Get()->GetIntCVar("renderer.recordingThreads");
+		if (threadCount <= 0)
+		{
+			return std::max(1u, std::thread::hardware_concurrency());
+		}
+
+		return static_cast<uint32_t>(threadCount);
+	}
+
+	// Recreates the recording threads and their command pools when the thread count changed
+	static void UpdateRecordingThreads()
+	{
+		uint32_t threadCount = GetRecordingThreadCount();
+		if (threadCount == s_Data.RecordingPool->GetThreadCount()) return;
+
+		// Frames in flight may still execute command buffers from the old pools
+		GraphicsContext::WaitIdle();
+
+		s_Data.RecordingPool = CreateScope<ThreadPool>(threadCount);
+		for (auto& frame : s_Data.Frames)
+		{
+			frame.InitThreadCommandPools(threadCount);
+		}
+
+		HG_CORE_INFO("Recording command buffers on {0} threads", threadCount);
+	}
+
+	// Blended stages are culled on the CPU, the culling pass does not keep the order of the draws
+	static bool UsesGPUCulling(const StageDescription& info)
+	{
+		return (info.StageType == RendererStageType::ForwardGraphics || info.StageType == RendererStageType::DeferredGraphics)
+			&& !info.Meshes.empty() && info.CullingViewProjection != nullptr && !info.SortBackToFront;
+	}
+
+	// Opaque draws are grouped by their index width and mesh first and their material second, draws sharing both go front
+	// to back. Blended draws go back to front and only use the rest to break ties. Stages draw with a single
+	// pipeline, so it has no bits of its own.
+	static uint64_t MakeDrawKey(uint32_t buffers, int32_t material, float depth, bool backToFront)
+	{
+		uint64_t depthBits = static_cast<uint64_t>(glm::clamp(depth, 0.0f, 1.0f) * 0xFFFFFF);
+		uint64_t bufferBits = buffers & 0xFFFFF;
+		uint64_t materialBits = static_cast<uint32_t>(material + 1) & 0xFFFFF;
+
+		if (backToFront)
+		{
+			return ((0xFFFFFF - depthBits) << 40) | (bufferBits << 20) | materialBits;
+		}
+
+		return (bufferBits << 44) | (materialBits << 24) | depthBits;
+	}
+
+	// Meshes already live in the shared geometry buffers, so GPU culling only needs its pipeline
+	static void CreateCullingPipeline()
+	{
+		HG_PROFILE_FUNCTION();
+
+		size_t meshCount = 0;
+		for (const auto& stage : s_Data.Stages)
+		{
+			if (UsesGPUCulling(stage.Info)) meshCount += stage.Info.Meshes.size();
+		}
+
+		if (meshCount == 0) return;
+
+		s_Data.CullingPipeline = ComputePipeline::Create({ .Shader = "Culling.compute" });
+		s_Data.CullingPipeline->Generate(nullptr, nullptr);
+
+		HG_CORE_INFO("GPU culling {0} meshes", meshCount);
+	}
+
+	static void BufferBarrier(VkCommandBuffer commandBuffer, VkBuffer buffer, VkPipelineStageFlags2 srcStage, VkAccessFlags2 srcAccess,
+		VkPipelineStageFlags2 dstStage, VkAccessFlags2 dstAccess)
+	{
+		VkBufferMemoryBarrier2 barrier = {
+			.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2,
+			.srcStageMask = srcStage,
+			.srcAccessMask = srcAccess,
+			.dstStageMask = dstStage,
+			.dstAccessMask = dstAccess,
+			.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.buffer = buffer,
+			.offset = 0,
+			.size = VK_WHOLE_SIZE,
+		};
+
+		VkDependencyInfo info = {
+			.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+			.bufferMemoryBarrierCount = 1,
+			.pBufferMemoryBarriers = &barrier,
+		};
+
+		s_Data.Stats.Barriers++;
+
+		vkCmdPipelineBarrier2(commandBuffer, &info);
+	}
+
+	// Buffers are persistently mapped and read without a submission of their own, so every submission ends by making
+	// its writes available to the host. A single global barrier, read back buffers only need the queue to be idle.
+	static void HostReadbackBarrier(VkCommandBuffer commandBuffer)
+	{
+		VkMemoryBarrier2 barrier = {
+			.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+			.srcStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+			.srcAccessMask = VK_ACCESS_2_MEMORY_WRITE_BIT,
+			.dstStageMask = VK_PIPELINE_STAGE_2_HOST_BIT,
+			.dstAccessMask = VK_ACCESS_2_HOST_READ_BIT,
+		};
+
+		VkDependencyInfo info = {
+			.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+			.memoryBarrierCount = 1,
+			.pMemoryBarriers = &barrier,
+		};
+
+		s_Data.Stats.Barriers++;
+
+		vkCmdPipelineBarrier2(commandBuffer, &info);
+	}
+
+	struct AliasingSlot
+	{
+		std::vector<uint32_t> Resources;
+		VkMemoryRequirements Requirements;
+	};
+
+	// Packs transient render graph resources whose lifetimes within the frame do not overlap into
+	// shared allocations, the graph then makes each of them wait on the previous occupant.
+	static void AliasTransientResources()
+	{
+		HG_PROFILE_FUNCTION();
+
+		const auto& resources = s_Data.Graph.GetTransientResources();
+
+		std::vector<uint32_t> candidates;
+		std::vector<VkMemoryRequirements> requirements(resources.size());
+		for (uint32_t i = 0; i < resources.size(); ++i)
+		{
+			const auto& resource = resources[i];
+			if (resource.Buffer && resource.Buffer->IsHostVisible()) continue;
+
+			requirements[i] = resource.Image ? resource.Image->GetMemoryRequirements() : resource.Buffer->GetMemoryRequirements();
+			candidates.push_back(i);
+		}
+
+		std::sort(candidates.begin(), candidates.end(), [&](uint32_t a, uint32_t b) {
+			return requirements[a].size > requirements[b].size;
+		});
+
+		std::vector<AliasingSlot> slots;
+		for (uint32_t index : candidates)
+		{
+			const auto& resource = resources[index];
+			const auto& requirement = requirements[index];
+
+			auto slot = std::find_if(slots.begin(), slots.end(), [&](const AliasingSlot& slot) {
+				if (!(slot.Requirements.memoryTypeBits & requirement.memoryTypeBits)) return false;
+
+				return std::none_of(slot.Resources.begin(), slot.Resources.end(), [&](uint32_t other) {
+					return resources[other].FirstStage <= resource.LastStage && resource.FirstStage <= resources[other].LastStage;
+				});
+			});
+
+			if (slot == slots.end())
+			{
+				slots.push_back({ { index }, requirement });
+				continue;
+			}
+
+			slot->Resources.push_back(index);
+			slot->Requirements.size = std::max(slot->Requirements.size, requirement.size);
+			slot->Requirements.alignment = std::max(slot->Requirements.alignment, requirement.alignment);
+			slot->Requirements.memoryTypeBits &= requirement.memoryTypeBits;
+		}
+
+		VkDeviceSize sizeBefore = 0;
+		VkDeviceSize sizeAfter = 0;
+		for (auto& slot : slots)
+		{
+			for (uint32_t index : slot.Resources) sizeBefore += requirements[index].size;
+			sizeAfter += slot.Requirements.size;
+
+			if (slot.Resources.size() < 2) continue;
+
+			VmaAllocationCreateInfo allocationCreateInfo = {
+				.usage = VMA_MEMORY_USAGE_GPU_ONLY,
+				.requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			};
+
+			VmaAllocation allocation;
+			CheckVkResult(vmaAllocateMemory(GraphicsContext::GetAllocator(), &slot.Requirements, &allocationCreateInfo, &allocation, nullptr));
+			s_Data.TransientAllocations.push_back(allocation);
+
+			std::vector<TransientResource> group;
+			for (uint32_t index : slot.Resources)
+			{
+				const auto& resource = resources[index];
+				if (resource.Image)
+					resource.Image->Alias(allocation);
+				else
+					resource.Buffer->Alias(allocation);
+
+				group.push_back(resource);
+			}
+
+			s_Data.Graph.AddAliasingGroup(group);
+		}
+
+		HG_CORE_INFO("Aliased {0} transient resources into {1} allocations, {2:.2f}MB -> {3:.2f}MB ({4:.2f}MB saved)",
+			resources.size(), s_Data.TransientAllocations.size(),
+			sizeBefore / (1024.0 * 1024.0), sizeAfter / (1024.0 * 1024.0), (sizeBefore - sizeAfter) / (1024.0 * 1024.0));
+	}
+
 	void Renderer::Initialize(RenderGraph renderGraph)
 	{
 		s_Data.MaxFrameCount = *CVarSystem::Get()->GetIntCVar("renderer.frameCount");
 
+		// The graph references its meshes and textures from the first frame on, so their uploads can not be waited out
+		UploadContext::AcquireAll();
+
 		s_Data.Graph = renderGraph;
 
 		s_Data.DescriptorLayoutCache.Init(GraphicsContext::GetDevice());
+		s_Data.DescriptorSetCache.Init(GraphicsContext::GetDevice());
+		s_Data.FrameAllocator.Init(*CVarSystem::Get()->GetIntCVar("renderer.frameAllocatorSize"), s_Data.MaxFrameCount);
+
+		s_Data.AsyncCompute = *CVarSystem::Get()->GetIntCVar("renderer.asyncCompute") && GraphicsContext::GetComputeQueue() != VK_NULL_HANDLE;
+		s_Data.Graph.SetAsyncCompute(s_Data.AsyncCompute);
+		// Subpasses only exist within render pass objects
+		s_Data.DynamicRendering = *CVarSystem::Get()->GetIntCVar("renderer.dynamicRendering");
+		s_Data.Graph.SetSubpassMerging(*CVarSystem::Get()->GetIntCVar("renderer.mergeSubpasses") && !s_Data.DynamicRendering);
+		s_Data.GraphicsTimeline = GraphicsContext::CreateTimelineSemaphore();
+		s_Data.ComputeTimeline = GraphicsContext::CreateTimelineSemaphore();
+		s_Data.GPUTimestamps = *CVarSystem::Get()->GetIntCVar("renderer.gpuTimestamps") && SupportsTimestamps(GraphicsContext::GetQueueFamily());
+		s_Data.ComputeTimestamps = s_Data.GPUTimestamps && s_Data.AsyncCompute && SupportsTimestamps(GraphicsContext::GetComputeQueueFamily());
+		s_Data.TimestampPeriod = GraphicsContext::GetGPUInfo()->DeviceProperties2.properties.limits.timestampPeriod;
+		s_Data.PipelineStatistics = *CVarSystem::Get()->GetIntCVar("renderer.pipelineStatistics");
+		if (s_Data.PipelineStatistics && !GraphicsContext::SupportsPipelineStatistics())
+		{
+			HG_CORE_WARN("Device does not support pipeline statistics and inherited queries, disabling renderer.pipelineStatistics");
+			s_Data.PipelineStatistics = false;
+		}
 
-		auto stages = s_Data.Graph.GetStages();
+		// Every stage of the plan gets initialized, including the ones that are culled right now,
+		// so enabling them later only changes which stages get executed.
+		const auto& stages = s_Data.Graph.Compile();
 		s_Data.Stages.resize(stages.size());
 
 		VkRenderPass blitRenderPass = VK_NULL_HANDLE;
 
+		// Resources have to be placed in their final memory before any descriptors reference them
+		if (*CVarSystem::Get()->GetIntCVar("renderer.aliasTransientResources"))
+		{
+			AliasTransientResources();
+		}
+
+		const auto& barriers = s_Data.Graph.GetStageBarriers();
+		const auto& subpasses = s_Data.Graph.GetStageSubpasses();
 		for (int i = 0; i < s_Data.Stages.size(); ++i)
 		{
-			auto& stage = s_Data.Stages[i];
-			stage.Info = stages[i]->StageInfo;
+			s_Data.Stages[i].Info = stages[i]->StageInfo;
+			s_Data.Stages[i].Barriers = barriers[i];
+			s_Data.Stages[i].Subpass = subpasses[i];
+		}
+
+		// Stages check for the culling pipeline when they get initialized
+		if (*CVarSystem::Get()->GetIntCVar("renderer.gpuCulling"))
+		{
+			CreateCullingPipeline();
+		}
 
+		for (auto& stage : s_Data.Stages)
+		{
 			stage.Init();
 
 			switch (stage.Info.StageType)
@@ -81,19 +527,51 @@ namespace Hog
 			}
 		}
 
+		s_Data.RecordingPool = CreateScope<ThreadPool>(GetRecordingThreadCount());
+
+		s_Data.Stats = {};
+		s_Data.StatsHistory.clear();
+		for (const auto& [name, getter] : s_HistoryStats)
+		{
+			s_Data.StatsHistory.push_back({ name });
+		}
+
+		for (const auto& stage : s_Data.Stages)
+		{
+			s_Data.Stats.Stages.push_back({ stage.Info.Name });
+			s_Data.StatsHistory.push_back({ stage.Info.Name });
+			s_Data.StatsHistory.push_back({ stage.Info.Name + " GPU" });
+		}
+
+		if (s_Data.GPUTimestamps)
+		{
+			CalibrateTimestamps();
+		}
+
 		s_Data.Frames.resize(s_Data.MaxFrameCount);
-		if (s_Data.Present)
+		for (auto& frame : s_Data.Frames)
 		{
-			for (int i = 0; i < s_Data.Frames.size(); ++i)
-			{
-				s_Data.Frames[i].Init(GraphicsContext::GetSwapchainImages()[i], blitRenderPass);
-			}
+			frame.Init();
 		}
-		else
+
+		if (s_Data.Present)
 		{
-			for (int i = 0; i < s_Data.Frames.size(); ++i)
+			for (const auto& image : GraphicsContext::GetSwapchainImages())
 			{
-				s_Data.Frames[i].Init();
+				SwapchainTarget target = {
+					.SwapchainImage = image,
+					.RenderSemaphore = GraphicsContext::CreateVkSemaphore(),
+				};
+
+				// With dynamic rendering the blit stage renders to the swapchain image view directly
+				if (blitRenderPass != VK_NULL_HANDLE)
+				{
+					std::vector<Ref<Image>> attachments(1);
+					attachments[0] = image;
+					target.FrameBuffer = FrameBuffer::Create(attachments, blitRenderPass);
+				}
+
+				s_Data.SwapchainTargets.push_back(target);
 			}
 		}
 	}
@@ -102,28 +580,159 @@ namespace Hog
 	{
 		HG_PROFILE_FUNCTION();
 
+		UpdateRecordingThreads();
+
 		auto& currentFrame = s_Data.Frames[s_Data.FrameIndex];
 
+		// Everything but the frame count and the stage names is counted anew every frame
+		s_Data.Stats = {
+			.FrameCount = s_Data.Stats.FrameCount,
+			.Stages = std::move(s_Data.Stats.Stages),
+		};
+
+		for (auto& stage : s_Data.Stats.Stages)
+		{
+			stage.RecordingTime = 0.0f;
+			stage.GPUTime = 0.0f;
+			stage.Statistics = {};
+		}
+
+		Timer waitTimer;
 		currentFrame.BeginFrame();
+		s_Data.Stats.FrameWaitTime = waitTimer.ElapsedMillis();
 
-		for (auto& stage : s_Data.Stages)
+		BindlessHeap::AdvanceFrame(s_Data.MaxFrameCount);
+		GeometryBuffer::AdvanceFrame(s_Data.MaxFrameCount);
+		s_Data.FrameAllocator.BeginFrame(s_Data.FrameIndex);
+
+		if (s_Data.Graph.UpdateEnabledStages())
+		{
+			const auto& barriers = s_Data.Graph.GetStageBarriers();
+			for (int i = 0; i < s_Data.Stages.size(); ++i)
+			{
+				s_Data.Stages[i].Barriers = barriers[i];
+			}
+		}
+
+		const auto& schedules = s_Data.Graph.GetStageSchedules();
+		const auto& activeStages = s_Data.Graph.GetActiveStages();
+
+		Timer recordingTimer;
+
+		// Barriers and descriptor sets depend on the state left behind by the previous stages, so they are
+		// resolved here in the order the stages get executed. The workers start recording as soon as a stage is ready.
+		for (auto queue : { RenderQueue::AsyncCompute, RenderQueue::Graphics })
+		{
+			auto& commandPools = queue == RenderQueue::AsyncCompute ? currentFrame.ComputeThreadCommandPools : currentFrame.ThreadCommandPools;
+
+			for (uint32_t index : activeStages)
+			{
+				if (schedules[index].Queue != queue) continue;
+
+				s_Data.Stages[index].Prepare();
+				s_Data.Stages[index].Record(*s_Data.RecordingPool, commandPools);
+			}
+		}
+
+		s_Data.RecordingPool->Wait();
+
+		// Every stage was prepared, so the frame's data is complete. Host writes become visible with the submit.
+		s_Data.FrameAllocator.Flush();
+
+		s_Data.Stats.RecordingTime = recordingTimer.ElapsedMillis();
+
+		for (uint32_t index : activeStages)
 		{
-			stage.Execute(currentFrame.CommandBuffer);
+			s_Data.Stats.Stages[index].RecordingTime = s_Data.Stages[index].CollectStats(s_Data.Stats);
+		}
+
+		// Async compute stages never depend on the frame's graphics work, so they can all be submitted up front.
+		// Frames without any leave the compute queue alone.
+		const bool asyncCompute = std::any_of(activeStages.begin(), activeStages.end(), [&](uint32_t index) {
+			return schedules[index].Queue == RenderQueue::AsyncCompute;
+		});
+
+		if (asyncCompute)
+		{
+			currentFrame.BeginAsyncCompute();
+
+			for (uint32_t index : activeStages)
+			{
+				if (schedules[index].Queue == RenderQueue::AsyncCompute)
+				{
+					uint32_t queries = currentFrame.BeginStageQueries(currentFrame.ComputeCommandBuffer, index, RenderQueue::AsyncCompute);
+					s_Data.Stages[index].Execute(currentFrame.ComputeCommandBuffer);
+					currentFrame.EndStageQueries(currentFrame.ComputeCommandBuffer, queries);
+				}
+			}
+
+			currentFrame.SubmitAsyncCompute();
+		}
+
+		for (uint32_t index : activeStages)
+		{
+			if (schedules[index].Queue != RenderQueue::Graphics) continue;
+
+			// Stages running as subpasses are executed by the stage that owns their render pass
+			const auto& subpass = s_Data.Stages[index].Subpass;
+			if (subpass.Subpass > 0) continue;
+
+			bool waitsForAsyncCompute = false;
+			for (uint32_t i = index; i < index + subpass.SubpassCount; ++i)
+			{
+				waitsForAsyncCompute |= schedules[i].WaitsForAsyncCompute;
+			}
+
+			if (asyncCompute && waitsForAsyncCompute)
+			{
+				currentFrame.WaitForAsyncCompute();
+			}
+
+			uint32_t queries = currentFrame.BeginStageQueries(currentFrame.CommandBuffer, index, RenderQueue::Graphics);
+			s_Data.Stages[index].Execute(currentFrame.CommandBuffer);
+			currentFrame.EndStageQueries(currentFrame.CommandBuffer, queries);
 		}
 
 		currentFrame.EndFrame();
 
+		s_Data.Stats.DescriptorSetWrites = s_Data.DescriptorSetCache.ResetWriteCount();
+		s_Data.Stats.BindlessWrites = BindlessHeap::ResetWriteCount();
+		s_Data.Stats.BytesUploaded += Buffer::ResetUploadedBytes();
+		s_Data.Stats.ImmediateSubmits = GraphicsContext::ResetImmediateSubmitCount();
+		s_Data.Stats.UploadSubmits = UploadContext::ResetSubmitCount();
+		s_Data.Stats.FrameCount++;
+
+		UpdateStatsHistory();
+
 		s_Data.FrameIndex = (s_Data.FrameIndex + 1) % s_Data.MaxFrameCount;
 	}
 
 	void Renderer::Cleanup()
 	{
+		s_Data.RecordingPool.reset();
 		std::for_each(s_Data.Frames.begin(), s_Data.Frames.end(), [](RendererFrame& elem) {elem.Cleanup(); });
 		s_Data.Frames.clear();
+		for (const auto& target : s_Data.SwapchainTargets)
+		{
+			vkDestroySemaphore(GraphicsContext::GetDevice(), target.RenderSemaphore, nullptr);
+		}
+		s_Data.SwapchainTargets.clear();
+		vkDestroySemaphore(GraphicsContext::GetDevice(), s_Data.GraphicsTimeline, nullptr);
+		vkDestroySemaphore(GraphicsContext::GetDevice(), s_Data.ComputeTimeline, nullptr);
 		std::for_each(s_Data.Stages.begin(), s_Data.Stages.end(), [](RendererStage& elem) {elem.Cleanup(); });
 		s_Data.Stages.clear();
+		s_Data.CullingPipeline.reset();
+		s_Data.DescriptorSetCache.Cleanup();
+		s_Data.FrameAllocator.Cleanup();
 		s_Data.DescriptorLayoutCache.Cleanup();
 		s_Data.Graph.Cleanup();
+
+		for (auto allocation : s_Data.TransientAllocations)
+		{
+			vmaFreeMemory(GraphicsContext::GetAllocator(), allocation);
+		}
+		s_Data.TransientAllocations.clear();
+		s_Data.ReleasedResources.clear();
 		
 		Application::Get().PopOverlay(s_Data.ImGuiLayer);
 		s_Data.ImGuiLayer.reset();
@@ -134,83 +743,259 @@ namespace Hog
 		return &(s_Data.DescriptorLayoutCache);
 	}
 
-	Renderer::RendererStats Renderer::GetStats()
+	const Renderer::RendererStats& Renderer::GetStats()
 	{
-		return RendererStats();
+		return s_Data.Stats;
 	}
 
-	void RendererFrame::Init()
+	const std::vector<Renderer::NamedStatistic>& Renderer::GetStatsHistory()
 	{
-		Device = GraphicsContext::GetDevice();
-		Queue = GraphicsContext::GetQueue();
-		Swapchain = GraphicsContext::GetSwapchain();
-		CommandPool = GraphicsContext::CreateCommandPool();
-		CommandBuffer = GraphicsContext::CreateCommandBuffer(CommandPool);
-		Fence = GraphicsContext::CreateFence(true);
-		PresentSemaphore = GraphicsContext::CreateVkSemaphore();
-		RenderSemaphore = GraphicsContext::CreateVkSemaphore();
-		DescriptorAllocator.Init(Device);
+		return s_Data.StatsHistory;
 	}
 
-	void RendererFrame::Init(Ref<Image> swapchainImage, VkRenderPass renderPass)
+	RollingStatistic::Summary Renderer::GetStatSummary(const std::string& name)
 	{
-		Device = GraphicsContext::GetDevice();
-		Queue = GraphicsContext::GetQueue();
-		Swapchain = GraphicsContext::GetSwapchain();
-		CommandPool = GraphicsContext::CreateCommandPool();
-		CommandBuffer = GraphicsContext::CreateCommandBuffer(CommandPool);
-		Fence = GraphicsContext::CreateFence(true);
-		PresentSemaphore = GraphicsContext::CreateVkSemaphore();
-		RenderSemaphore = GraphicsContext::CreateVkSemaphore();
-		DescriptorAllocator.Init(Device);
-		SwapchainImage = swapchainImage;
-		std::vector<Ref<Image>> attachments(1);
-		attachments[0] = SwapchainImage;
-		FrameBuffer = FrameBuffer::Create(attachments, renderPass);
+		for (const auto& [statName, statistic] : s_Data.StatsHistory)
+		{
+			if (statName == name)
+			{
+				return statistic.Summarize();
+			}
+		}
+
+		return {};
 	}
 
-	void RendererFrame::BeginFrame()
+	void Renderer::DrawStatsOverlay()
 	{
-		CheckVkResult(vkWaitForFences(Device, 1, &Fence, VK_TRUE, UINT64_MAX));
-		vkResetFences(Device, 1, &Fence);
+		if (!*CVarSystem::Get()->GetIntCVar("renderer.statsOverlay") || s_Data.StatsHistory.empty()) return;
 
-		DescriptorAllocator.ResetPools();
+		const size_t stageRow = std::size(s_HistoryStats);
 
-		vkAcquireNextImageKHR(Device, Swapchain, UINT64_MAX, PresentSemaphore, VK_NULL_HANDLE, &s_Data.FrameIndex);
+		ImGui::SetNextWindowBgAlpha(0.75f);
+		if (ImGui::Begin("Renderer Stats", nullptr, ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoFocusOnAppearing))
+		{
+			ImGui::Text("Frame %llu, last %zu frames", static_cast<unsigned long long>(s_Data.Stats.FrameCount), s_Data.StatsHistory.front().Statistic.GetSampleCount());
 
-		// begin command buffer
-		VkCommandBufferBeginInfo beginInfo{};
-		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+			if (ImGui::BeginTable("RendererStats", 6, ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingFixedFit))
+			{
+				for (const char* column : { "", "Last", "Min", "Avg", "Max", "P99" })
+				{
+					ImGui::TableSetupColumn(column);
+				}
+				ImGui::TableHeadersRow();
 
-		CheckVkResult(vkBeginCommandBuffer(CommandBuffer, &beginInfo));
-		HG_PROFILE_GPU_CONTEXT(currentFrame.CommandBuffer);
-		HG_PROFILE_GPU_EVENT("Begin CommandBuffer");
+				for (size_t i = 0; i < s_Data.StatsHistory.size(); i++)
+				{
+					const auto& [name, statistic] = s_Data.StatsHistory[i];
+					RollingStatistic::Summary summary = statistic.Summarize();
+
+					ImGui::TableNextRow();
+					ImGui::TableNextColumn();
+					// Stage rows hold the CPU and GPU times of the stage in milliseconds
+					if (i >= stageRow)
+						ImGui::Text("  %s (ms)", name.c_str());
+					else
+						ImGui::TextUnformatted(name.c_str());
+
+					for (float value : { summary.Last, summary.Min, summary.Average, summary.Max, summary.P99 })
+					{
+						ImGui::TableNextColumn();
+						ImGui::Text("%.2f", value);
+					}
+				}
 
-		if (SwapchainImage)
-		{
-			SwapchainImage->ExecuteBarrier(CommandBuffer, {ImageLayout::Undefined, ImageLayout::ColorAttachmentOptimal});
-		}
+				ImGui::EndTable();
+			}
+
+			// Statistics of the last frame that read them back, stages that did not run are left out
+			if (s_Data.PipelineStatistics && ImGui::BeginTable("PipelineStatistics", 8, ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingFixedFit))
+			{
+				for (const char* column : { "Stage", "IA verts", "IA prims", "VS", "Clip in", "Clip out", "FS", "CS" })
+				{
+					ImGui::TableSetupColumn(column);
+				}
+				ImGui::TableHeadersRow();
+
+				for (const auto& stage : s_Data.Stats.Stages)
+				{
+					const auto& statistics = stage.Statistics;
+					const uint64_t values[] = {
+						statistics.InputAssemblyVertices, statistics.InputAssemblyPrimitives, statistics.VertexShaderInvocations,
+						statistics.ClippingInvocations, statistics.ClippingPrimitives, statistics.FragmentShaderInvocations,
+						statistics.ComputeShaderInvocations,
+					};
+
+					if (std::all_of(std::begin(values), std::end(values), [](uint64_t value) { return value == 0; })) continue;
+
+					ImGui::TableNextRow();
+					ImGui::TableNextColumn();
+					ImGui::TextUnformatted(stage.Name.c_str());
+
+					for (uint64_t value : values)
+					{
+						ImGui::TableNextColumn();
+						ImGui::Text("%llu", static_cast<unsigned long long>(value));
+					}
+				}
+
+				ImGui::EndTable();
+			}
+		}
+		ImGui::End();
 	}
 
-	void RendererFrame::EndFrame()
+	void RendererFrame::Init()
 	{
-		// end command buffer
-		CheckVkResult(vkEndCommandBuffer(CommandBuffer));
+		Device = GraphicsContext::GetDevice();
+		Queue = GraphicsContext::GetQueue();
+		Swapchain = GraphicsContext::GetSwapchain();
+		CommandPool = GraphicsContext::CreateCommandPool();
+		CommandBuffer = GraphicsContext::CreateCommandBuffer(CommandPool);
+		LateCommandBuffer = GraphicsContext::CreateCommandBuffer(CommandPool);
+		PresentSemaphore = GraphicsContext::CreateVkSemaphore();
+
+		if (s_Data.AsyncCompute)
+		{
+			ComputeQueue = GraphicsContext::GetComputeQueue();
+			ComputeCommandPool = GraphicsContext::CreateCommandPool(GraphicsContext::GetComputeQueueFamily());
+			ComputeCommandBuffer = GraphicsContext::CreateCommandBuffer(ComputeCommandPool);
+		}
+
+		InitThreadCommandPools(s_Data.RecordingPool->GetThreadCount());
+
+		// Every stage is executed at most once per frame
+		const uint32_t stageCount = static_cast<uint32_t>(s_Data.Stages.size());
+		if (s_Data.GPUTimestamps)
+		{
+			TimestampPool = GraphicsContext::CreateQueryPool(VK_QUERY_TYPE_TIMESTAMP, stageCount * 2);
+		}
+
+		// Graphics statistics can only be collected on a queue that supports graphics
+		if (s_Data.PipelineStatistics)
+		{
+			StatisticsPool = GraphicsContext::CreateQueryPool(VK_QUERY_TYPE_PIPELINE_STATISTICS, stageCount, GraphicsStatistics);
+
+			if (ComputeCommandPool)
+				ComputeStatisticsPool = GraphicsContext::CreateQueryPool(VK_QUERY_TYPE_PIPELINE_STATISTICS, stageCount, VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT);
+		}
+	}
+
+	void RendererFrame::InitThreadCommandPools(uint32_t threadCount)
+	{
+		CleanupThreadCommandPools();
+
+		ThreadCommandPools.resize(threadCount);
+		for (auto& commandPool : ThreadCommandPools)
+		{
+			commandPool.Init(GraphicsContext::GetQueueFamily());
+		}
+
+		if (ComputeCommandPool)
+		{
+			ComputeThreadCommandPools.resize(threadCount);
+			for (auto& commandPool : ComputeThreadCommandPools)
+			{
+				commandPool.Init(GraphicsContext::GetComputeQueueFamily());
+			}
+		}
+	}
+
+	void RendererFrame::CleanupThreadCommandPools()
+	{
+		std::for_each(ThreadCommandPools.begin(), ThreadCommandPools.end(), [](ThreadCommandPool& elem) {elem.Cleanup(); });
+		std::for_each(ComputeThreadCommandPools.begin(), ComputeThreadCommandPools.end(), [](ThreadCommandPool& elem) {elem.Cleanup(); });
+		ThreadCommandPools.clear();
+		ComputeThreadCommandPools.clear();
+	}
+
+	void RendererFrame::BeginFrame()
+	{
+		// The frame's last submissions signaled the timelines to its serial. The graphics work does not always
+		// wait for the async compute work, so the compute timeline is waited for as well if the frame submitted any.
+		const VkSemaphore timelines[] = { s_Data.GraphicsTimeline, s_Data.ComputeTimeline };
+		const uint64_t values[] = { Serial, Serial };
+		const VkSemaphoreWaitInfo waitInfo = {
+			.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+			.semaphoreCount = m_SubmittedAsyncCompute ? 2u : 1u,
+			.pSemaphores = timelines,
+			.pValues = values,
+		};
+
+		CheckVkResult(vkWaitSemaphores(Device, &waitInfo, UINT64_MAX));
+		m_SubmittedAsyncCompute = false;
+
+		ReadQueries();
+
+		Serial = ++s_Data.FrameSerial;
+
+		std::for_each(ThreadCommandPools.begin(), ThreadCommandPools.end(), [](ThreadCommandPool& elem) {elem.Reset(); });
+		std::for_each(ComputeThreadCommandPools.begin(), ComputeThreadCommandPools.end(), [](ThreadCommandPool& elem) {elem.Reset(); });
+
+		// The image index only selects the swapchain image, the frame keeps its own slot
+		if (s_Data.Present)
+		{
+			vkAcquireNextImageKHR(Device, Swapchain, UINT64_MAX, PresentSemaphore, VK_NULL_HANDLE, &ImageIndex);
+
+			const auto& target = s_Data.SwapchainTargets[ImageIndex];
+			SwapchainImage = target.SwapchainImage;
+			FrameBuffer = target.FrameBuffer;
+			RenderSemaphore = target.RenderSemaphore;
+		}
+
+		// begin command buffer
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+
+		CheckVkResult(vkBeginCommandBuffer(CommandBuffer, &beginInfo));
+		HG_PROFILE_GPU_CONTEXT(currentFrame.CommandBuffer);
+		HG_PROFILE_GPU_EVENT("Begin CommandBuffer");
+
+		// Resources uploaded on the transfer queue become usable by the graphics queue from this frame on
+		UploadContext::RecordAcquires(CommandBuffer);
+
+		if (SwapchainImage)
+		{
+			SwapchainImage->ExecuteBarrier(CommandBuffer, {
+				PipelineStage::ColorAttachmentOutput, AccessFlag::None,
+				PipelineStage::ColorAttachmentOutput, AccessFlag::ColorAttachmentWrite,
+				ImageLayout::Undefined, ImageLayout::ColorAttachmentOptimal,
+			});
+		}
+	}
+
+	void RendererFrame::BeginAsyncCompute()
+	{
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+
+		CheckVkResult(vkBeginCommandBuffer(ComputeCommandBuffer, &beginInfo));
+	}
+
+	void RendererFrame::SubmitAsyncCompute()
+	{
+		HostReadbackBarrier(ComputeCommandBuffer);
+
+		CheckVkResult(vkEndCommandBuffer(ComputeCommandBuffer));
 
-		// Submit
 		const VkCommandBufferSubmitInfo commandBufferSubmitInfo = {
 			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO,
-			.commandBuffer = CommandBuffer,
+			.commandBuffer = ComputeCommandBuffer,
 		};
 
+		// Resources the previous frame's graphics work hands over are released at the end of it
 		const VkSemaphoreSubmitInfo waitSemaphoreInfo = {
 			.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO,
-			.semaphore = PresentSemaphore,
+			.semaphore = s_Data.GraphicsTimeline,
+			.value = Serial - 1,
+			.stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
 		};
 
 		const VkSemaphoreSubmitInfo signalSemaphoreInfo = {
 			.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO,
-			.semaphore = RenderSemaphore,
+			.semaphore = s_Data.ComputeTimeline,
+			.value = Serial,
+			.stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
 		};
 
 		const VkSubmitInfo2 submitInfo = {
@@ -223,7 +1008,114 @@ namespace Hog
 			.pSignalSemaphoreInfos = &signalSemaphoreInfo,
 		};
 
-		CheckVkResult(vkQueueSubmit2(Queue, 1, &submitInfo, Fence));
+		CheckVkResult(vkQueueSubmit2(ComputeQueue, 1, &submitInfo, VK_NULL_HANDLE));
+		m_SubmittedAsyncCompute = true;
+	}
+
+	void RendererFrame::WaitForAsyncCompute()
+	{
+		if (m_WaitsForAsyncCompute) return;
+
+		CheckVkResult(vkEndCommandBuffer(CommandBuffer));
+
+		const VkCommandBufferSubmitInfo commandBufferSubmitInfo = {
+			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO,
+			.commandBuffer = CommandBuffer,
+		};
+
+		const VkSemaphoreSubmitInfo waitSemaphoreInfo = {
+			.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO,
+			.semaphore = PresentSemaphore,
+			.stageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+		};
+
+		// Frames that do not present never acquire an image to wait for
+		const VkSubmitInfo2 submitInfo = {
+			.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2,
+			.waitSemaphoreInfoCount = s_Data.Present ? 1u : 0u,
+			.pWaitSemaphoreInfos = &waitSemaphoreInfo,
+			.commandBufferInfoCount = 1,
+			.pCommandBufferInfos = &commandBufferSubmitInfo,
+		};
+
+		CheckVkResult(vkQueueSubmit2(Queue, 1, &submitInfo, VK_NULL_HANDLE));
+
+		std::swap(CommandBuffer, LateCommandBuffer);
+		m_WaitsForAsyncCompute = true;
+
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+
+		CheckVkResult(vkBeginCommandBuffer(CommandBuffer, &beginInfo));
+	}
+
+	void RendererFrame::EndFrame()
+	{
+		if (SwapchainImage)
+		{
+			SwapchainImage->ExecuteBarrier(CommandBuffer, {
+				PipelineStage::ColorAttachmentOutput, AccessFlag::ColorAttachmentWrite,
+				PipelineStage::None, AccessFlag::None,
+				ImageLayout::ColorAttachmentOptimal, ImageLayout::PresentSrcKHR,
+			});
+		}
+
+		HostReadbackBarrier(CommandBuffer);
+
+		// end command buffer
+		CheckVkResult(vkEndCommandBuffer(CommandBuffer));
+
+		// Submit
+		const VkCommandBufferSubmitInfo commandBufferSubmitInfo = {
+			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO,
+			.commandBuffer = CommandBuffer,
+		};
+
+		// The swapchain wait was already consumed by the first submission when the frame waits for async compute
+		const VkSemaphoreSubmitInfo waitSemaphoreInfo = m_WaitsForAsyncCompute ?
+			VkSemaphoreSubmitInfo{
+				.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO,
+				.semaphore = s_Data.ComputeTimeline,
+				.value = Serial,
+				.stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+			} :
+			VkSemaphoreSubmitInfo{
+				.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO,
+				.semaphore = PresentSemaphore,
+				.stageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+			};
+
+		// The graphics timeline tells the frame when it can be reused, the render semaphore is only waited for by the present
+		const VkSemaphoreSubmitInfo signalSemaphoreInfos[] = {
+			{
+				.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO,
+				.semaphore = s_Data.GraphicsTimeline,
+				.value = Serial,
+				.stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+			},
+			{
+				.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO,
+				.semaphore = RenderSemaphore,
+			},
+		};
+
+		const VkSubmitInfo2 submitInfo = {
+			.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2,
+			.waitSemaphoreInfoCount = m_WaitsForAsyncCompute || s_Data.Present ? 1u : 0u,
+			.pWaitSemaphoreInfos = &waitSemaphoreInfo,
+			.commandBufferInfoCount = 1,
+			.pCommandBufferInfos = &commandBufferSubmitInfo,
+			.signalSemaphoreInfoCount = s_Data.Present ? 2u : 1u,
+			.pSignalSemaphoreInfos = signalSemaphoreInfos,
+		};
+
+		CheckVkResult(vkQueueSubmit2(Queue, 1, &submitInfo, VK_NULL_HANDLE));
+
+		if (m_WaitsForAsyncCompute)
+		{
+			std::swap(CommandBuffer, LateCommandBuffer);
+			m_WaitsForAsyncCompute = false;
+		}
 
 		// Present
 		if (s_Data.Present)
@@ -238,7 +1130,7 @@ namespace Hog
 			presentInfo.swapchainCount = 1;
 			presentInfo.pSwapchains = swapChains;
 
-			presentInfo.pImageIndices = &s_Data.FrameIndex;
+			presentInfo.pImageIndices = &ImageIndex;
 
 			HG_PROFILE_GPU_FLIP(Swapchain);
 
@@ -246,64 +1138,331 @@ namespace Hog
 		}
 	}
 
+	uint32_t RendererFrame::BeginStageQueries(VkCommandBuffer commandBuffer, uint32_t stage, RenderQueue queue)
+	{
+		VkQueryPool statisticsPool = queue == RenderQueue::AsyncCompute ? ComputeStatisticsPool : StatisticsPool;
+		const StageQueries queries = {
+			.Stage = stage,
+			.Queue = queue,
+			.Timestamps = TimestampPool != VK_NULL_HANDLE && (queue == RenderQueue::Graphics || s_Data.ComputeTimestamps),
+			.Statistics = statisticsPool != VK_NULL_HANDLE,
+		};
+
+		if (!queries.Timestamps && !queries.Statistics) return InvalidQueries;
+
+		uint32_t index = static_cast<uint32_t>(QueriedStages.size());
+		QueriedStages.push_back(queries);
+
+		if (queries.Timestamps)
+			vkCmdWriteTimestamp2(commandBuffer, VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT, TimestampPool, index * 2);
+
+		if (queries.Statistics)
+			vkCmdBeginQuery(commandBuffer, statisticsPool, index, 0);
+
+		return index;
+	}
+
+	void RendererFrame::EndStageQueries(VkCommandBuffer commandBuffer, uint32_t index)
+	{
+		if (index == InvalidQueries) return;
+
+		const auto& queries = QueriedStages[index];
+
+		if (queries.Statistics)
+			vkCmdEndQuery(commandBuffer, queries.Queue == RenderQueue::AsyncCompute ? ComputeStatisticsPool : StatisticsPool, index);
+
+		if (queries.Timestamps)
+			vkCmdWriteTimestamp2(commandBuffer, VK_PIPELINE_STAGE_2_BOTTOM_OF_PIPE_BIT, TimestampPool, index * 2 + 1);
+	}
+
+	void RendererFrame::ReadQueries()
+	{
+		if (QueriedStages.empty()) return;
+
+		const uint32_t count = static_cast<uint32_t>(QueriedStages.size());
+
+		// Every result is followed by its availability. The frame's work is done, so they are all available
+		// unless a submission failed, in which case the stage is left out rather than waited for. Queries of
+		// a pool that belong to stages of the other queue were never begun and stay unavailable.
+		const auto readResults = [&](VkQueryPool queryPool, uint32_t queryCount, uint32_t valueCount)
+		{
+			std::vector<uint64_t> results;
+			if (queryPool)
+			{
+				results.resize(queryCount * (valueCount + 1));
+				vkGetQueryPoolResults(Device, queryPool, 0, queryCount, results.size() * sizeof(uint64_t), results.data(),
+					(valueCount + 1) * sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+				vkResetQueryPool(Device, queryPool, 0, queryCount);
+			}
+
+			return results;
+		};
+
+		const auto timestamps = readResults(TimestampPool, count * 2, 1);
+		const auto statistics = readResults(StatisticsPool, count, GraphicsStatisticCount);
+		const auto computeStatistics = readResults(ComputeStatisticsPool, count, 1);
+
+		// Timestamps of the graphics and the compute queue are compared directly, both count the same device clock
+		uint64_t frameBegin = UINT64_MAX;
+		uint64_t frameEnd = 0;
+		for (uint32_t i = 0; i < count; i++)
+		{
+			const auto& queries = QueriedStages[i];
+			auto& stageStats = s_Data.Stats.Stages[queries.Stage];
+
+			if (queries.Statistics)
+			{
+				const uint64_t* results = queries.Queue == RenderQueue::AsyncCompute ?
+					&computeStatistics[i * 2] : &statistics[i * (GraphicsStatisticCount + 1)];
+				stageStats.Statistics = ToPipelineStatistics(results, queries.Queue);
+			}
+
+			if (!queries.Timestamps) continue;
+
+			const uint64_t begin = timestamps[i * 4];
+			const uint64_t end = timestamps[i * 4 + 2];
+			if (!timestamps[i * 4 + 1] || !timestamps[i * 4 + 3] || end < begin) continue;
+
+			frameBegin = std::min(frameBegin, begin);
+			frameEnd = std::max(frameEnd, end);
+
+			const double duration = (end - begin) * s_Data.TimestampPeriod;
+			stageStats.GPUTime += static_cast<float>(duration / 1000000.0);
+
+			HG_PROFILE_GPU_RESULT({
+				.Name = s_Data.Stages[queries.Stage].Info.Name,
+				.Start = FloatingPointMicroseconds(begin * s_Data.TimestampPeriod / 1000.0 + s_Data.TimestampOffset),
+				.ElapsedTime = FloatingPointMicroseconds(duration / 1000.0),
+				.Track = static_cast<uint32_t>(queries.Queue),
+				.TrackName = queries.Queue == RenderQueue::AsyncCompute ? "GPU Async Compute" : "GPU Graphics",
+				.Args = queries.Statistics ? ToTraceArgs(stageStats.Statistics) : GPUProfileResult::ArgList(),
+			});
+		}
+
+		if (frameEnd > frameBegin)
+		{
+			s_Data.Stats.GPUTime = static_cast<float>((frameEnd - frameBegin) * s_Data.TimestampPeriod / 1000000.0);
+		}
+
+		QueriedStages.clear();
+	}
+
 	void RendererFrame::Cleanup()
 	{
-		vkDestroyFence(Device, Fence, nullptr);
 		vkDestroyCommandPool(Device, CommandPool, nullptr);
+		if (ComputeCommandPool)
+			vkDestroyCommandPool(Device, ComputeCommandPool, nullptr);
+		CleanupThreadCommandPools();
 		vkDestroySemaphore(Device, PresentSemaphore, nullptr);
-		vkDestroySemaphore(Device, RenderSemaphore, nullptr);
-		DescriptorAllocator.Cleanup();
+		for (VkQueryPool queryPool : { TimestampPool, StatisticsPool, ComputeStatisticsPool })
+		{
+			if (queryPool)
+				vkDestroyQueryPool(Device, queryPool, nullptr);
+		}
+		QueriedStages.clear();
 		FrameBuffer.reset();
+		SwapchainImage.reset();
+	}
+
+	void ThreadCommandPool::Init(uint32_t queueFamily)
+	{
+		m_CommandPool = GraphicsContext::CreateCommandPool(queueFamily);
+	}
+
+	void ThreadCommandPool::Reset()
+	{
+		CheckVkResult(vkResetCommandPool(GraphicsContext::GetDevice(), m_CommandPool, 0));
+		m_UsedCount = 0;
+	}
+
+	VkCommandBuffer ThreadCommandPool::Allocate()
+	{
+		if (m_UsedCount == m_CommandBuffers.size())
+		{
+			m_CommandBuffers.push_back(GraphicsContext::CreateCommandBuffer(m_CommandPool, VK_COMMAND_BUFFER_LEVEL_SECONDARY));
+		}
+
+		return m_CommandBuffers[m_UsedCount++];
+	}
+
+	void ThreadCommandPool::Cleanup()
+	{
+		vkDestroyCommandPool(GraphicsContext::GetDevice(), m_CommandPool, nullptr);
+		m_CommandPool = VK_NULL_HANDLE;
+		m_CommandBuffers.clear();
+		m_UsedCount = 0;
 	}
 
 	void RendererStage::Init()
 	{
-		if (Info.StageType == RendererStageType::DeferredGraphics || Info.StageType == RendererStageType::ForwardGraphics
+		// The ImGui backend only knows how to draw within a render pass, so that stage always gets one
+		m_DynamicRendering = s_Data.DynamicRendering && (Info.StageType == RendererStageType::DeferredGraphics
+			|| Info.StageType == RendererStageType::ForwardGraphics || Info.StageType == RendererStageType::Blit
+			|| Info.StageType == RendererStageType::ScreenSpacePass);
+
+		if (Subpass.Subpass > 0)
+		{
+			// The stage runs as a subpass of the render pass owned by an earlier stage
+			const RendererStage& owner = GetSubpassStage(0);
+			RenderPass = owner.RenderPass;
+			FrameBuffer = owner.FrameBuffer;
+		}
+		else if (m_DynamicRendering)
+		{
+			HG_CORE_ASSERT(!Info.Resources.ContainsType(ResourceType::InputAttachment), "Input attachments need a render pass, disable renderer.dynamicRendering");
+			SetupDynamicRendering();
+		}
+		else if (Info.StageType == RendererStageType::DeferredGraphics || Info.StageType == RendererStageType::ForwardGraphics
 			|| Info.StageType == RendererStageType::ImGui || Info.StageType == RendererStageType::Blit
 			|| Info.StageType == RendererStageType::ScreenSpacePass)
 		{
-			std::vector<VkAttachmentDescription2> attachments(Info.Attachments.size());
-			std::unordered_map<AttachmentType, std::vector<VkAttachmentReference2>> attachmentRefs;
-			std::vector<VkSubpassDependency2> dependencies;
-			dependencies.reserve(Info.Attachments.size());
-			ClearValues.resize(Info.Attachments.size());
+			CreateRenderPass();
+		}
+
+		VkSpecializationInfo specializationInfo = {};
+		std::vector<VkSpecializationMapEntry> specializationMapEntries;
+		std::vector<uint8_t> buffer;
+
+		if (Info.Pipeline)
+		{
+			uint32_t offset = 0;
+			size_t size = 0;
 
-			for (int i = 0; i < attachments.size(); ++i)
+			for (const auto& resource : Info.Resources)
 			{
-				attachments[i] = {};
-				attachments[i].sType = VK_STRUCTURE_TYPE_ATTACHMENT_DESCRIPTION_2;
-				if (Info.Attachments[i].Type != AttachmentType::Swapchain)
+				if (resource.Type == ResourceType::Constant)
 				{
-					attachments[i].format = Info.Attachments[i].Image->GetFormat();
-					attachments[i].samples = Info.Attachments[i].Image->GetSamples();
+					specializationMapEntries.push_back({ resource.ConstantID, offset, resource.ConstantSize });
+					size += resource.ConstantSize;
+
+					buffer.resize(size);
+					std::memcpy(buffer.data() + offset, resource.ConstantDataPointer, resource.ConstantSize);
+
+					offset += (uint32_t)resource.ConstantSize;
 				}
-				else
+			}
+
+			// Vertex shaders of mesh stages learn the vertex format of the shared geometry buffer
+			if (!Info.Meshes.empty())
+			{
+				VkBool32 compactVertices = GeometryBuffer::UsesCompactVertices();
+				specializationMapEntries.push_back({ GeometryBuffer::CompactVerticesConstantID, offset, sizeof(compactVertices) });
+				size += sizeof(compactVertices);
+
+				buffer.resize(size);
+				std::memcpy(buffer.data() + offset, &compactVertices, sizeof(compactVertices));
+			}
+
+			Info.Pipeline->SetMeshVertexInput(!Info.Meshes.empty());
+
+			if (!specializationMapEntries.empty())
+			{
+				specializationInfo.mapEntryCount = (uint32_t)specializationMapEntries.size();
+				specializationInfo.pMapEntries = specializationMapEntries.data();
+				specializationInfo.dataSize = size;
+				specializationInfo.pData = buffer.data();
+			}
+
+			if (RenderPass != VK_NULL_HANDLE)
+			{
+				uint32_t colorCount = 0;
+				std::for_each(Info.Attachments.begin(), Info.Attachments.end(), [&colorCount](AttachmentElement& attachment) 
+					{ 
+						colorCount += (attachment.Type == AttachmentType::Color || attachment.Type == AttachmentType::Swapchain) ? 1 : 0;
+					});
+
+				Info.Pipeline->Generate(RenderPass, &specializationInfo, Subpass.Subpass);
+			}
+			else if (m_DynamicRendering)
+			{
+				Info.Pipeline->Generate(m_RenderingFormats, &specializationInfo);
+			}
+			else
+			{
+				Info.Pipeline->Generate(nullptr, &specializationInfo);
+			}
+		}
+
+		if (Info.Pipeline)
+		{
+			CreateDescriptorSetLayout();
+		}
+
+		if (!Info.Meshes.empty())
+		{
+			CreateInstanceBuffers();
+		}
+
+		m_GPUCulling = s_Data.CullingPipeline && UsesGPUCulling(Info);
+		if (m_GPUCulling)
+		{
+			CreateIndirectBuffers();
+		}
+
+		if (Info.StageType == RendererStageType::RayTracing)
+		{
+			Info.ShaderBindingTable = ShaderBindingTable::Create(Info.Pipeline->GetHandle());
+		}
+	}
+
+	void RendererStage::CreateRenderPass()
+	{
+		struct SubpassAttachments
+		{
+			std::vector<VkAttachmentReference2> Colors;
+			std::vector<VkAttachmentReference2> Inputs;
+			std::vector<uint32_t> Preserves;
+			VkAttachmentReference2 DepthStencil = {};
+			bool HasDepthStencil = false;
+
+			bool References(uint32_t attachment) const
+			{
+				auto matches = [attachment](const VkAttachmentReference2& ref) { return ref.attachment == attachment; };
+				return std::any_of(Colors.begin(), Colors.end(), matches) || std::any_of(Inputs.begin(), Inputs.end(), matches)
+					|| (HasDepthStencil && DepthStencil.attachment == attachment);
+			}
+		};
+
+		std::vector<VkAttachmentDescription2> attachments;
+		std::vector<Ref<Image>> images;
+		// First and last subpass that use each attachment
+		std::vector<std::pair<uint32_t, uint32_t>> references;
+		std::vector<SubpassAttachments> subpasses(Subpass.SubpassCount);
+		ClearValues.clear();
+
+		for (uint32_t subpass = 0; subpass < Subpass.SubpassCount; ++subpass)
+		{
+			const RendererStage& stage = GetSubpassStage(subpass);
+			auto& subpassAttachments = subpasses[subpass];
+
+			for (const auto& element : stage.Info.Attachments)
+			{
+				VkAttachmentDescription2 attachment = {};
+				attachment.sType = VK_STRUCTURE_TYPE_ATTACHMENT_DESCRIPTION_2;
+				if (element.Type != AttachmentType::Swapchain)
 				{
-					attachments[i].format = GraphicsContext::GetSwapchainFormat();
-					attachments[i].samples = VK_SAMPLE_COUNT_1_BIT;
+					attachment.format = element.Image->GetFormat();
+					attachment.samples = element.Image->GetSamples();
 				}
-				attachments[i].loadOp = (Info.Attachments[i].Clear) ? VK_ATTACHMENT_LOAD_OP_CLEAR : VK_ATTACHMENT_LOAD_OP_LOAD;
-
-				if (Info.Attachments[i].Barrier.OldLayout == ImageLayout::Undefined)
+				else
 				{
-					attachments[i].loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+					attachment.format = GraphicsContext::GetSwapchainFormat();
+					attachment.samples = VK_SAMPLE_COUNT_1_BIT;
 				}
-
-				attachments[i].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-				if (Info.Attachments[i].Type == AttachmentType::DepthStencil)
+				attachment.loadOp = (element.Clear) ? VK_ATTACHMENT_LOAD_OP_CLEAR : VK_ATTACHMENT_LOAD_OP_LOAD;
+				attachment.storeOp = (element.Image && s_Data.Graph.IsRenderPassLocal(element.Image)) ? VK_ATTACHMENT_STORE_OP_DONT_CARE : VK_ATTACHMENT_STORE_OP_STORE;
+				if (element.Type == AttachmentType::DepthStencil)
 				{
-					attachments[i].stencilLoadOp = (Info.Attachments[i].Clear) ? VK_ATTACHMENT_LOAD_OP_CLEAR : VK_ATTACHMENT_LOAD_OP_LOAD;
-					attachments[i].stencilStoreOp = VK_ATTACHMENT_STORE_OP_STORE;
+					attachment.stencilLoadOp = (element.Clear) ? VK_ATTACHMENT_LOAD_OP_CLEAR : VK_ATTACHMENT_LOAD_OP_LOAD;
+					attachment.stencilStoreOp = attachment.storeOp;
 				}
-				attachments[i].initialLayout = static_cast<VkImageLayout>(Info.Attachments[i].Barrier.OldLayout);
-				attachments[i].finalLayout = static_cast<VkImageLayout>(Info.Attachments[i].Barrier.NewLayout);
 
 				VkAttachmentReference2 attachRef = {
 					.sType = VK_STRUCTURE_TYPE_ATTACHMENT_REFERENCE_2,
-					.attachment = static_cast<uint32_t>(i),
+					.attachment = static_cast<uint32_t>(attachments.size()),
 				};
 
-				switch (Info.Attachments[i].Type)
+				switch (element.Type)
 				{
 					case AttachmentType::Color:
 					case AttachmentType::Swapchain:		attachRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL; break;
@@ -311,174 +1470,516 @@ namespace Hog
 					case AttachmentType::DepthStencil:	attachRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL; break;
 				}
 
-				if (Info.Attachments[i].Type == AttachmentType::Swapchain)
+				// Layout transitions and dependencies are recorded as barriers ahead of the pass
+				attachment.initialLayout = attachRef.layout;
+				attachment.finalLayout = attachRef.layout;
+
+				if (element.Type == AttachmentType::Depth || element.Type == AttachmentType::DepthStencil)
 				{
-					attachmentRefs[AttachmentType::Color].push_back(attachRef);
+					subpassAttachments.DepthStencil = attachRef;
+					subpassAttachments.HasDepthStencil = true;
 				}
 				else
 				{
-					attachmentRefs[Info.Attachments[i].Type].push_back(attachRef);
+					subpassAttachments.Colors.push_back(attachRef);
 				}
 
-				VkSubpassDependency2 dependency = {
-					.sType = VK_STRUCTURE_TYPE_SUBPASS_DEPENDENCY_2,
-					.srcSubpass = VK_SUBPASS_EXTERNAL,
-					.srcStageMask = ToStageFlags1(static_cast<VkPipelineStageFlags2>(Info.Attachments[i].Barrier.SrcStage)),
-					.dstStageMask = ToStageFlags1(static_cast<VkPipelineStageFlags2>(Info.Attachments[i].Barrier.DstStage)),
-					.srcAccessMask = ToAccessFlags1(static_cast<VkAccessFlags2>(Info.Attachments[i].Barrier.SrcAccessMask)),
-					.dstAccessMask = ToAccessFlags1(static_cast<VkAccessFlags2>(Info.Attachments[i].Barrier.DstAccessMask)),
-				};
-
-				dependencies.push_back(dependency);
-
-				if (Info.Attachments[i].Clear)
+				VkClearValue clearValue = {};
+				if (element.Clear)
 				{
-					if (Info.Attachments[i].Type == AttachmentType::Color ||
-						Info.Attachments[i].Type == AttachmentType::Swapchain)
+					if (element.Type == AttachmentType::Color || element.Type == AttachmentType::Swapchain)
 					{
-						ClearValues[i].color = { 0.0f, 0.0f, 0.0f, 1.0f };
+						clearValue.color = { 0.0f, 0.0f, 0.0f, 1.0f };
 					}
-					else if (Info.Attachments[i].Type == AttachmentType::Depth ||
-						Info.Attachments[i].Type == AttachmentType::DepthStencil)
+					else if (element.Type == AttachmentType::Depth || element.Type == AttachmentType::DepthStencil)
 					{
-						ClearValues[i].depthStencil.depth = 1.f;
+						clearValue.depthStencil.depth = 1.f;
 					}
 				}
-			}
 
-			//we are going to create 1 subpass, which is the minimum you can do
-			VkSubpassDescription2 subpass = {
-				.sType = VK_STRUCTURE_TYPE_SUBPASS_DESCRIPTION_2,
-				.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
-			};
+				attachments.push_back(attachment);
+				images.push_back(element.Image);
+				references.push_back({ subpass, subpass });
+				ClearValues.push_back(clearValue);
+			}
 
-			if (attachmentRefs.contains(AttachmentType::Color))
+			for (const auto& resource : stage.Info.Resources)
 			{
-				subpass.colorAttachmentCount = static_cast<uint32_t>(attachmentRefs[AttachmentType::Color].size());
-				subpass.pColorAttachments = attachmentRefs[AttachmentType::Color].data();
+				if (resource.Type != ResourceType::InputAttachment) continue;
+
+				const Ref<Image>& image = resource.Texture->GetImage();
+				uint32_t index = static_cast<uint32_t>(std::find(images.begin(), images.end(), image) - images.begin());
+				if (index == images.size())
+				{
+					// Rendered by an earlier render pass, the graph transitions it ahead of this one
+					attachments.push_back({
+						.sType = VK_STRUCTURE_TYPE_ATTACHMENT_DESCRIPTION_2,
+						.format = image->GetFormat(),
+						.samples = image->GetSamples(),
+						.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD,
+						.storeOp = VK_ATTACHMENT_STORE_OP_NONE,
+						.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+						.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+						.initialLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+					});
+					images.push_back(image);
+					references.push_back({ subpass, subpass });
+					ClearValues.push_back({});
+				}
+
+				// Attachments read by a later subpass are left in the layout of that read
+				attachments[index].finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+				references[index].second = subpass;
+
+				subpassAttachments.Inputs.push_back({
+					.sType = VK_STRUCTURE_TYPE_ATTACHMENT_REFERENCE_2,
+					.attachment = index,
+					.layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+					.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+				});
 			}
+		}
 
-			if (attachmentRefs.contains(AttachmentType::Depth))
+		// Subpasses in between the ones that write and read an attachment have to keep its contents around
+		for (uint32_t attachment = 0; attachment < references.size(); ++attachment)
+		{
+			for (uint32_t subpass = references[attachment].first + 1; subpass < references[attachment].second; ++subpass)
 			{
-				subpass.pDepthStencilAttachment= attachmentRefs[AttachmentType::Depth].data();
+				if (!subpasses[subpass].References(attachment))
+				{
+					subpasses[subpass].Preserves.push_back(attachment);
+				}
 			}
+		}
+
+		std::vector<VkSubpassDescription2> subpassDescriptions(subpasses.size());
+		std::vector<VkSubpassDependency2> dependencies;
+		for (uint32_t subpass = 0; subpass < subpasses.size(); ++subpass)
+		{
+			const auto& subpassAttachments = subpasses[subpass];
 
-			VkRenderPassCreateInfo2 renderPassInfo = {
-				.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO_2,
-				.attachmentCount = static_cast<uint32_t>(attachments.size()),
-				.pAttachments = attachments.data(),
-				.subpassCount = 1,
-				.pSubpasses = &subpass,
-				.dependencyCount = static_cast<uint32_t>(dependencies.size()),
-				.pDependencies = dependencies.data(),
+			subpassDescriptions[subpass] = {
+				.sType = VK_STRUCTURE_TYPE_SUBPASS_DESCRIPTION_2,
+				.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
+				.inputAttachmentCount = static_cast<uint32_t>(subpassAttachments.Inputs.size()),
+				.pInputAttachments = subpassAttachments.Inputs.data(),
+				.colorAttachmentCount = static_cast<uint32_t>(subpassAttachments.Colors.size()),
+				.pColorAttachments = subpassAttachments.Colors.data(),
+				.pDepthStencilAttachment = subpassAttachments.HasDepthStencil ? &subpassAttachments.DepthStencil : nullptr,
+				.preserveAttachmentCount = static_cast<uint32_t>(subpassAttachments.Preserves.size()),
+				.pPreserveAttachments = subpassAttachments.Preserves.data(),
 			};
 
-			CheckVkResult(vkCreateRenderPass2(GraphicsContext::GetDevice(), &renderPassInfo, nullptr, &RenderPass));
+			if (subpass == 0) continue;
+
+			// Each subpass reads what the ones before it rendered to the same pixel, the fragment shader
+			// stage is part of the source so the dependencies chain through the whole render pass
+			dependencies.push_back({
+				.sType = VK_STRUCTURE_TYPE_SUBPASS_DEPENDENCY_2,
+				.srcSubpass = subpass - 1,
+				.dstSubpass = subpass,
+				.srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT
+					| VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+				.dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT
+					| VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+				.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+				.dstAccessMask = VK_ACCESS_INPUT_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT
+					| VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+				.dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT,
+			});
 		}
 
-		VkSpecializationInfo specializationInfo = {};
-		std::vector<VkSpecializationMapEntry> specializationMapEntries;
-		std::vector<uint8_t> buffer;
+		VkRenderPassCreateInfo2 renderPassInfo = {
+			.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO_2,
+			.attachmentCount = static_cast<uint32_t>(attachments.size()),
+			.pAttachments = attachments.data(),
+			.subpassCount = static_cast<uint32_t>(subpassDescriptions.size()),
+			.pSubpasses = subpassDescriptions.data(),
+			.dependencyCount = static_cast<uint32_t>(dependencies.size()),
+			.pDependencies = dependencies.data(),
+		};
 
-		if (Info.Pipeline)
+		CheckVkResult(vkCreateRenderPass2(GraphicsContext::GetDevice(), &renderPassInfo, nullptr, &RenderPass));
+
+		// The stage whose barriers bring an attachment into the render pass keeps track of where the render pass leaves it
+		for (uint32_t attachment = 0; attachment < attachments.size(); ++attachment)
 		{
-			if (Info.Resources.ContainsType(ResourceType::Constant))
+			if (images[attachment] && attachments[attachment].finalLayout != attachments[attachment].initialLayout)
 			{
-				uint32_t offset = 0;
-				size_t size = 0;
+				GetSubpassStage(references[attachment].first).m_RenderPassLayouts.push_back({ images[attachment], attachments[attachment].finalLayout });
+			}
+		}
 
-				for (const auto& resource : Info.Resources)
-				{
-					if (resource.Type == ResourceType::Constant)
-					{
-						specializationMapEntries.push_back({ resource.ConstantID, offset, resource.ConstantSize });
-						size += resource.ConstantSize;
+		if (Info.StageType != RendererStageType::Blit)
+		{
+			FrameBuffer = FrameBuffer::Create(images, RenderPass, images[0]->GetExtent());
+		}
+	}
 
-						buffer.resize(size);
-						std::memcpy(buffer.data() + offset, resource.ConstantDataPointer, resource.ConstantSize);
+	void RendererStage::SetupDynamicRendering()
+	{
+		ClearValues.clear();
 
-						offset += (uint32_t)resource.ConstantSize;
-					}
-				}
+		for (const auto& element : Info.Attachments)
+		{
+			VkClearValue clearValue = {};
 
-				specializationInfo.mapEntryCount = (uint32_t)specializationMapEntries.size();
-				specializationInfo.pMapEntries = specializationMapEntries.data();
-				specializationInfo.dataSize = size;
-				specializationInfo.pData = buffer.data();
+			switch (element.Type)
+			{
+				case AttachmentType::Color:
+				{
+					m_RenderingFormats.ColorFormats.push_back(element.Image->GetFormat());
+					clearValue.color = { 0.0f, 0.0f, 0.0f, 1.0f };
+				}break;
+				case AttachmentType::Swapchain:
+				{
+					m_RenderingFormats.ColorFormats.push_back(GraphicsContext::GetSwapchainFormat());
+					clearValue.color = { 0.0f, 0.0f, 0.0f, 1.0f };
+				}break;
+				case AttachmentType::Depth:
+				{
+					m_RenderingFormats.DepthFormat = element.Image->GetFormat();
+					clearValue.depthStencil.depth = 1.f;
+				}break;
+				case AttachmentType::DepthStencil:
+				{
+					m_RenderingFormats.DepthFormat = element.Image->GetFormat();
+					m_RenderingFormats.StencilFormat = element.Image->GetFormat();
+					clearValue.depthStencil.depth = 1.f;
+				}break;
 			}
 
-			if (RenderPass != VK_NULL_HANDLE)
+			if (element.Type != AttachmentType::Swapchain)
 			{
-				uint32_t colorCount = 0;
-				std::for_each(Info.Attachments.begin(), Info.Attachments.end(), [&colorCount](AttachmentElement& attachment) 
-					{ 
-						colorCount += (attachment.Type == AttachmentType::Color || attachment.Type == AttachmentType::Swapchain) ? 1 : 0;
-					});
+				m_RenderingSamples = element.Image->GetSamples();
+			}
 
-				Info.Pipeline->Generate(RenderPass, &specializationInfo);
+			ClearValues.push_back(clearValue);
+		}
+	}
+
+	void RendererStage::BeginRendering(VkCommandBuffer commandBuffer)
+	{
+		std::vector<VkRenderingAttachmentInfo> colorAttachments;
+		VkRenderingAttachmentInfo depthAttachment = {};
+		VkRenderingAttachmentInfo stencilAttachment = {};
+		VkExtent2D extent = {};
+
+		uint32_t index = 0;
+		for (const auto& element : Info.Attachments)
+		{
+			// Image views are looked up every frame, so recreated images need no other objects recreated with them
+			const Ref<Image>& image = element.Type == AttachmentType::Swapchain ? s_Data.GetCurrentFrame().SwapchainImage : element.Image;
+			if (index == 0) extent = image->GetExtent();
+
+			VkRenderingAttachmentInfo attachment = {
+				.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
+				.imageView = image->GetImageView(),
+				.loadOp = (element.Clear) ? VK_ATTACHMENT_LOAD_OP_CLEAR : VK_ATTACHMENT_LOAD_OP_LOAD,
+				.storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+				.clearValue = ClearValues[index++],
+			};
+
+			switch (element.Type)
+			{
+				case AttachmentType::Color:
+				case AttachmentType::Swapchain:
+				{
+					attachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+					colorAttachments.push_back(attachment);
+				}break;
+				case AttachmentType::Depth:
+				{
+					attachment.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+					depthAttachment = attachment;
+				}break;
+				case AttachmentType::DepthStencil:
+				{
+					attachment.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+					depthAttachment = attachment;
+					stencilAttachment = attachment;
+				}break;
 			}
+		}
+
+		const VkRenderingInfo renderingInfo = {
+			.sType = VK_STRUCTURE_TYPE_RENDERING_INFO,
+			.flags = VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT,
+			.renderArea = {
+				.extent = extent,
+			},
+			.layerCount = 1,
+			.colorAttachmentCount = static_cast<uint32_t>(colorAttachments.size()),
+			.pColorAttachments = colorAttachments.data(),
+			.pDepthAttachment = m_RenderingFormats.DepthFormat != VK_FORMAT_UNDEFINED ? &depthAttachment : nullptr,
+			.pStencilAttachment = m_RenderingFormats.StencilFormat != VK_FORMAT_UNDEFINED ? &stencilAttachment : nullptr,
+		};
+
+		vkCmdBeginRendering(commandBuffer, &renderingInfo);
+	}
+
+	RendererStage& RendererStage::GetSubpassStage(uint32_t subpass) const
+	{
+		return s_Data.Stages[Subpass.RenderPassStage + subpass];
+	}
+
+	void RendererStage::Prepare()
+	{
+		Timer prepareTimer;
+
+		for (const auto& barrier : Barriers.Images)
+		{
+			// Nothing was released yet on the first frame, the resource is simply used for the first time
+			if (barrier.SrcQueue != barrier.DstQueue && s_Data.ReleasedResources.erase(barrier.Image.get()))
+				m_BarrierBatch.AddImageOwnershipTransfer(*barrier.Image, barrier.Barrier, GetQueueFamily(barrier.SrcQueue), GetQueueFamily(barrier.DstQueue));
+			else
+				m_BarrierBatch.AddImageBarrier(*barrier.Image, barrier.Barrier, barrier.Discard);
+		}
+
+		for (const auto& barrier : Barriers.Buffers)
+		{
+			if (barrier.SrcQueue != barrier.DstQueue && s_Data.ReleasedResources.erase(barrier.Buffer.get()))
+				m_BarrierBatch.AddBufferOwnershipTransfer(*barrier.Buffer, barrier.Barrier, GetQueueFamily(barrier.SrcQueue), GetQueueFamily(barrier.DstQueue));
 			else
+				m_BarrierBatch.AddBufferBarrier(*barrier.Buffer, barrier.Barrier);
+		}
+
+		// Descriptors capture the image layouts, which are only known once the barriers above are added
+		if (Info.Pipeline)
+		{
+			UpdateDescriptorSet();
+			UpdateDynamicOffsets();
+		}
+
+		if (!m_InstanceBuffers.empty())
+		{
+			UpdateInstances();
+		}
+
+		if (m_GPUCulling)
+		{
+			m_FrustumPlanes = Math::ExtractFrustumPlanes(*Info.CullingViewProjection);
+		}
+		else if (Info.CullingViewProjection && !Info.Meshes.empty())
+		{
+			CullMeshes();
+		}
+
+		if (!m_GPUCulling && !Info.Meshes.empty())
+		{
+			SortDraws();
+		}
+
+		for (const auto& [image, layout] : m_RenderPassLayouts)
+		{
+			image->SetImageLayout(layout);
+		}
+
+		for (const auto& barrier : Barriers.ReleaseImages)
+		{
+			m_ReleaseBarrierBatch.AddImageOwnershipTransfer(*barrier.Image, barrier.Barrier, GetQueueFamily(barrier.SrcQueue), GetQueueFamily(barrier.DstQueue));
+			s_Data.ReleasedResources.insert(barrier.Image.get());
+		}
+
+		for (const auto& barrier : Barriers.ReleaseBuffers)
+		{
+			m_ReleaseBarrierBatch.AddBufferOwnershipTransfer(*barrier.Buffer, barrier.Barrier, GetQueueFamily(barrier.SrcQueue), GetQueueFamily(barrier.DstQueue));
+			s_Data.ReleasedResources.insert(barrier.Buffer.get());
+		}
+
+		m_PrepareTime = prepareTimer.ElapsedMillis();
+	}
+
+	void RendererStage::Record(ThreadPool& threadPool, std::vector<ThreadCommandPool>& commandPools)
+	{
+		m_MeshesPerJob = std::max(1, *CVarSystem::Get()->GetIntCVar("renderer.meshesPerRecordingJob"));
+		m_CommandBuffers.resize(GetRecordingJobCount());
+		m_JobCounters.assign(m_CommandBuffers.size(), {});
+		m_JobTimes.resize(m_CommandBuffers.size());
+
+		for (uint32_t job = 0; job < m_CommandBuffers.size(); ++job)
+		{
+			threadPool.Submit([this, &commandPools, job](uint32_t threadIndex) {
+				Timer jobTimer;
+				VkCommandBuffer commandBuffer = commandPools[threadIndex].Allocate();
+				RecordJob(commandBuffer, job, m_JobCounters[job]);
+				m_CommandBuffers[job] = commandBuffer;
+				m_JobTimes[job] = jobTimer.ElapsedMillis();
+			});
+		}
+	}
+
+	void RendererStage::Execute(VkCommandBuffer commandBuffer)
+	{
+		// Barriers cannot be recorded between subpasses, every stage of the render pass gets its barriers up front
+		for (uint32_t subpass = 0; subpass < Subpass.SubpassCount; ++subpass)
+		{
+			auto& barrierBatch = GetSubpassStage(subpass).m_BarrierBatch;
+			s_Data.Stats.Barriers += barrierBatch.GetBarrierCount();
+			barrierBatch.Flush(commandBuffer);
+		}
+
+		// Dispatches are not allowed within a render pass, so every subpass gets culled ahead of it
+		for (uint32_t subpass = 0; subpass < Subpass.SubpassCount; ++subpass)
+		{
+			GetSubpassStage(subpass).Cull(commandBuffer);
+		}
+
+		if (!m_CommandBuffers.empty() && RenderPass != VK_NULL_HANDLE)
+		{
+			Ref<Hog::FrameBuffer> frameBuffer = GetTargetFrameBuffer();
+
+			VkRenderPassBeginInfo renderPassBeginInfo = {
+				.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
+				.renderPass = RenderPass,
+				.framebuffer = static_cast<VkFramebuffer>(*frameBuffer),
+				.renderArea = {
+					.extent = frameBuffer->GetExtent(),
+				},
+				.clearValueCount = static_cast<uint32_t>(ClearValues.size()),
+				.pClearValues = ClearValues.data(),
+			};
+
+			VkSubpassBeginInfo subpassBeginInfo = {
+				.sType = VK_STRUCTURE_TYPE_SUBPASS_BEGIN_INFO,
+				.contents = VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS,
+			};
+
+			VkSubpassEndInfo subpassEndInfo = {
+				.sType = VK_STRUCTURE_TYPE_SUBPASS_END_INFO,
+			};
+
+			vkCmdBeginRenderPass2(commandBuffer, &renderPassBeginInfo, &subpassBeginInfo);
+			for (uint32_t subpass = 0; subpass < Subpass.SubpassCount; ++subpass)
 			{
-				Info.Pipeline->Generate(nullptr, &specializationInfo);
+				if (subpass > 0)
+				{
+					vkCmdNextSubpass2(commandBuffer, &subpassBeginInfo, &subpassEndInfo);
+				}
+
+				const auto& commandBuffers = GetSubpassStage(subpass).m_CommandBuffers;
+				vkCmdExecuteCommands(commandBuffer, static_cast<uint32_t>(commandBuffers.size()), commandBuffers.data());
 			}
+			vkCmdEndRenderPass2(commandBuffer, &subpassEndInfo);
+		}
+		else if (!m_CommandBuffers.empty() && m_DynamicRendering)
+		{
+			BeginRendering(commandBuffer);
+			vkCmdExecuteCommands(commandBuffer, static_cast<uint32_t>(m_CommandBuffers.size()), m_CommandBuffers.data());
+			vkCmdEndRendering(commandBuffer);
+		}
+		else if (!m_CommandBuffers.empty())
+		{
+			vkCmdExecuteCommands(commandBuffer, static_cast<uint32_t>(m_CommandBuffers.size()), m_CommandBuffers.data());
 		}
 
-		if (Info.StageType == RendererStageType::RayTracing)
+		for (uint32_t subpass = 0; subpass < Subpass.SubpassCount; ++subpass)
 		{
-			Info.ShaderBindingTable = ShaderBindingTable::Create(Info.Pipeline->GetHandle());
+			auto& barrierBatch = GetSubpassStage(subpass).m_ReleaseBarrierBatch;
+			s_Data.Stats.Barriers += barrierBatch.GetBarrierCount();
+			barrierBatch.Flush(commandBuffer);
+		}
+	}
+
+	float RendererStage::CollectStats(Renderer::RendererStats& stats) const
+	{
+		float recordingTime = m_PrepareTime;
+		for (size_t job = 0; job < m_JobCounters.size(); ++job)
+		{
+			const auto& counters = m_JobCounters[job];
+			stats.DrawCalls += counters.DrawCalls;
+			stats.Dispatches += counters.Dispatches;
+			stats.Instances += counters.Instances;
+			stats.Triangles += counters.Triangles;
+			stats.PipelineBinds += counters.PipelineBinds;
+			stats.BufferBinds += counters.BufferBinds;
+
+			recordingTime += m_JobTimes[job];
 		}
 
-		if (Info.StageType != RendererStageType::Blit && RenderPass != VK_NULL_HANDLE)
+		return recordingTime;
+	}
+
+	void RendererStage::Cleanup()
+	{
+		FrameBuffer.reset();
+		m_DrawBuffer.reset();
+		m_IndirectBuffers.clear();
+		m_RenderPassLayouts.clear();
+
+		// Stages running as subpasses share the render pass of the stage that owns it
+		if (Subpass.Subpass == 0)
 		{
-			auto attachments = Info.Attachments.GetElements();
-			std::vector<Ref<Image>> fbAttachments(attachments.size());
-			for (int i = 0; i < attachments.size(); ++i)
-			{
-				fbAttachments[i] = attachments[i].Image;
-			}
-
-			FrameBuffer = FrameBuffer::Create(fbAttachments, RenderPass, fbAttachments[0]->GetExtent());
+			vkDestroyRenderPass(GraphicsContext::GetDevice(), RenderPass, nullptr);
 		}
 	}
 
-	void RendererStage::Execute(VkCommandBuffer commandBuffer)
+	uint32_t RendererStage::GetRecordingJobCount() const
 	{
-		/*for (const auto& resource : stage.Info.Resources)
+		switch (Info.StageType)
 		{
-			if (resource.Barrier)
+			case RendererStageType::Barrier: return 0;
+			case RendererStageType::ForwardGraphics:
+			case RendererStageType::DeferredGraphics:
 			{
-				if (resource.StorageImage)
-				{
-					resource.StorageImage->ExecuteBarrier(currentFrame.CommandBuffer, resource.Barrier);
-				}
-				else if (resource.Texture)
-				{
-					resource.Texture->GetImage()->ExecuteBarrier(currentFrame.CommandBuffer, resource.Barrier);
-				}
-			}
-		}*/
+				if (m_GPUCulling) return 1;
 
-		for (const auto& attachment : Info.Attachments)
-		{
-			if (attachment.Image)
-			{
-				if (attachment.Image->GetImageLayout() != static_cast<VkImageLayout>(attachment.Barrier.OldLayout) && attachment.Barrier.OldLayout != ImageLayout::Undefined)
-				{
-					attachment.Image->ExecuteBarrier(commandBuffer, { static_cast<ImageLayout>(attachment.Image->GetImageLayout()), attachment.Barrier.OldLayout});
-				}
+				// The render pass still has to run for its clears when there is nothing to draw
+				uint32_t drawCount = static_cast<uint32_t>(m_Draws.size());
+				return std::max(1u, (drawCount + m_MeshesPerJob - 1) / m_MeshesPerJob);
 			}
+			default: return 1;
 		}
+	}
+
+	Ref<FrameBuffer> RendererStage::GetTargetFrameBuffer() const
+	{
+		return Info.StageType == RendererStageType::Blit ? s_Data.GetCurrentFrame().FrameBuffer : FrameBuffer;
+	}
+
+	void RendererStage::RecordJob(VkCommandBuffer commandBuffer, uint32_t job, RecordingCounters& counters)
+	{
+		HG_PROFILE_FUNCTION();
+		HG_PROFILE_TAG("Name", Info.Name.c_str());
+
+		const VkCommandBufferInheritanceRenderingInfo renderingInfo = {
+			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO,
+			.colorAttachmentCount = static_cast<uint32_t>(m_RenderingFormats.ColorFormats.size()),
+			.pColorAttachmentFormats = m_RenderingFormats.ColorFormats.data(),
+			.depthAttachmentFormat = m_RenderingFormats.DepthFormat,
+			.stencilAttachmentFormat = m_RenderingFormats.StencilFormat,
+			.rasterizationSamples = m_RenderingSamples,
+		};
+
+		const VkCommandBufferInheritanceInfo inheritanceInfo = {
+			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
+			.pNext = m_DynamicRendering ? &renderingInfo : nullptr,
+			.renderPass = RenderPass,
+			.subpass = Subpass.Subpass,
+			.framebuffer = RenderPass != VK_NULL_HANDLE ? static_cast<VkFramebuffer>(*GetTargetFrameBuffer()) : VK_NULL_HANDLE,
+			// Secondaries executed while a statistics query is active have to count everything the query does
+			.pipelineStatistics = s_Data.PipelineStatistics ? GraphicsStatistics : 0u,
+		};
+
+		const VkCommandBufferBeginInfo beginInfo = {
+			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+			.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT
+				| (RenderPass != VK_NULL_HANDLE || m_DynamicRendering ? VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT : 0u),
+			.pInheritanceInfo = &inheritanceInfo,
+		};
+
+		CheckVkResult(vkBeginCommandBuffer(commandBuffer, &beginInfo));
 
 		switch (Info.StageType)
 		{
 			case RendererStageType::Blit:
 			{
-				BlitStage(commandBuffer);
+				BlitStage(commandBuffer, counters);
 			}break;
 			case RendererStageType::DeferredCompute:
 			case RendererStageType::ForwardCompute:
 			{
-				ForwardCompute(commandBuffer);
+				ForwardCompute(commandBuffer, counters);
 			}break;
 			case RendererStageType::ImGui:
 			{
@@ -488,55 +1989,25 @@ namespace Hog
 			case RendererStageType::DeferredGraphics:
 			case RendererStageType::ScreenSpacePass:
 			{
-				ForwardGraphics(commandBuffer);
+				ForwardGraphics(commandBuffer, job, counters);
 			}break;
 			case RendererStageType::RayTracing:
 			{
-				RayTracing(commandBuffer);
+				RayTracing(commandBuffer, counters);
 			}break;
+			default: break;
 		}
 
-		for (const auto& attachment : Info.Attachments)
-		{
-			if (attachment.Image)
-			{
-				attachment.Image->SetImageLayout(static_cast<VkImageLayout>(attachment.Barrier.NewLayout));
-			}
-		}
-	}
-
-	void RendererStage::Cleanup()
-	{
-		FrameBuffer.reset();
-		vkDestroyRenderPass(GraphicsContext::GetDevice(), RenderPass, nullptr);
+		CheckVkResult(vkEndCommandBuffer(commandBuffer));
 	}
 
-	void RendererStage::ForwardGraphics(VkCommandBuffer commandBuffer)
+	void RendererStage::ForwardGraphics(VkCommandBuffer commandBuffer, uint32_t job, RecordingCounters& counters)
 	{
 		HG_PROFILE_GPU_EVENT("ForwardGraphics Pass");
 		HG_PROFILE_TAG("Name", Info.Name.c_str());
 
-		RendererFrame& currentFrame = s_Data.GetCurrentFrame();
 		VkExtent2D extent = Info.Attachments.begin()->Image->GetExtent();
 
-		VkRenderPassBeginInfo renderPassBeginInfo = {
-			.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
-			.renderPass = RenderPass,
-			.framebuffer = static_cast<VkFramebuffer>(*FrameBuffer),
-			.renderArea = {
-				.extent = extent
-			},
-			.clearValueCount = static_cast<uint32_t>(ClearValues.size()),
-			.pClearValues = ClearValues.data(),
-		};
-
-		VkSubpassBeginInfo subpassBeginInfo = {
-			.sType = VK_STRUCTURE_TYPE_SUBPASS_BEGIN_INFO,
-			.contents = VK_SUBPASS_CONTENTS_INLINE,
-		};
-
-		vkCmdBeginRenderPass2(commandBuffer, &renderPassBeginInfo, &subpassBeginInfo);
-
 		VkViewport viewport;
 		viewport.x = 0.0f;
 		if (Info.StageType == RendererStageType::ScreenSpacePass)
@@ -564,50 +2035,92 @@ namespace Hog
 		vkCmdSetDepthBias(commandBuffer, 0, 0, 0);
 
 		Info.Pipeline->Bind(commandBuffer);
+		counters.PipelineBinds++;
 
-		BindResources(commandBuffer, &s_Data.GetCurrentFrame().DescriptorAllocator);
+		BindResources(commandBuffer);
 
 		if (Info.StageType == RendererStageType::ScreenSpacePass)
 		{
 			vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+			counters.DrawCalls++;
+			counters.Instances++;
+			counters.Triangles++;
 		}
-		else 
+		else if (m_GPUCulling)
 		{
-			for (auto && mesh : Info.Meshes)
+			vkCmdPushConstants(commandBuffer, Info.Pipeline->GetPipelineLayout(), m_InstancePushStages, 0, sizeof(m_InstanceBufferIndex), &m_InstanceBufferIndex);
+
+			GeometryBuffer::Bind(commandBuffer);
+			counters.BufferBinds += 2;
+
+			// One indirect draw per index width, each with its own count
+			VkBuffer indirectBuffer = m_IndirectBuffers[s_Data.FrameIndex]->GetHandle();
+			const uint32_t narrowDrawCount = m_DrawCount - m_WideDrawCount;
+			if (narrowDrawCount)
 			{
-				glm::mat4 modelMat = mesh->GetModelMatrix();
-				for (int i = 0; i < Info.Resources.size(); i++)
-				{
-					const auto& resource = Info.Resources[i];
+				vkCmdDrawIndexedIndirectCount(commandBuffer, indirectBuffer, IndirectCommandOffset, indirectBuffer, 0,
+					narrowDrawCount, sizeof(VkDrawIndexedIndirectCommand));
+				counters.DrawCalls++;
+			}
 
-					switch (resource.Type)
-					{
-						case ResourceType::PushConstant:
-						{
-							std::memcpy(resource.ConstantDataPointer, &modelMat, resource.ConstantSize);
-							vkCmdPushConstants(commandBuffer, Info.Pipeline->GetPipelineLayout(), resource.BindLocation, 0, static_cast<uint32_t>(resource.ConstantSize), resource.ConstantDataPointer);
-						}break;
-						default: break;
-					}
+			if (m_WideDrawCount)
+			{
+				GeometryBuffer::BindIndices(commandBuffer, VK_INDEX_TYPE_UINT32);
+				vkCmdDrawIndexedIndirectCount(commandBuffer, indirectBuffer,
+					IndirectCommandOffset + narrowDrawCount * sizeof(VkDrawIndexedIndirectCommand), indirectBuffer, sizeof(uint32_t),
+					m_WideDrawCount, sizeof(VkDrawIndexedIndirectCommand));
+				counters.DrawCalls++;
+				counters.BufferBinds++;
+			}
+		}
+		else if (!Info.Meshes.empty())
+		{
+			vkCmdPushConstants(commandBuffer, Info.Pipeline->GetPipelineLayout(), m_InstancePushStages, 0, sizeof(m_InstanceBufferIndex), &m_InstanceBufferIndex);
+
+			size_t firstDraw = static_cast<size_t>(job) * m_MeshesPerJob;
+			size_t lastDraw = std::min(m_Draws.size(), firstDraw + m_MeshesPerJob);
+
+			// Every mesh lives in the shared geometry buffers, so the job binds them once for all of its draws and only
+			// rebinds the index buffer when the index width changes
+			GeometryBuffer::Bind(commandBuffer);
+			VkIndexType boundIndexType = VK_INDEX_TYPE_UINT16;
+			counters.BufferBinds += 2;
+
+			for (size_t d = firstDraw; d < lastDraw; d++)
+			{
+				const auto& draw = m_Draws[d];
+				const auto& mesh = Info.Meshes[draw.Mesh];
+
+				VkIndexType indexType = mesh->GetPrimitive(draw.Primitive).GetIndexType();
+				if (indexType != boundIndexType)
+				{
+					GeometryBuffer::BindIndices(commandBuffer, indexType);
+					boundIndexType = indexType;
+					counters.BufferBinds++;
 				}
 
-				mesh->Draw(commandBuffer);
+				mesh->DrawPrimitive(commandBuffer, draw.Primitive, m_MeshFirstInstance[draw.Mesh] + draw.Primitive * mesh->GetInstanceCount());
+
+				counters.DrawCalls++;
+				counters.Instances += mesh->GetInstanceCount();
+				counters.Triangles += mesh->GetPrimitive(draw.Primitive).GetIndexCount() / 3 * mesh->GetInstanceCount();
 			}
 		}
-
-		vkCmdEndRenderPass(commandBuffer);
 	}
 
-	void RendererStage::ForwardCompute(VkCommandBuffer commandBuffer)
+	void RendererStage::ForwardCompute(VkCommandBuffer commandBuffer, RecordingCounters& counters)
 	{
 		HG_PROFILE_GPU_EVENT("ForwardCompute Pass");
 		HG_PROFILE_TAG("Name", Info.Name.c_str());
 
 		Info.Pipeline->Bind(commandBuffer);
 
-		BindResources(commandBuffer, &s_Data.GetCurrentFrame().DescriptorAllocator);
+		BindResources(commandBuffer);
 
 		vkCmdDispatch(commandBuffer, Info.GroupCounts.x, Info.GroupCounts.y, Info.GroupCounts.z);
+
+		counters.PipelineBinds++;
+		counters.Dispatches++;
 	}
 
 	void RendererStage::ImGui(VkCommandBuffer commandBuffer)
@@ -615,54 +2128,15 @@ namespace Hog
 		// ImGui
 		HG_PROFILE_GPU_EVENT("ImGui Pass");
 
-		VkRenderPassBeginInfo renderPassBeginInfo = {
-			.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
-			.renderPass = RenderPass,
-			.framebuffer = static_cast<VkFramebuffer>(*FrameBuffer),
-			.renderArea = {
-				.extent = FrameBuffer->GetExtent(),
-			},
-			.clearValueCount = static_cast<uint32_t>(ClearValues.size()),
-			.pClearValues = ClearValues.data(),
-		};
-
-		VkSubpassBeginInfo subpassBeginInfo = {
-			.sType = VK_STRUCTURE_TYPE_SUBPASS_BEGIN_INFO,
-			.contents = VK_SUBPASS_CONTENTS_INLINE,
-		};
-
-		vkCmdBeginRenderPass2(commandBuffer, &renderPassBeginInfo, &subpassBeginInfo);
-
 		// Imgui draw
 		s_Data.ImGuiLayer->Draw(commandBuffer);
-
-		vkCmdEndRenderPass(commandBuffer);
 	}
 
-	void RendererStage::BlitStage(VkCommandBuffer commandBuffer)
+	void RendererStage::BlitStage(VkCommandBuffer commandBuffer, RecordingCounters& counters)
 	{
 		// Copy to final target
 		HG_PROFILE_GPU_EVENT("Blit Pass");
-		RendererFrame& currentFrame = s_Data.GetCurrentFrame();
-		VkExtent2D extent = currentFrame.FrameBuffer->GetExtent();
-
-		VkRenderPassBeginInfo renderPassBeginInfo = {
-			.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
-			.renderPass = RenderPass,
-			.framebuffer = static_cast<VkFramebuffer>(*(currentFrame.FrameBuffer)),
-			.renderArea = {
-				.extent = extent
-			},
-			.clearValueCount = static_cast<uint32_t>(ClearValues.size()),
-			.pClearValues = ClearValues.data(),
-		};
-
-		VkSubpassBeginInfo subpassBeginInfo = {
-			.sType = VK_STRUCTURE_TYPE_SUBPASS_BEGIN_INFO,
-			.contents = VK_SUBPASS_CONTENTS_INLINE,
-		};
-
-		vkCmdBeginRenderPass2(commandBuffer, &renderPassBeginInfo, &subpassBeginInfo);
+		VkExtent2D extent = s_Data.GetCurrentFrame().SwapchainImage->GetExtent();
 
 		VkViewport viewport;
 		viewport.x = 0.0f;
@@ -683,17 +2157,24 @@ namespace Hog
 
 		Info.Pipeline->Bind(commandBuffer);
 
-		BindResources(commandBuffer, &currentFrame.DescriptorAllocator);
+		BindResources(commandBuffer);
 
 		vkCmdDraw(commandBuffer, 3, 1, 0, 0);
 
-		vkCmdEndRenderPass(commandBuffer);
+		counters.PipelineBinds++;
+		counters.DrawCalls++;
+		counters.Instances++;
+		counters.Triangles++;
 	}
 
-	void RendererStage::RayTracing(VkCommandBuffer commandBuffer)
+	void RendererStage::RayTracing(VkCommandBuffer commandBuffer, RecordingCounters& counters)
 	{
 		Info.Pipeline->Bind(commandBuffer);
-		BindResources(commandBuffer, &s_Data.GetCurrentFrame().DescriptorAllocator);
+		BindResources(commandBuffer);
+
+		// Trace rays calls are counted as dispatches
+		counters.PipelineBinds++;
+		counters.Dispatches++;
 
 		vkCmdTraceRaysKHR(commandBuffer,
 			Info.ShaderBindingTable->GetRaygenShaderSBTEntry(),
@@ -706,110 +2187,401 @@ namespace Hog
 		);
 	}
 
-	void RendererStage::BindResources(VkCommandBuffer commandBuffer, DescriptorAllocator* allocator)
+	void RendererStage::CreateInstanceBuffers()
+	{
+		uint32_t instanceCount = 0;
+		m_MeshFirstInstance.reserve(Info.Meshes.size());
+		for (const auto& mesh : Info.Meshes)
+		{
+			m_MeshFirstInstance.push_back(instanceCount);
+			instanceCount += static_cast<uint32_t>(mesh->GetPrimitiveCount()) * mesh->GetInstanceCount();
+		}
+
+		for (uint32_t i = 0; i < s_Data.MaxFrameCount; i++)
+		{
+			m_InstanceBuffers.push_back(Buffer::Create(BufferDescription::Defaults::StorageBuffer, sizeof(InstanceData) * std::max(1u, instanceCount)));
+		}
+
+		// The instance buffer index is pushed to the stages that take the stage's push constant
+		for (const auto& resource : Info.Resources)
+		{
+			if (resource.Type == ResourceType::PushConstant)
+			{
+				m_InstancePushStages = resource.BindLocation;
+			}
+		}
+	}
+
+	void RendererStage::UpdateInstances()
+	{
+		HG_PROFILE_FUNCTION();
+
+		const auto& buffer = m_InstanceBuffers[s_Data.FrameIndex];
+		InstanceData* instances = static_cast<InstanceData*>(static_cast<void*>(*buffer));
+
+		// The instances of a primitive are contiguous so a single draw covers all of them
+		for (const auto& mesh : Info.Meshes)
+		{
+			for (const auto& primitive : *mesh)
+			{
+				for (const auto& model : mesh->GetInstances())
+				{
+					instances->Model = model;
+					instances->PositionOffset = primitive.GetPositionOffset();
+					instances->MaterialIndex = primitive.GetMaterialIndex();
+					instances->PositionScale = primitive.GetPositionScale();
+					instances++;
+				}
+			}
+		}
+
+		buffer->Flush();
+		m_InstanceBufferIndex = buffer->GetGPUIndex();
+
+		s_Data.Stats.BytesUploaded += reinterpret_cast<uint8_t*>(instances) - static_cast<uint8_t*>(static_cast<void*>(*buffer));
+	}
+
+	void RendererStage::CullMeshes()
+	{
+		HG_PROFILE_FUNCTION();
+
+		m_FrustumPlanes = Math::ExtractFrustumPlanes(*Info.CullingViewProjection);
+
+		m_MeshBounds.Resize(Info.Meshes.size());
+		for (size_t m = 0; m < Info.Meshes.size(); m++)
+		{
+			// Instanced meshes are drawn or culled as a whole, so they are tested against the union of their instances
+			const auto& mesh = Info.Meshes[m];
+			Math::BoundingBox bounds = mesh->GetBounds().Transform(mesh->GetModelMatrix());
+			for (uint32_t i = 1; i < mesh->GetInstanceCount(); i++)
+			{
+				bounds.Merge(mesh->GetBounds().Transform(mesh->GetInstances()[i]));
+			}
+
+			m_MeshBounds.Set(m, bounds);
+		}
+
+		uint32_t visibleCount = Math::CullBoundingBoxes(m_FrustumPlanes, m_MeshBounds, m_MeshVisibility);
+
+		s_Data.Stats.VisibleMeshes += visibleCount;
+		s_Data.Stats.CulledMeshes += static_cast<uint32_t>(Info.Meshes.size()) - visibleCount;
+	}
+
+	void RendererStage::SortDraws()
+	{
+		HG_PROFILE_FUNCTION();
+
+		if (m_MeshBufferKeys.empty())
+		{
+			std::unordered_map<const Mesh*, uint32_t> firstMeshes;
+			for (uint32_t m = 0; m < Info.Meshes.size(); m++)
+			{
+				m_MeshBufferKeys.push_back(firstMeshes.try_emplace(Info.Meshes[m].get(), m).first->second);
+			}
+		}
+
+		// Without a view projection there is no depth to order blended draws by, so they keep the order they were given in
+		bool sort = *CVarSystem::Get()->GetIntCVar("renderer.sortDraws") && (!Info.SortBackToFront || Info.CullingViewProjection);
+		glm::mat4 viewProjection = Info.CullingViewProjection ? *Info.CullingViewProjection : glm::mat4(1.0f);
+
+		m_Draws.clear();
+		for (uint32_t m = 0; m < Info.Meshes.size(); m++)
+		{
+			if (!m_MeshVisibility.empty() && !m_MeshVisibility[m]) continue;
+
+			const auto& mesh = Info.Meshes[m];
+			glm::mat4 transform = viewProjection * mesh->GetModelMatrix();
+
+			for (uint32_t p = 0; p < mesh->GetPrimitiveCount(); p++)
+			{
+				uint64_t key = 0;
+				if (sort)
+				{
+					const auto& primitive = mesh->GetPrimitive(p);
+					glm::vec4 position = transform * glm::vec4(primitive.GetBounds().GetCenter(), 1.0f);
+					float depth = position.w > 0.0f ? position.z / position.w : 0.0f;
+
+					uint32_t buffers = (primitive.GetIndexType() == VK_INDEX_TYPE_UINT32 ? 1u << 19 : 0u) | m_MeshBufferKeys[m];
+					key = MakeDrawKey(buffers, primitive.GetMaterialIndex(), depth, Info.SortBackToFront);
+				}
+
+				m_Draws.push_back({ key, m, p });
+			}
+		}
+
+		if (sort)
+		{
+			Util::RadixSort(m_Draws, m_SortScratch, [](const DrawItem& draw) { return draw.Key; });
+		}
+	}
+
+	void RendererStage::CreateIndirectBuffers()
+	{
+		m_DrawCount = m_MeshFirstInstance.empty() ? 0 : m_MeshFirstInstance.back()
+			+ static_cast<uint32_t>(Info.Meshes.back()->GetPrimitiveCount()) * Info.Meshes.back()->GetInstanceCount();
+		m_DrawBuffer = Buffer::Create(BufferDescription::Defaults::StorageBuffer, sizeof(IndirectDrawData) * std::max(1u, m_DrawCount));
+
+		// Draws are in instance order, the culling pass hands the instance index on to the draw as its first instance.
+		// Instances are culled one by one here, so every instance of a primitive gets its own draw.
+		m_WideDrawCount = 0;
+		IndirectDrawData* draws = static_cast<IndirectDrawData*>(static_cast<void*>(*m_DrawBuffer));
+		for (const auto& mesh : Info.Meshes)
+		{
+			for (const auto& primitive : *mesh)
+			{
+				for (uint32_t i = 0; i < mesh->GetInstanceCount(); i++)
+				{
+					*draws++ = {
+						.BoundsMin = primitive.GetBounds().Min,
+						.IndexCount = static_cast<uint32_t>(primitive.GetIndexCount()),
+						.BoundsMax = primitive.GetBounds().Max,
+						.FirstIndex = primitive.GetFirstIndex(),
+						.VertexOffset = primitive.GetFirstVertex(),
+						.IndexType = static_cast<uint32_t>(primitive.GetIndexType()),
+					};
+				}
+
+				if (primitive.GetIndexType() == VK_INDEX_TYPE_UINT32)
+				{
+					m_WideDrawCount += mesh->GetInstanceCount();
+				}
+			}
+		}
+
+		m_DrawBuffer->Flush();
+
+		for (uint32_t i = 0; i < s_Data.MaxFrameCount; i++)
+		{
+			m_IndirectBuffers.push_back(Buffer::Create(BufferDescription::Defaults::IndirectBuffer,
+				IndirectCommandOffset + sizeof(VkDrawIndexedIndirectCommand) * std::max(1u, m_DrawCount)));
+		}
+	}
+
+	void RendererStage::Cull(VkCommandBuffer commandBuffer)
+	{
+		if (!m_GPUCulling) return;
+
+		HG_PROFILE_GPU_EVENT("Culling Pass");
+
+		const auto& indirectBuffer = m_IndirectBuffers[s_Data.FrameIndex];
+
+		vkCmdFillBuffer(commandBuffer, indirectBuffer->GetHandle(), 0, 2 * sizeof(uint32_t), 0);
+		BufferBarrier(commandBuffer, indirectBuffer->GetHandle(), VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT,
+			VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+
+		const CullingConstants constants = {
+			.FrustumPlanes = m_FrustumPlanes,
+			.DrawCount = m_DrawCount,
+			.DrawBuffer = m_DrawBuffer->GetGPUIndex(),
+			.InstanceBuffer = m_InstanceBufferIndex,
+			.IndirectBuffer = indirectBuffer->GetGPUIndex(),
+			.WideDrawOffset = m_DrawCount - m_WideDrawCount,
+		};
+
+		const auto& pipeline = s_Data.CullingPipeline;
+		VkDescriptorSet heap = BindlessHeap::GetDescriptorSet();
+
+		pipeline->Bind(commandBuffer);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline->GetPipelineLayout(), BindlessHeap::Set, 1, &heap, 0, nullptr);
+		vkCmdPushConstants(commandBuffer, pipeline->GetPipelineLayout(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+		vkCmdDispatch(commandBuffer, (m_DrawCount + 63) / 64, 1, 1);
+
+		// Culling is recorded on the main thread while the frame executes, after the recording jobs were collected
+		s_Data.Stats.PipelineBinds++;
+		s_Data.Stats.Dispatches++;
+
+		BufferBarrier(commandBuffer, indirectBuffer->GetHandle(), VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+			VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT, VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT);
+	}
+
+	void RendererStage::CreateDescriptorSetLayout()
 	{
-		VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
-		auto db = DescriptorBuilder::Begin(Renderer::GetDescriptorLayoutCache(), allocator);
-		std::vector<VkDescriptorImageInfo*> imageInfos;
-		std::vector<VkDescriptorBufferInfo*> bufferInfos;
-		std::vector<VkWriteDescriptorSetAccelerationStructureKHR*> acceleratrionStructureInfos;
+		std::vector<VkDescriptorSetLayoutBinding> bindings;
 
-		for (int i = 0; i < Info.Resources.size(); i++)
+		for (uint32_t i = 0; i < Info.Resources.size(); i++)
 		{
 			const auto& resource = Info.Resources[i];
+			VkDescriptorSetLayoutBinding binding = {
+				.binding = resource.Binding,
+				.descriptorCount = 1,
+				.stageFlags = resource.BindLocation,
+			};
 
-			switch(resource.Type)
+			switch (resource.Type)
 			{
-				case ResourceType::Sampler:
+				case ResourceType::Sampler: binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER; break;
+				case ResourceType::InputAttachment: binding.descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT; break;
+				case ResourceType::StorageImage: binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE; break;
+				case ResourceType::Storage:
+				case ResourceType::Uniform: binding.descriptorType = ToStageDescriptorType(resource.Buffer->GetBufferDescription()); break;
+				case ResourceType::FrameUniform: binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC; break;
+				case ResourceType::SamplerArray:
 				{
-					VkDescriptorImageInfo* sourceImage = new VkDescriptorImageInfo;
-					sourceImage->sampler = resource.Texture->GetSampler();
+					binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+					binding.descriptorCount = resource.ArrayMaxCount;
+				}break;
+				case ResourceType::AccelerationStructure: binding.descriptorType = VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR; break;
+				default: continue;
+			}
+
+			bindings.push_back(binding);
+
+			if (binding.descriptorType == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC)
+			{
+				m_DynamicResources.push_back(i);
+			}
+		}
+
+		// Dynamic offsets are consumed in binding order
+		std::sort(m_DynamicResources.begin(), m_DynamicResources.end(),
+			[this](uint32_t a, uint32_t b) { return Info.Resources[a].Binding < Info.Resources[b].Binding; });
+		m_DynamicOffsets.assign(m_DynamicResources.size(), 0);
 
-					sourceImage->imageView = resource.Texture->GetImageView();
-					sourceImage->imageLayout = resource.Texture->GetImageLayout();
-					imageInfos.push_back(sourceImage);
-					
-					db.BindImage(resource.Binding, imageInfos.back(), VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, resource.BindLocation);
+		VkDescriptorSetLayoutCreateInfo layoutInfo = {
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+			.bindingCount = static_cast<uint32_t>(bindings.size()),
+			.pBindings = bindings.data(),
+		};
+
+		m_DescriptorSetLayout = Renderer::GetDescriptorLayoutCache()->CreateDescriptorLayout(&layoutInfo);
+	}
+
+	void RendererStage::UpdateDescriptorSet()
+	{
+		// The key holds everything the writes below depend on, the vector keeps its capacity from frame to frame
+		m_DescriptorKey.clear();
+		m_DescriptorKey.push_back(DescriptorSetCache::ToKey(m_DescriptorSetLayout));
+
+		for (const auto& resource : Info.Resources)
+		{
+			switch (resource.Type)
+			{
+				case ResourceType::Sampler:
+				{
+					m_DescriptorKey.push_back(DescriptorSetCache::ToKey(resource.Texture->GetSampler()));
+					m_DescriptorKey.push_back(DescriptorSetCache::ToKey(resource.Texture->GetImageView()));
+					m_DescriptorKey.push_back(resource.Texture->GetImageLayout());
+				}break;
+				case ResourceType::InputAttachment:
+				{
+					m_DescriptorKey.push_back(DescriptorSetCache::ToKey(resource.Texture->GetImageView()));
 				}break;
 				case ResourceType::StorageImage:
 				{
-					VkDescriptorImageInfo* sourceImage = new VkDescriptorImageInfo;
-					sourceImage->imageView = resource.StorageImage->GetImageView();
-					sourceImage->imageLayout = resource.StorageImage->GetImageLayout();
-					imageInfos.push_back(sourceImage);
-
-					db.BindImage(resource.Binding, imageInfos.back(), VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, resource.BindLocation);
+					m_DescriptorKey.push_back(DescriptorSetCache::ToKey(resource.StorageImage->GetImageView()));
+					m_DescriptorKey.push_back(resource.StorageImage->GetImageLayout());
 				}break;
 				case ResourceType::Storage:
+				case ResourceType::Uniform:
+				{
+					m_DescriptorKey.push_back(DescriptorSetCache::ToKey(resource.Buffer->GetHandle()));
+				}break;
+				case ResourceType::FrameUniform:
 				{
-					VkDescriptorBufferInfo* bufferInfo = new VkDescriptorBufferInfo;
-					bufferInfo->buffer = resource.Buffer->GetHandle();
-					bufferInfo->offset = 0;
-					bufferInfo->range = VK_WHOLE_SIZE;
-					bufferInfos.push_back(bufferInfo);
+					m_DescriptorKey.push_back(DescriptorSetCache::ToKey(s_Data.FrameAllocator.GetBuffer()->GetHandle()));
+					m_DescriptorKey.push_back(resource.ConstantSize);
+				}break;
+				case ResourceType::SamplerArray:
+				{
+					m_DescriptorKey.push_back(resource.Textures.size());
+					for (const auto& texture : resource.Textures)
+					{
+						m_DescriptorKey.push_back(DescriptorSetCache::ToKey(texture->GetSampler()));
+						m_DescriptorKey.push_back(DescriptorSetCache::ToKey(texture->GetImageView()));
+						m_DescriptorKey.push_back(texture->GetImageLayout());
+					}
+				}break;
+				case ResourceType::AccelerationStructure:
+				{
+					m_DescriptorKey.push_back(DescriptorSetCache::ToKey(*resource.TLAS->GetHandlePtr()));
+				}break;
+				default: break;
+			}
+		}
+
+		// Nothing bound to the stage changed since the last frame
+		if (m_DescriptorSet != VK_NULL_HANDLE && m_DescriptorKey == m_BoundDescriptorKey) return;
 
-					db.BindBuffer(resource.Binding, bufferInfos.back(), resource.Buffer->GetBufferDescription(), resource.BindLocation);
+		m_DescriptorSet = s_Data.DescriptorSetCache.Get(m_DescriptorSetLayout, m_DescriptorKey,
+			[this](DescriptorWriter& writer) { WriteDescriptorSet(writer); });
+		m_BoundDescriptorKey = m_DescriptorKey;
+	}
+
+	void RendererStage::WriteDescriptorSet(DescriptorWriter& writer) const
+	{
+		for (const auto& resource : Info.Resources)
+		{
+			switch(resource.Type)
+			{
+				case ResourceType::Sampler:
+				{
+					writer.WriteImage(resource.Binding, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+						resource.Texture->GetSampler(), resource.Texture->GetImageView(), resource.Texture->GetImageLayout());
+				}break;
+				case ResourceType::InputAttachment:
+				{
+					// Input attachments are read in the layout of the subpass, which the render pass transitions them to
+					writer.WriteImage(resource.Binding, VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT,
+						VK_NULL_HANDLE, resource.Texture->GetImageView(), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+				}break;
+				case ResourceType::StorageImage:
+				{
+					writer.WriteImage(resource.Binding, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+						VK_NULL_HANDLE, resource.StorageImage->GetImageView(), resource.StorageImage->GetImageLayout());
 				}break;
+				case ResourceType::Storage:
 				case ResourceType::Uniform:
 				{
-					VkDescriptorBufferInfo* bufferInfo = new VkDescriptorBufferInfo;
-					bufferInfo->buffer = resource.Buffer->GetHandle();
-					bufferInfo->offset = 0;
-					bufferInfo->range = VK_WHOLE_SIZE;
-					bufferInfos.push_back(bufferInfo);
-
-					db.BindBuffer(resource.Binding, bufferInfos.back(), resource.Buffer->GetBufferDescription(), resource.BindLocation);
+					writer.WriteBuffer(resource.Binding, ToStageDescriptorType(resource.Buffer->GetBufferDescription()), resource.Buffer->GetHandle());
+				}break;
+				case ResourceType::FrameUniform:
+				{
+					// The range covers one copy of the data, the dynamic offset picks the copy of the current frame
+					writer.WriteBuffer(resource.Binding, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+						s_Data.FrameAllocator.GetBuffer()->GetHandle(), 0, resource.ConstantSize);
 				}break;
 				case ResourceType::PushConstant: break;
 				case ResourceType::Constant: break;
 				case ResourceType::SamplerArray:
 				{
-					VkDescriptorImageInfo* imageInfosLocal = new VkDescriptorImageInfo[resource.Textures.size()];
-					for (int i = 0; i < resource.Textures.size(); ++i)
+					writer.WriteImageArray(resource.Binding, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+					for (const auto& texture : resource.Textures)
 					{
-						imageInfosLocal[i].sampler = resource.Textures[i]->GetSampler();
-
-						imageInfosLocal[i].imageView = resource.Textures[i]->GetImageView();
-						imageInfosLocal[i].imageLayout = resource.Textures[i]->GetImageLayout();
+						writer.WriteImage(resource.Binding, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+							texture->GetSampler(), texture->GetImageView(), texture->GetImageLayout());
 					}
-
-					imageInfos.push_back(imageInfosLocal);
-
-					db.BindImage(resource.Binding, imageInfos.back(), VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, resource.BindLocation, resource.Textures.size(), resource.ArrayMaxCount);
 				}break;
 				case ResourceType::AccelerationStructure:
 				{
-					VkWriteDescriptorSetAccelerationStructureKHR* accelerationStructureInfo = new VkWriteDescriptorSetAccelerationStructureKHR;
-					accelerationStructureInfo->sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET_ACCELERATION_STRUCTURE_KHR;
-					accelerationStructureInfo->pNext = nullptr;
-					accelerationStructureInfo->accelerationStructureCount = 1;
-					accelerationStructureInfo->pAccelerationStructures = resource.TLAS->GetHandlePtr();
-
-					acceleratrionStructureInfos.push_back(accelerationStructureInfo);
-
-					db.BindAccelerationStructure(resource.Binding, acceleratrionStructureInfos.back(), VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR, resource.BindLocation);
+					writer.WriteAccelerationStructure(resource.Binding, resource.TLAS->GetHandlePtr());
 				}break;
 			}
 		}
+	}
 
-		db.Build(descriptorSet);
+	void RendererStage::UpdateDynamicOffsets()
+	{
+		for (size_t i = 0; i < m_DynamicResources.size(); i++)
+		{
+			const ResourceElement& resource = Info.Resources[m_DynamicResources[i]];
+			if (resource.Type != ResourceType::FrameUniform) continue;
 
-		vkCmdBindDescriptorSets(commandBuffer, ToPipelineBindPoint(Info.StageType), Info.Pipeline->GetPipelineLayout(),
-			0, 1, &descriptorSet, 0, nullptr);
+			auto allocation = s_Data.FrameAllocator.Allocate(resource.ConstantSize);
+			memcpy(allocation.Data, resource.ConstantDataPointer, resource.ConstantSize);
+			m_DynamicOffsets[i] = static_cast<uint32_t>(allocation.Offset);
 
-		for (size_t i = 0; i < imageInfos.size(); i++)
-		{
-			delete imageInfos[i];
+			s_Data.Stats.BytesUploaded += resource.ConstantSize;
 		}
+	}
 
-		for (size_t i = 0; i < bufferInfos.size(); i++)
-		{
-			delete bufferInfos[i];
-		}
-		
-		for (size_t i = 0; i < acceleratrionStructureInfos.size(); i++)
-		{
-			delete acceleratrionStructureInfos[i];
-		}
+	void RendererStage::BindResources(VkCommandBuffer commandBuffer)
+	{
+		static_assert(BindlessHeap::Set == 1, "The bindless heap is bound right after the stage's own set");
+
+		// Secondary command buffers start without any bound sets, so the heap comes along with every stage set
+		std::array<VkDescriptorSet, 2> descriptorSets = { m_DescriptorSet, BindlessHeap::GetDescriptorSet() };
+		vkCmdBindDescriptorSets(commandBuffer, ToPipelineBindPoint(Info.StageType), Info.Pipeline->GetPipelineLayout(),
+			0, static_cast<uint32_t>(descriptorSets.size()), descriptorSets.data(),
+			static_cast<uint32_t>(m_DynamicOffsets.size()), m_DynamicOffsets.data());
 	}
 }
@@ -5,6 +5,9 @@
 #include "Hog/Renderer/FrameBuffer.h"
 #include "Hog/Renderer/Descriptor.h"
 #include "Hog/Renderer/GraphicsContext.h"
+#include "Hog/Renderer/BarrierBatch.h"
+#include "Hog/Core/ThreadPool.h"
+#include "Hog/Core/RollingStatistic.h"
 
 namespace Hog
 {
@@ -18,52 +21,278 @@ namespace Hog
 
 		struct RendererStats
 		{
+			// Counted by pipeline statistics queries when renderer.pipelineStatistics is enabled. Fragment invocations over
+			// the pixels of the target give the overdraw, clipping primitives over clipping invocations what survived clipping.
+			struct PipelineStatistics
+			{
+				uint64_t InputAssemblyVertices = 0;
+				uint64_t InputAssemblyPrimitives = 0;
+				uint64_t VertexShaderInvocations = 0;
+				uint64_t ClippingInvocations = 0;
+				uint64_t ClippingPrimitives = 0;
+				uint64_t FragmentShaderInvocations = 0;
+				uint64_t ComputeShaderInvocations = 0;
+			};
+
+			struct StageStats
+			{
+				std::string Name;
+				// CPU time spent preparing the stage and recording it, summed over its recording jobs, in milliseconds
+				float RecordingTime = 0.0f;
+				// GPU time between the timestamps written around the stage, in milliseconds. A stage owning a render pass
+				// includes the stages running as its subpasses, which report no time of their own.
+				float GPUTime = 0.0f;
+				// Read back along with the GPU time. Stages on the async compute queue only count compute invocations.
+				PipelineStatistics Statistics;
+			};
+
 			uint64_t FrameCount = 0;
+			// CPU time the last frame waited for its frame context to be done on the GPU and for a swapchain image, in milliseconds
+			float FrameWaitTime = 0.0f;
+			// CPU time spent preparing and recording the stages of the last frame, in milliseconds
+			float RecordingTime = 0.0f;
+			// GPU time from the first stage starting to the last one finishing, in milliseconds. The GPU times are read back
+			// once the frame context is used again, so they describe the frame renderer.frameCount frames before this one.
+			float GPUTime = 0.0f;
+			// Commands recorded during the last frame. A GPU culled stage counts its indirect draw as a single draw call,
+			// the instances and triangles it ends up drawing are only known on the GPU.
+			uint32_t DrawCalls = 0;
+			uint32_t Dispatches = 0;
+			uint32_t Instances = 0;
+			uint64_t Triangles = 0;
+			uint32_t PipelineBinds = 0;
+			// Vertex and index buffer binds recorded during the last frame
+			uint32_t BufferBinds = 0;
+			uint32_t Barriers = 0;
+			// Descriptor sets allocated and written during the last frame, zero as long as the resources bound to the stages stay the same
+			uint32_t DescriptorSetWrites = 0;
+			// Descriptors the bindless heap wrote for resources created since the previous frame
+			uint32_t BindlessWrites = 0;
+			// Bytes written to buffers, immediate submits and upload batch submits since the previous frame, including the
+			// ones outside of Draw
+			uint64_t BytesUploaded = 0;
+			uint32_t ImmediateSubmits = 0;
+			uint32_t UploadSubmits = 0;
+			// Meshes the CPU frustum culling kept and skipped during the last frame, summed over all stages
+			uint32_t VisibleMeshes = 0;
+			uint32_t CulledMeshes = 0;
+			// Every stage of the render graph in plan order, stages that were not active last frame have a time of zero
+			std::vector<StageStats> Stages;
 		};
 
-		static RendererStats GetStats();
+		struct NamedStatistic
+		{
+			std::string Name;
+			RollingStatistic Statistic;
+		};
+
+		static const RendererStats& GetStats();
+		// Rolling window over the stats of the last frames, the stage recording times are listed under the names of their stages
+		// and their GPU times under the stage names followed by " GPU"
+		static const std::vector<NamedStatistic>& GetStatsHistory();
+		static RollingStatistic::Summary GetStatSummary(const std::string& name);
+		// Shows the stats history in an ImGui window, has to be called between the ImGui layer's Begin and End
+		static void DrawStatsOverlay();
 	};
 
+	// Command pool used by a single recording thread of a single frame. Secondary command buffers
+	// are allocated on demand and handed out again after every reset.
+	class ThreadCommandPool
+	{
+	public:
+		void Init(uint32_t queueFamily);
+		void Reset();
+		VkCommandBuffer Allocate();
+		void Cleanup();
+	private:
+		VkCommandPool m_CommandPool = VK_NULL_HANDLE;
+		std::vector<VkCommandBuffer> m_CommandBuffers;
+		uint32_t m_UsedCount = 0;
+	};
+
+	// Context of one frame in flight. There are renderer.frameCount of them, independent of the number of swapchain images,
+	// and a frame only waits for the GPU to finish the work it submitted renderer.frameCount frames ago.
 	class RendererFrame
 	{
 	public:
 		void Init();
-		void Init(Ref<Image> swapchainImage, VkRenderPass renderPass);
+		void InitThreadCommandPools(uint32_t threadCount);
+		// Waits until the frame context is free again and acquires the swapchain image the frame renders to
 		void BeginFrame();
+		// Only frames with async compute stages record and submit async compute work, which runs alongside the graphics work
+		void BeginAsyncCompute();
+		void SubmitAsyncCompute();
+		// Submits the graphics work recorded so far and continues in a command buffer that waits for the async compute work
+		void WaitForAsyncCompute();
 		void EndFrame();
+		// Writes timestamps and pipeline statistics queries around the work of a stage. BeginStageQueries returns the index
+		// to pass on to EndStageQueries, or InvalidQueries when no queries are enabled for the queue the stage runs on.
+		uint32_t BeginStageQueries(VkCommandBuffer commandBuffer, uint32_t stage, RenderQueue queue);
+		void EndStageQueries(VkCommandBuffer commandBuffer, uint32_t index);
 		void Cleanup();
 	public:
+		static constexpr uint32_t InvalidQueries = UINT32_MAX;
+
+		struct StageQueries
+		{
+			uint32_t Stage;
+			RenderQueue Queue;
+			bool Timestamps;
+			bool Statistics;
+		};
+
 		VkDevice Device = VK_NULL_HANDLE;
 		VkQueue Queue = VK_NULL_HANDLE;
+		VkQueue ComputeQueue = VK_NULL_HANDLE;
 		VkSwapchainKHR Swapchain = VK_NULL_HANDLE;
 		VkCommandPool CommandPool = VK_NULL_HANDLE;
 		VkCommandBuffer CommandBuffer = VK_NULL_HANDLE;
-		VkFence Fence = VK_NULL_HANDLE;
+		VkCommandBuffer LateCommandBuffer = VK_NULL_HANDLE;
+		VkCommandPool ComputeCommandPool = VK_NULL_HANDLE;
+		VkCommandBuffer ComputeCommandBuffer = VK_NULL_HANDLE;
+		// Secondary command buffers have to come from a pool of the queue family they get executed on
+		std::vector<ThreadCommandPool> ThreadCommandPools;
+		std::vector<ThreadCommandPool> ComputeThreadCommandPools;
+		// Value the timeline semaphores are signaled to by the frame's submissions
+		uint64_t Serial = 0;
 		VkSemaphore PresentSemaphore = VK_NULL_HANDLE;
+		// Swapchain image acquired by the frame along with its framebuffer and render finished semaphore, which
+		// belong to the image since it is only presented again once it was acquired again
+		uint32_t ImageIndex = 0;
 		VkSemaphore RenderSemaphore = VK_NULL_HANDLE;
 		Ref<FrameBuffer> FrameBuffer;
-		DescriptorAllocator DescriptorAllocator;
 		Ref<Image> SwapchainImage;
+		// Two timestamps and one statistics query for every stage the frame executed, in the order of QueriedStages
+		VkQueryPool TimestampPool = VK_NULL_HANDLE;
+		VkQueryPool StatisticsPool = VK_NULL_HANDLE;
+		VkQueryPool ComputeStatisticsPool = VK_NULL_HANDLE;
+		std::vector<StageQueries> QueriedStages;
+	private:
+		void CleanupThreadCommandPools();
+		// Reads the queries of the frame context's previous frame into the stats, its work has to be done already
+		void ReadQueries();
+	private:
+		bool m_WaitsForAsyncCompute = false;
+		// Set when the frame signaled the compute timeline, so the next use of the frame context waits for it
+		bool m_SubmittedAsyncCompute = false;
+	};
+
+	// Commands a recording job recorded, summed up into the frame's stats once every job is done
+	struct RecordingCounters
+	{
+		uint32_t DrawCalls = 0;
+		uint32_t Dispatches = 0;
+		uint32_t Instances = 0;
+		uint64_t Triangles = 0;
+		uint32_t PipelineBinds = 0;
+		uint32_t BufferBinds = 0;
 	};
 
 	class RendererStage
 	{
 	public:
 		void Init();
+		// Resolves the stage's barriers and descriptors. Has to run on the main thread in plan order.
+		void Prepare();
+		// Records the stage into secondary command buffers on the worker threads, large mesh lists are split into several jobs
+		void Record(ThreadPool& threadPool, std::vector<ThreadCommandPool>& commandPools);
+		// Executes the recorded secondary command buffers together with the barriers of the stage. A stage that owns
+		// a render pass shared with the stages after it executes all of them, one subpass after the other.
 		void Execute(VkCommandBuffer commandBuffer);
+		// Adds the commands the recording jobs recorded this frame to the stats and returns the CPU time the stage took
+		float CollectStats(Renderer::RendererStats& stats) const;
 		void Cleanup();
 	public:
 		StageDescription Info;
+		StageBarriers Barriers;
+		StageSubpass Subpass;
 		VkRenderPass RenderPass = VK_NULL_HANDLE;
 		Ref<FrameBuffer> FrameBuffer;
 		std::vector<VkClearValue> ClearValues;
 	private:
-		void ForwardGraphics(VkCommandBuffer commandBuffer);
-		void ForwardCompute(VkCommandBuffer commandBuffer);
+		void CreateRenderPass();
+		void SetupDynamicRendering();
+		void BeginRendering(VkCommandBuffer commandBuffer);
+		RendererStage& GetSubpassStage(uint32_t subpass) const;
+		uint32_t GetRecordingJobCount() const;
+		Ref<Hog::FrameBuffer> GetTargetFrameBuffer() const;
+		void RecordJob(VkCommandBuffer commandBuffer, uint32_t job, RecordingCounters& counters);
+
+		void ForwardGraphics(VkCommandBuffer commandBuffer, uint32_t job, RecordingCounters& counters);
+		void ForwardCompute(VkCommandBuffer commandBuffer, RecordingCounters& counters);
 		void ImGui(VkCommandBuffer commandBuffer);
-		void BlitStage(VkCommandBuffer commandBuffer);
-		void RayTracing(VkCommandBuffer commandBuffer);
+		void BlitStage(VkCommandBuffer commandBuffer, RecordingCounters& counters);
+		void RayTracing(VkCommandBuffer commandBuffer, RecordingCounters& counters);
+
+		void CreateInstanceBuffers();
+		// Gathers the model matrix and material of every draw into the frame's instance buffer
+		void UpdateInstances();
+		// Frustum culls the stage's meshes on the CPU, for stages that are not culled on the GPU
+		void CullMeshes();
+		// Orders the visible primitives by their draw keys, so that draws sharing buffers follow each other
+		void SortDraws();
+		void CreateIndirectBuffers();
+		// Frustum culls the stage's draws on the GPU and compacts the visible ones into the frame's indirect buffer
+		void Cull(VkCommandBuffer commandBuffer);
+		void CreateDescriptorSetLayout();
+		// Looks up the descriptor set for the resources currently bound to the stage, only a new combination of them writes a set
+		void UpdateDescriptorSet();
+		void WriteDescriptorSet(DescriptorWriter& writer) const;
+		// Copies the stage's frame uniforms into the frame allocator and points their dynamic offsets at the copies
+		void UpdateDynamicOffsets();
+		void BindResources(VkCommandBuffer commandBuffer);
+	private:
+		BarrierBatch m_BarrierBatch;
+		BarrierBatch m_ReleaseBarrierBatch;
+		VkDescriptorSetLayout m_DescriptorSetLayout = VK_NULL_HANDLE;
+		VkDescriptorSet m_DescriptorSet = VK_NULL_HANDLE;
+		DescriptorSetCache::Key m_DescriptorKey;
+		DescriptorSetCache::Key m_BoundDescriptorKey;
+		// Resources bound as dynamic uniform buffers in binding order, with the offset each of them is bound at this frame
+		std::vector<uint32_t> m_DynamicResources;
+		std::vector<uint32_t> m_DynamicOffsets;
+		// One instance buffer per frame in flight, the draws find theirs through a push constant holding its bindless index
+		std::vector<Ref<Buffer>> m_InstanceBuffers;
+		int32_t m_InstanceBufferIndex = -1;
+		VkShaderStageFlags m_InstancePushStages = VK_SHADER_STAGE_VERTEX_BIT;
+		// Instance of the first primitive of every mesh
+		std::vector<uint32_t> m_MeshFirstInstance;
+		// GPU culled stages draw all of their primitives with an indirect draw per index width out of the shared geometry buffers
+		bool m_GPUCulling = false;
+		uint32_t m_DrawCount = 0;
+		// Draws of primitives with 32 bit indices, they get an indirect draw of their own
+		uint32_t m_WideDrawCount = 0;
+		Ref<Buffer> m_DrawBuffer;
+		// One indirect buffer per frame in flight, holding the draw counts followed by the draw commands
+		std::vector<Ref<Buffer>> m_IndirectBuffers;
+		std::array<glm::vec4, 6> m_FrustumPlanes;
+		// World space bounds of the meshes and whether they passed the CPU culling this frame
+		Math::BoundingBoxArray m_MeshBounds;
+		std::vector<uint8_t> m_MeshVisibility;
+
+		struct DrawItem
+		{
+			uint64_t Key;
+			uint32_t Mesh;
+			uint32_t Primitive;
+		};
 
-		void BindResources(VkCommandBuffer commandBuffer, DescriptorAllocator* allocator);
+		// Draws of the frame in key order, the recording jobs each take a range of them
+		std::vector<DrawItem> m_Draws;
+		std::vector<DrawItem> m_SortScratch;
+		// Index of the first mesh sharing a mesh's buffers, the buffer part of its draw keys
+		std::vector<uint32_t> m_MeshBufferKeys;
+		std::vector<VkCommandBuffer> m_CommandBuffers;
+		// What every recording job recorded and how long it took, each job only writes its own slot
+		std::vector<RecordingCounters> m_JobCounters;
+		std::vector<float> m_JobTimes;
+		float m_PrepareTime = 0.0f;
+		uint32_t m_MeshesPerJob = 1;
+		// Graphics stages render without render pass and framebuffer objects when dynamic rendering is enabled
+		bool m_DynamicRendering = false;
+		RenderingFormats m_RenderingFormats;
+		VkSampleCountFlagBits m_RenderingSamples = VK_SAMPLE_COUNT_1_BIT;
+		// Layouts the render pass leaves attachments in that differ from the ones the stage's barriers transition them to
+		std::vector<std::pair<Ref<Image>, VkImageLayout>> m_RenderPassLayouts;
 	};
-}
+}
\ No newline at end of file
@@ -15,6 +15,7 @@
 #include "Hog/Utils/Filesystem.h"
 #include "Hog/Utils/RendererUtils.h"
 #include "Hog/Renderer/GraphicsContext.h"
+#include "Hog/Renderer/BindlessHeap.h"
 #include "Hog/Debug/Instrumentor.h"
 
 AutoCVar_String CVar_ShaderCacheDBFile("shader.cacheDBFile", "Shader cache database filename", ".db", CVarFlags::EditReadOnly);
@@ -338,7 +339,7 @@ namespace Hog {
 
 					VkDescriptorSetLayoutBinding& layoutBinding = data.DescriptorSetLayoutBinding[refl_set.set][refl_binding.binding];
 					layoutBinding.binding = refl_binding.binding;
-					layoutBinding.descriptorType = static_cast<VkDescriptorType>(refl_binding.descriptor_type);
+					layoutBinding.descriptorType = ToStageDescriptorType(static_cast<VkDescriptorType>(refl_binding.descriptor_type));
 					layoutBinding.descriptorCount = 1;
 					for (uint32_t i_dim = 0; i_dim < refl_binding.array.dims_count; ++i_dim) {
 						layoutBinding.descriptorCount *= refl_binding.array.dims[i_dim];
@@ -416,6 +417,13 @@ namespace Hog {
 
 		for (int i = 0; i < data.DescriptorSetLayoutBinding.size(); ++i)
 		{
+			// Every pipeline shares the layout of the bindless heap, whatever part of it the shaders declare
+			if (i == BindlessHeap::Set)
+			{
+				data.DescriptorSetLayouts[i] = BindlessHeap::GetLayout();
+				continue;
+			}
+
 			std::vector<VkDescriptorBindingFlags> bindingFlags(data.DescriptorSetLayoutBinding[i].size(), VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT);
 
 			VkDescriptorSetLayoutBindingFlagsCreateInfo layoutBindingFlags = {
@@ -3,6 +3,7 @@
 
 #include "Hog/Utils/RendererUtils.h"
 #include "Hog/Renderer/GraphicsContext.h"
+#include "Hog/Renderer/BindlessHeap.h"
 
 namespace Hog {
 	Ref<Texture> Texture::Create(Ref<Image> image, SamplerType samplerType)
@@ -40,10 +41,18 @@ namespace Hog {
 		samplerInfo.maxAnisotropy = GraphicsContext::GetGPUInfo()->DeviceProperties2.properties.limits.maxSamplerAnisotropy;
 
 		CheckVkResult(vkCreateSampler(GraphicsContext::GetDevice(), &samplerInfo, nullptr, &m_Sampler));
+
+		if (m_Image->GetDescription().ImageUsageFlags & VK_IMAGE_USAGE_SAMPLED_BIT)
+		{
+			m_GPUIndex = static_cast<int32_t>(BindlessHeap::RegisterSampledImage(m_Image.get(), m_Sampler));
+		}
 	}
 
 	Texture::~Texture()
 	{
+		if (m_GPUIndex != -1)
+			BindlessHeap::Release(BindlessHeap::SampledImages, m_GPUIndex);
+
 		if (m_Sampler)
 			vkDestroySampler(GraphicsContext::GetDevice(), m_Sampler, nullptr);
 	}
@@ -27,7 +27,7 @@ namespace Hog {
 		VkImageView GetImageView() { return m_Image->GetImageView(); }
 		VkImageLayout GetImageLayout() { return m_Image->GetImageLayout(); }
 		VkFormat GetFormat() const { return m_Image->GetFormat(); }
-		void SetGPUIndex(int32_t ind) { m_GPUIndex = ind; }
+		// Index of the texture in the sampled image array of the bindless heap, -1 for images without sampled usage
 		int32_t GetGPUIndex() const { return m_GPUIndex; }
 		Ref<Image> GetImage() { return m_Image; }
 		VkSampleCountFlagBits GetSamples() const { return m_Image->GetSamples(); }
@@ -37,6 +37,6 @@ namespace Hog {
 		Ref<Image> m_Image;
 		VkSampler m_Sampler;
 		SamplerType m_SamplerType;
-		int32_t m_GPUIndex = 0;
+		int32_t m_GPUIndex = -1;
 	};
 }
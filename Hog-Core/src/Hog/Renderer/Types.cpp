@@ -65,6 +65,15 @@ namespace Hog
 			DescriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
 		}break;
 
+		case Defaults::StorageBuffer:
+		{
+			MemoryUsage = VMA_MEMORY_USAGE_AUTO;
+			AllocationCreateFlags = VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT;
+
+			BufferUsageFlags = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+			DescriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		}break;
+
 		case Defaults::ReadbackStorageBuffer:
 		{
 			MemoryUsage = VMA_MEMORY_USAGE_AUTO;
@@ -78,6 +87,17 @@ namespace Hog
 			DescriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
 		}break;
 
+		case Defaults::IndirectBuffer:
+		{
+			MemoryUsage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
+
+			BufferUsageFlags = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+				VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+				VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+
+			DescriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		}break;
+
 		case Defaults::AccelerationStructureBuildInput:
 		{
 			MemoryUsage = VMA_MEMORY_USAGE_AUTO;
@@ -114,6 +134,15 @@ namespace Hog
 
 			BufferUsageFlags = VK_BUFFER_USAGE_SHADER_BINDING_TABLE_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
 		}break;
+
+		case Defaults::TransientBuffer:
+		{
+			MemoryUsage = VMA_MEMORY_USAGE_AUTO;
+			AllocationCreateFlags = VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT;
+
+			BufferUsageFlags = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+			DescriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+		}break;
 		}
 	}
 
@@ -322,28 +351,28 @@ namespace Hog
 
 			case Defaults::SampledHDRColorAttachment:
 			{
-				ImageUsageFlags = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+				ImageUsageFlags = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
 				ImageAspectFlags = VK_IMAGE_ASPECT_COLOR_BIT;
 				Format = VK_FORMAT_R16G16B16A16_SFLOAT;
 			}break;
 
 			case Defaults::SampledColorAttachment:
 			{
-				ImageUsageFlags = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+				ImageUsageFlags = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
 				ImageAspectFlags = VK_IMAGE_ASPECT_COLOR_BIT;
 				Format = VK_FORMAT_R8G8B8A8_UNORM;
 			}break;
 			
 			case Defaults::SampledPositionAttachment:
 			{
-				ImageUsageFlags = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+				ImageUsageFlags = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
 				ImageAspectFlags = VK_IMAGE_ASPECT_COLOR_BIT;
 				Format = VK_FORMAT_R16G16B16A16_SFLOAT;
 			}break;
 
 			case Defaults::SampledNormalAttachment:
 			{
-				ImageUsageFlags = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+				ImageUsageFlags = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
 				ImageAspectFlags = VK_IMAGE_ASPECT_COLOR_BIT;
 				Format = VK_FORMAT_R16G16B16A16_SFLOAT;
 			}break;
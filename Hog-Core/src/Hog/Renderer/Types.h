@@ -270,7 +270,6 @@ namespace Hog
 	vec2f TexCoords;
 	vec3f Normal;
 	vec4f Tangent;
-	int32 MaterialIndex;
 	*/
 
 
@@ -280,7 +279,43 @@ namespace Hog
 		glm::vec2 TexCoords;
 		glm::vec3 Normal;
 		glm::vec4 Tangent;
-		int32_t MaterialIndex;
+	};
+
+	// Vertex format of the shared geometry buffer when renderer.geometry.compactVertices is set, built from a Vertex
+	// when the primitive is uploaded. Positions are snorm within the primitive's bounds, its draws carry the offset and
+	// scale that undo it. Normals and tangents are octahedral encoded and the sign of the tangent's w goes into the
+	// position's w.
+	struct CompactVertex
+	{
+		int16_t Position[4];
+		// Half floats
+		uint16_t TexCoords[2];
+		int16_t Normal[2];
+		int16_t Tangent[2];
+	};
+
+	// Per draw data of a mesh stage, the renderer gathers it into a storage buffer every frame and every draw
+	// reads its own entry through gl_InstanceIndex
+	struct alignas(16) InstanceData
+	{
+		glm::mat4 Model = glm::mat4(1.0f);
+		// Local space position of a vertex is PositionOffset + PositionScale * its position, which only changes
+		// anything for compact vertices
+		glm::vec3 PositionOffset = glm::vec3(0.0f);
+		int32_t MaterialIndex = -1;
+		glm::vec3 PositionScale = glm::vec3(1.0f);
+	};
+
+	// Per primitive input of the GPU culling pass, laid out like DrawData in Culling.compute
+	struct alignas(16) IndirectDrawData
+	{
+		glm::vec3 BoundsMin;
+		uint32_t IndexCount;
+		glm::vec3 BoundsMax;
+		uint32_t FirstIndex;
+		int32_t VertexOffset;
+		// VK_INDEX_TYPE_UINT16 or VK_INDEX_TYPE_UINT32
+		uint32_t IndexType;
 	};
 
 	struct BufferDescription
@@ -294,11 +329,14 @@ namespace Hog
 			VertexBuffer,
 			IndexBuffer,
 			UniformBuffer,
+			StorageBuffer,
 			ReadbackStorageBuffer,
+			IndirectBuffer,
 			AccelerationStructureBuildInput,
 			AccelerationStructure,
 			AccelerationStructureScratchBuffer,
 			ShaderBindingTable,
+			TransientBuffer,
 		};
 
 		VmaMemoryUsage MemoryUsage = VMA_MEMORY_USAGE_AUTO;
@@ -489,9 +527,19 @@ namespace Hog
 		Color, Depth, DepthStencil, Swapchain
 	};
 
+	// InputAttachment reads the texel of the current fragment from an image an earlier stage rendered to. Its
+	// input_attachment_index is the order of the stage's InputAttachment resources, and it lets the render graph
+	// merge the stage into the render pass of the stage that writes the image.
 	enum class ResourceType
 	{
-		Uniform, Constant, PushConstant, Storage, StorageImage, Sampler, SamplerArray, AccelerationStructure
+		Uniform, Constant, PushConstant, Storage, StorageImage, Sampler, SamplerArray, AccelerationStructure, InputAttachment,
+		// Uniform data copied from application memory into the renderer's frame allocator every frame
+		FrameUniform
+	};
+
+	enum class ResourceAccess
+	{
+		Read, Write, ReadWrite
 	};
 
 	enum class RendererStageType
@@ -499,6 +547,11 @@ namespace Hog
 		ForwardCompute, DeferredCompute, ForwardGraphics, DeferredGraphics, Blit, ImGui, Barrier, ScreenSpacePass, RayTracing
 	};
 
+	enum class RenderQueue
+	{
+		Graphics, AsyncCompute
+	};
+
 	static inline VkPipelineBindPoint ToPipelineBindPoint(RendererStageType type)
 	{
 		switch (type)
@@ -514,6 +567,13 @@ namespace Hog
 		return (VkPipelineBindPoint)0;
 	}
 
+	// Uniform buffers of the stage sets are always bound with a dynamic offset, so per frame data can move
+	// through the frame allocator without writing new descriptors. Static uniform buffers use an offset of zero.
+	static inline VkDescriptorType ToStageDescriptorType(VkDescriptorType type)
+	{
+		return type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC : type;
+	}
+
 	enum class PipelineStage : VkPipelineStageFlags2
 	{
 		None								= VK_PIPELINE_STAGE_2_NONE,
@@ -663,6 +723,36 @@ namespace Hog
 		return VK_ACCESS_2_NONE;
 	}
 
+	static inline VkPipelineStageFlags2 ToPipelineStageFlags(VkShaderStageFlags stages)
+	{
+		VkPipelineStageFlags2 flags = VK_PIPELINE_STAGE_2_NONE;
+
+		if (stages & VK_SHADER_STAGE_VERTEX_BIT)					flags |= VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT;
+		if (stages & VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT)		flags |= VK_PIPELINE_STAGE_2_TESSELLATION_CONTROL_SHADER_BIT;
+		if (stages & VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT)	flags |= VK_PIPELINE_STAGE_2_TESSELLATION_EVALUATION_SHADER_BIT;
+		if (stages & VK_SHADER_STAGE_GEOMETRY_BIT)					flags |= VK_PIPELINE_STAGE_2_GEOMETRY_SHADER_BIT;
+		if (stages & VK_SHADER_STAGE_FRAGMENT_BIT)					flags |= VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT;
+		if (stages & VK_SHADER_STAGE_COMPUTE_BIT)					flags |= VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+		if (stages & VK_SHADER_STAGE_TASK_BIT_NV)					flags |= VK_PIPELINE_STAGE_2_TASK_SHADER_BIT_NV;
+		if (stages & VK_SHADER_STAGE_MESH_BIT_NV)					flags |= VK_PIPELINE_STAGE_2_MESH_SHADER_BIT_NV;
+		if (stages & (VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_ANY_HIT_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR |
+			VK_SHADER_STAGE_MISS_BIT_KHR | VK_SHADER_STAGE_INTERSECTION_BIT_KHR | VK_SHADER_STAGE_CALLABLE_BIT_KHR))
+		{
+			flags |= VK_PIPELINE_STAGE_2_RAY_TRACING_SHADER_BIT_KHR;
+		}
+
+		return flags;
+	}
+
+	static inline VkAccessFlags2 GetWriteAccess(VkAccessFlags2 access)
+	{
+		constexpr VkAccessFlags2 writeAccess = VK_ACCESS_2_SHADER_WRITE_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT |
+			VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_2_TRANSFER_WRITE_BIT | VK_ACCESS_2_HOST_WRITE_BIT |
+			VK_ACCESS_2_MEMORY_WRITE_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT | VK_ACCESS_2_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+
+		return access & writeAccess;
+	}
+
 	struct BarrierDescription
 	{
 		enum class Defaults
@@ -0,0 +1,486 @@
+#include "hgpch.h"
+
+#include "UploadBatch.h"
+
+#include "Hog/Renderer/GraphicsContext.h"
+#include "Hog/Renderer/Buffer.h"
+#include "Hog/Renderer/Image.h"
+#include "Hog/Utils/RendererUtils.h"
+#include "Hog/Core/CVars.h"
+
+AutoCVar_Int CVar_StagingRingSize("renderer.stagingRingSize", "Size in bytes of the staging ring upload batches copy their data through", 64 * 1024 * 1024, CVarFlags::EditReadOnly);
+
+namespace Hog
+{
+	static size_t AlignUp(size_t value, size_t alignment)
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+
+	bool UploadFuture::IsReady() const
+	{
+		return UploadContext::GetCompletedValue() >= m_Value;
+	}
+
+	void UploadFuture::Wait() const
+	{
+		UploadContext::Wait(m_Value);
+	}
+
+	UploadBatch::~UploadBatch()
+	{
+		Submit();
+	}
+
+	void UploadBatch::WriteBuffer(Buffer& buffer, void* data, size_t size, size_t bufferOffset)
+	{
+		if (buffer.IsHostVisible())
+		{
+			buffer.WriteData(data, size, bufferOffset);
+			return;
+		}
+
+		VkBuffer stagingBuffer;
+		VkDeviceSize stagingOffset = Stage(data, size, stagingBuffer);
+
+		VkBufferCopy copy = {
+			.srcOffset = stagingOffset,
+			.dstOffset = bufferOffset,
+			.size = size,
+		};
+
+		vkCmdCopyBuffer(GetCommandBuffer(), stagingBuffer, buffer.GetHandle(), 1, &copy);
+
+		if (UploadContext::UsesTransferQueue() && std::find(m_Buffers.begin(), m_Buffers.end(), buffer.GetHandle()) == m_Buffers.end())
+			m_Buffers.push_back(buffer.GetHandle());
+	}
+
+	void UploadBatch::WriteBuffer(BufferRegion& region, void* data, size_t size, size_t regionOffset)
+	{
+		HG_CORE_ASSERT(regionOffset + size <= region.GetSize(), "Invalid write command. Tried to write more data then can fit region.");
+
+		WriteBuffer(*region.GetBuffer(), data, size, region.GetOffset() + regionOffset);
+	}
+
+	void UploadBatch::WriteImage(Image& image, void* data, size_t size)
+	{
+		VkBuffer stagingBuffer;
+		VkDeviceSize stagingOffset = Stage(data, size, stagingBuffer);
+
+		// The levels are generated with blits, which the transfer queue can not record
+		if (UploadContext::UsesTransferQueue())
+		{
+			image.RecordCopy(GetCommandBuffer(), stagingBuffer, stagingOffset);
+			m_Images.push_back(&image);
+		}
+		else
+		{
+			image.RecordUpload(GetCommandBuffer(), stagingBuffer, stagingOffset);
+		}
+
+		image.SetImageLayout(VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	}
+
+	UploadFuture UploadBatch::Submit()
+	{
+		if (IsEmpty()) return UploadFuture(m_LastSubmission);
+
+		if (UploadContext::UsesTransferQueue())
+		{
+			// Releases every written resource to the graphics queue family, RecordAcquires records the matching half
+			std::vector<VkBufferMemoryBarrier2> bufferBarriers;
+			bufferBarriers.reserve(m_Buffers.size());
+			for (VkBuffer buffer : m_Buffers)
+			{
+				bufferBarriers.push_back({
+					.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2,
+					.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT,
+					.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+					.srcQueueFamilyIndex = GraphicsContext::GetTransferQueueFamily(),
+					.dstQueueFamilyIndex = GraphicsContext::GetQueueFamily(),
+					.buffer = buffer,
+					.offset = 0,
+					.size = VK_WHOLE_SIZE,
+				});
+			}
+
+			std::vector<VkImageMemoryBarrier2> imageBarriers;
+			imageBarriers.reserve(m_Images.size());
+			for (Image* image : m_Images)
+			{
+				imageBarriers.push_back({
+					.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+					.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT,
+					.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+					.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+					.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+					.srcQueueFamilyIndex = GraphicsContext::GetTransferQueueFamily(),
+					.dstQueueFamilyIndex = GraphicsContext::GetQueueFamily(),
+					.image = image->GetHandle(),
+					.subresourceRange = { image->GetDescription().ImageAspectFlags, 0, image->GetLevelCount(), 0, 1 },
+				});
+			}
+
+			VkDependencyInfo dependencyInfo = {
+				.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+				.bufferMemoryBarrierCount = static_cast<uint32_t>(bufferBarriers.size()),
+				.pBufferMemoryBarriers = bufferBarriers.data(),
+				.imageMemoryBarrierCount = static_cast<uint32_t>(imageBarriers.size()),
+				.pImageMemoryBarriers = imageBarriers.data(),
+			};
+
+			vkCmdPipelineBarrier2(m_CommandBuffer, &dependencyInfo);
+		}
+		else
+		{
+			// One barrier for every buffer copy of the batch, images already transitioned themselves
+			VkMemoryBarrier2 barrier = {
+				.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+				.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT,
+				.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+				.dstStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+				.dstAccessMask = VK_ACCESS_2_MEMORY_READ_BIT,
+			};
+
+			VkDependencyInfo dependencyInfo = {
+				.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+				.memoryBarrierCount = 1,
+				.pMemoryBarriers = &barrier,
+			};
+
+			vkCmdPipelineBarrier2(m_CommandBuffer, &dependencyInfo);
+		}
+
+		m_LastSubmission = UploadContext::Get().Submit(this, m_CommandBuffer, std::move(m_DedicatedBuffers), std::move(m_Buffers), std::move(m_Images));
+		m_DedicatedBuffers.clear();
+		m_Buffers.clear();
+		m_Images.clear();
+		m_CommandBuffer = VK_NULL_HANDLE;
+
+		return UploadFuture(m_LastSubmission);
+	}
+
+	VkDeviceSize UploadBatch::Stage(void* data, size_t size, VkBuffer& stagingBuffer)
+	{
+		auto& context = UploadContext::Get();
+
+		// Data that could never fit the ring gets a buffer of its own, released with the submission. So does the data of
+		// a batch recorded while another one holds unsubmitted ring space.
+		if (size >= context.m_RingSize || !context.CanStageInRing(this))
+		{
+			auto buffer = Buffer::Create(BufferDescription::Defaults::TransferSourceBuffer, size);
+			buffer->WriteData(data, size);
+			stagingBuffer = buffer->GetHandle();
+			m_DedicatedBuffers.push_back(buffer);
+
+			return 0;
+		}
+
+		VkDeviceSize offset;
+		while (!context.AllocateStaging(size, offset))
+		{
+			if (context.HasSubmissionsInFlight())
+			{
+				context.WaitForOldestSubmission();
+			}
+			else if (context.m_RingOwner == this)
+			{
+				// The batch's own copies fill the ring, they have to be submitted before their space can be reused
+				Submit();
+			}
+			else
+			{
+				HG_CORE_CRITICAL("Staging ring has no room for {} bytes and nothing left to free", size);
+				std::abort();
+			}
+		}
+
+		context.m_RingOwner = this;
+		context.m_Ring->WriteData(data, size, offset);
+		stagingBuffer = context.m_Ring->GetHandle();
+
+		return offset;
+	}
+
+	VkCommandBuffer UploadBatch::GetCommandBuffer()
+	{
+		if (m_CommandBuffer == VK_NULL_HANDLE)
+			m_CommandBuffer = UploadContext::Get().BeginCommandBuffer();
+
+		return m_CommandBuffer;
+	}
+
+	void UploadContext::InitializeImpl()
+	{
+		m_RingSize = static_cast<size_t>(CVar_StagingRingSize.Get());
+		m_Ring = Buffer::Create(BufferDescription::Defaults::TransferSourceBuffer, m_RingSize);
+		m_Head = 0;
+		m_Tail = 0;
+		m_SubmittedHead = 0;
+		m_RingOwner = nullptr;
+
+		if (GraphicsContext::GetTransferQueue() != VK_NULL_HANDLE)
+		{
+			m_Queue = GraphicsContext::GetTransferQueue();
+			m_QueueFamily = GraphicsContext::GetTransferQueueFamily();
+		}
+		else
+		{
+			m_Queue = GraphicsContext::GetQueue();
+			m_QueueFamily = GraphicsContext::GetQueueFamily();
+		}
+
+		m_CommandPool = GraphicsContext::CreateCommandPool(m_QueueFamily);
+		m_Timeline = GraphicsContext::CreateTimelineSemaphore(0);
+		m_Value = 0;
+	}
+
+	void UploadContext::DeinitializeImpl()
+	{
+		WaitImpl(m_Value);
+		Retire();
+
+		m_PendingAcquires.clear();
+		m_FreeCommandBuffers.clear();
+		vkDestroyCommandPool(GraphicsContext::GetDevice(), m_CommandPool, nullptr);
+		vkDestroySemaphore(GraphicsContext::GetDevice(), m_Timeline, nullptr);
+		m_Ring.reset();
+	}
+
+	uint64_t UploadContext::GetCompletedValueImpl()
+	{
+		uint64_t value;
+		CheckVkResult(vkGetSemaphoreCounterValue(GraphicsContext::GetDevice(), m_Timeline, &value));
+
+		return value;
+	}
+
+	void UploadContext::WaitImpl(uint64_t value)
+	{
+		const VkSemaphoreWaitInfo waitInfo = {
+			.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+			.semaphoreCount = 1,
+			.pSemaphores = &m_Timeline,
+			.pValues = &value,
+		};
+
+		CheckVkResult(vkWaitSemaphores(GraphicsContext::GetDevice(), &waitInfo, UINT64_MAX));
+	}
+
+	bool UploadContext::UsesTransferQueueImpl() const
+	{
+		return m_QueueFamily != GraphicsContext::GetQueueFamily();
+	}
+
+	void UploadContext::RecordAcquiresImpl(VkCommandBuffer commandBuffer)
+	{
+		if (m_PendingAcquires.empty()) return;
+
+		uint64_t completed = GetCompletedValueImpl();
+		if (m_PendingAcquires.front().Value > completed) return;
+
+		std::vector<VkBufferMemoryBarrier2> bufferBarriers;
+		std::vector<VkImageMemoryBarrier2> imageBarriers;
+		std::vector<Image*> images;
+
+		while (!m_PendingAcquires.empty() && m_PendingAcquires.front().Value <= completed)
+		{
+			auto& acquire = m_PendingAcquires.front();
+
+			for (VkBuffer buffer : acquire.Buffers)
+			{
+				bufferBarriers.push_back({
+					.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2,
+					.dstStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+					.dstAccessMask = VK_ACCESS_2_MEMORY_READ_BIT,
+					.srcQueueFamilyIndex = m_QueueFamily,
+					.dstQueueFamilyIndex = GraphicsContext::GetQueueFamily(),
+					.buffer = buffer,
+					.offset = 0,
+					.size = VK_WHOLE_SIZE,
+				});
+			}
+
+			for (Image* image : acquire.Images)
+			{
+				imageBarriers.push_back({
+					.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+					.dstStageMask = VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT,
+					.dstAccessMask = VK_ACCESS_2_TRANSFER_READ_BIT | VK_ACCESS_2_TRANSFER_WRITE_BIT,
+					.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+					.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+					.srcQueueFamilyIndex = m_QueueFamily,
+					.dstQueueFamilyIndex = GraphicsContext::GetQueueFamily(),
+					.image = image->GetHandle(),
+					.subresourceRange = { image->GetDescription().ImageAspectFlags, 0, image->GetLevelCount(), 0, 1 },
+				});
+
+				images.push_back(image);
+			}
+
+			m_PendingAcquires.pop_front();
+		}
+
+		VkDependencyInfo dependencyInfo = {
+			.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+			.bufferMemoryBarrierCount = static_cast<uint32_t>(bufferBarriers.size()),
+			.pBufferMemoryBarriers = bufferBarriers.data(),
+			.imageMemoryBarrierCount = static_cast<uint32_t>(imageBarriers.size()),
+			.pImageMemoryBarriers = imageBarriers.data(),
+		};
+
+		vkCmdPipelineBarrier2(commandBuffer, &dependencyInfo);
+
+		for (Image* image : images)
+		{
+			image->RecordMipGeneration(commandBuffer);
+		}
+	}
+
+	void UploadContext::AcquireAllImpl()
+	{
+		if (m_PendingAcquires.empty()) return;
+
+		WaitImpl(m_PendingAcquires.back().Value);
+
+		GraphicsContext::ImmediateSubmit([this](VkCommandBuffer commandBuffer)
+		{
+			RecordAcquiresImpl(commandBuffer);
+		});
+	}
+
+	VkCommandBuffer UploadContext::BeginCommandBuffer()
+	{
+		Retire();
+
+		VkCommandBuffer commandBuffer;
+		if (m_FreeCommandBuffers.empty())
+		{
+			commandBuffer = GraphicsContext::CreateCommandBuffer(m_CommandPool);
+		}
+		else
+		{
+			commandBuffer = m_FreeCommandBuffers.back();
+			m_FreeCommandBuffers.pop_back();
+		}
+
+		VkCommandBufferBeginInfo beginInfo = {
+			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+			.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+		};
+
+		CheckVkResult(vkBeginCommandBuffer(commandBuffer, &beginInfo));
+
+		return commandBuffer;
+	}
+
+	bool UploadContext::AllocateStaging(size_t size, VkDeviceSize& offset)
+	{
+		Retire();
+
+		// Head and tail only meet when the ring is empty, so allocations never end exactly at the tail
+		size_t aligned = AlignUp(m_Head, m_Alignment);
+		if (m_Head >= m_Tail)
+		{
+			if (aligned + size <= m_RingSize)
+			{
+				offset = aligned;
+				m_Head = aligned + size;
+				return true;
+			}
+
+			if (size < m_Tail)
+			{
+				offset = 0;
+				m_Head = size;
+				return true;
+			}
+
+			return false;
+		}
+
+		if (aligned + size < m_Tail)
+		{
+			offset = aligned;
+			m_Head = aligned + size;
+			return true;
+		}
+
+		return false;
+	}
+
+	void UploadContext::WaitForOldestSubmission()
+	{
+		WaitImpl(m_InFlight.front().Value);
+		Retire();
+	}
+
+	uint64_t UploadContext::Submit(const UploadBatch* batch, VkCommandBuffer commandBuffer, std::vector<Ref<Buffer>>&& dedicatedBuffers,
+		std::vector<VkBuffer>&& buffers, std::vector<Image*>&& images)
+	{
+		CheckVkResult(vkEndCommandBuffer(commandBuffer));
+
+		const VkCommandBufferSubmitInfo commandBufferSubmitInfo = {
+			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO,
+			.commandBuffer = commandBuffer,
+		};
+
+		const VkSemaphoreSubmitInfo signalSemaphoreInfo = {
+			.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO,
+			.semaphore = m_Timeline,
+			.value = m_Value + 1,
+			.stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+		};
+
+		const VkSubmitInfo2 submitInfo = {
+			.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2,
+			.commandBufferInfoCount = 1,
+			.pCommandBufferInfos = &commandBufferSubmitInfo,
+			.signalSemaphoreInfoCount = 1,
+			.pSignalSemaphoreInfos = &signalSemaphoreInfo,
+		};
+
+		CheckVkResult(vkQueueSubmit2(m_Queue, 1, &submitInfo, VK_NULL_HANDLE));
+
+		m_Value++;
+		if (!buffers.empty() || !images.empty())
+			m_PendingAcquires.push_back({ m_Value, std::move(buffers), std::move(images) });
+
+		// Batches that staged outside of the ring free no ring space, the head may belong to the ring owner
+		if (m_RingOwner == batch)
+		{
+			m_SubmittedHead = m_Head;
+			m_RingOwner = nullptr;
+		}
+
+		m_InFlight.push_back({ m_Value, commandBuffer, m_SubmittedHead, std::move(dedicatedBuffers) });
+		m_SubmitCount++;
+
+		return m_Value;
+	}
+
+	void UploadContext::Retire()
+	{
+		if (m_InFlight.empty()) return;
+
+		uint64_t completed = GetCompletedValueImpl();
+		while (!m_InFlight.empty() && m_InFlight.front().Value <= completed)
+		{
+			auto& submission = m_InFlight.front();
+			m_Tail = submission.RingEnd;
+
+			CheckVkResult(vkResetCommandBuffer(submission.CommandBuffer, 0));
+			m_FreeCommandBuffers.push_back(submission.CommandBuffer);
+
+			m_InFlight.pop_front();
+		}
+
+		// Nothing left in flight or recording, start over at the beginning instead of wrapping later
+		if (m_InFlight.empty() && m_RingOwner == nullptr)
+		{
+			m_Head = 0;
+			m_Tail = 0;
+			m_SubmittedHead = 0;
+		}
+	}
+}
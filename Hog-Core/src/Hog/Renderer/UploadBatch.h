@@ -0,0 +1,170 @@
+#pragma once
+
+#include <volk.h>
+
+#include <atomic>
+#include <deque>
+#include <vector>
+
+#include "Hog/Core/Base.h"
+
+namespace Hog
+{
+	class Buffer;
+	class BufferRegion;
+	class Image;
+
+	// Completion of a submitted upload batch, the value the upload timeline reaches once the batch has executed
+	class UploadFuture
+	{
+	public:
+		UploadFuture() = default;
+		explicit UploadFuture(uint64_t value)
+			: m_Value(value) {}
+
+		bool IsReady() const;
+		void Wait() const;
+		uint64_t GetValue() const { return m_Value; }
+	private:
+		uint64_t m_Value = 0;
+	};
+
+	// Records many buffer and image uploads into one command buffer, staging their data in the upload context's ring
+	// instead of a buffer per write, and submits them together. Main thread only.
+	//
+	// The ring is freed in submission order, so only one batch at a time holds ring space that was not submitted yet.
+	// Batches recorded while another one does stage their data in buffers of their own, released with their submission.
+	//
+	// On devices with a transfer only queue family the batch runs there and the written resources are released to the
+	// graphics queue family. The renderer acquires them at the start of the first frame after the future is ready, so
+	// resources are only usable by frames that begin after that. Ownership moves for whole resources, which therefore
+	// should not be in use by the graphics queue while they are being written. Without such a family the batch runs on
+	// the graphics queue and later submissions see the uploads right away.
+	class UploadBatch
+	{
+	public:
+		UploadBatch() = default;
+		// Submits whatever was recorded and not submitted yet
+		~UploadBatch();
+
+		UploadBatch(UploadBatch const&) = delete;
+		void operator=(UploadBatch const&) = delete;
+
+		// Host visible buffers are written directly, the data is copied before the call returns either way
+		void WriteBuffer(Buffer& buffer, void* data, size_t size, size_t bufferOffset = 0);
+		void WriteBuffer(BufferRegion& region, void* data, size_t size, size_t regionOffset = 0);
+		// Uploads the first level and generates the rest, leaves the image in the shader read only layout
+		void WriteImage(Image& image, void* data, size_t size);
+
+		// Can be called again to submit the uploads recorded since, the future covers everything submitted so far
+		UploadFuture Submit();
+		bool IsEmpty() const { return m_CommandBuffer == VK_NULL_HANDLE; }
+	private:
+		// Offset of the data in the staging buffer it was copied into
+		VkDeviceSize Stage(void* data, size_t size, VkBuffer& stagingBuffer);
+		VkCommandBuffer GetCommandBuffer();
+	private:
+		VkCommandBuffer m_CommandBuffer = VK_NULL_HANDLE;
+		std::vector<Ref<Buffer>> m_DedicatedBuffers;
+		// Resources written on the transfer queue, released to the graphics queue when the batch is submitted
+		std::vector<VkBuffer> m_Buffers;
+		std::vector<Image*> m_Images;
+		uint64_t m_LastSubmission = 0;
+	};
+
+	// Owns what upload batches share: a persistently mapped staging ring, the command pool and the timeline semaphore
+	// every batch submission signals. Ring space and command buffers are recycled once the timeline passes them.
+	class UploadContext
+	{
+	public:
+		static UploadContext& Get()
+		{
+			static UploadContext instance;
+
+			return instance;
+		}
+
+		static void Initialize() { Get().InitializeImpl(); }
+		static void Deinitialize() { Get().DeinitializeImpl(); }
+
+		static uint64_t GetCompletedValue() { return Get().GetCompletedValueImpl(); }
+		static void Wait(uint64_t value) { Get().WaitImpl(value); }
+
+		// True when batches run on a transfer only queue family and hand their resources over to the graphics one
+		static bool UsesTransferQueue() { return Get().UsesTransferQueueImpl(); }
+		// Acquires the resources of every batch the transfer queue finished, generating the levels of their images.
+		// The host saw the batches complete, so the submission of the command buffer needs no semaphore wait.
+		static void RecordAcquires(VkCommandBuffer commandBuffer) { Get().RecordAcquiresImpl(commandBuffer); }
+		// Waits for every submitted batch and acquires its resources right away, for resources used as soon as the
+		// renderer starts instead of once they are ready. Blocks the calling thread.
+		static void AcquireAll() { Get().AcquireAllImpl(); }
+
+		// Number of batch submissions since the last call
+		static uint32_t ResetSubmitCount() { return Get().m_SubmitCount.exchange(0); }
+	public:
+		UploadContext(UploadContext const&) = delete;
+		void operator=(UploadContext const&) = delete;
+	private:
+		UploadContext() = default;
+
+		void InitializeImpl();
+		void DeinitializeImpl();
+		uint64_t GetCompletedValueImpl();
+		void WaitImpl(uint64_t value);
+		bool UsesTransferQueueImpl() const;
+		void RecordAcquiresImpl(VkCommandBuffer commandBuffer);
+		void AcquireAllImpl();
+
+		VkCommandBuffer BeginCommandBuffer();
+		// Fails when the ring has no room left until earlier submissions finish
+		bool AllocateStaging(size_t size, VkDeviceSize& offset);
+		// True when the batch can stage its data in the ring, which no other batch holds unsubmitted space of
+		bool CanStageInRing(const UploadBatch* batch) const { return m_RingOwner == nullptr || m_RingOwner == batch; }
+		bool HasSubmissionsInFlight() const { return !m_InFlight.empty(); }
+		void WaitForOldestSubmission();
+		uint64_t Submit(const UploadBatch* batch, VkCommandBuffer commandBuffer, std::vector<Ref<Buffer>>&& dedicatedBuffers,
+			std::vector<VkBuffer>&& buffers, std::vector<Image*>&& images);
+		void Retire();
+	private:
+		struct Submission
+		{
+			uint64_t Value;
+			VkCommandBuffer CommandBuffer;
+			// Ring space before this offset is free once the submission is done
+			size_t RingEnd;
+			std::vector<Ref<Buffer>> DedicatedBuffers;
+		};
+
+		// Resources of a transfer queue batch waiting for the graphics queue to take them over. Images have to stay
+		// alive until then, their levels are generated when they are acquired.
+		struct Acquire
+		{
+			uint64_t Value;
+			std::vector<VkBuffer> Buffers;
+			std::vector<Image*> Images;
+		};
+
+		Ref<Buffer> m_Ring;
+		size_t m_RingSize = 0;
+		size_t m_Head = 0;
+		size_t m_Tail = 0;
+		// Head at the last submission that staged in the ring, space after it belongs to the ring owner
+		size_t m_SubmittedHead = 0;
+		// Batch that is still recording and staged data in the ring since the last submission
+		const UploadBatch* m_RingOwner = nullptr;
+		size_t m_Alignment = 16;
+
+		VkQueue m_Queue = VK_NULL_HANDLE;
+		uint32_t m_QueueFamily = VK_QUEUE_FAMILY_IGNORED;
+		VkCommandPool m_CommandPool = VK_NULL_HANDLE;
+		std::vector<VkCommandBuffer> m_FreeCommandBuffers;
+
+		VkSemaphore m_Timeline = VK_NULL_HANDLE;
+		uint64_t m_Value = 0;
+		std::deque<Submission> m_InFlight;
+		std::deque<Acquire> m_PendingAcquires;
+		std::atomic<uint32_t> m_SubmitCount = 0;
+
+		friend class UploadBatch;
+	};
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstdint>
+#include <iterator>
+#include <map>
+#include <optional>
+
+namespace Hog
+{
+	namespace Util
+	{
+		// Hands out ranges of a fixed capacity, in whatever unit the caller counts in. Free ranges are kept sorted by
+		// offset, allocations take the first one that is large enough and freed ranges merge with their neighbours.
+		class FreeListAllocator
+		{
+		public:
+			FreeListAllocator(uint64_t capacity = 0) { Reset(capacity); }
+
+			void Reset(uint64_t capacity)
+			{
+				m_FreeRanges.clear();
+				if (capacity) m_FreeRanges[0] = capacity;
+				m_Capacity = capacity;
+				m_Used = 0;
+			}
+
+			// The offset is a multiple of the alignment, whatever the range skips to get there stays free
+			std::optional<uint64_t> Allocate(uint64_t size, uint64_t alignment = 1)
+			{
+				if (size == 0) return std::nullopt;
+
+				for (auto it = m_FreeRanges.begin(); it != m_FreeRanges.end(); ++it)
+				{
+					uint64_t start = it->first;
+					uint64_t end = it->first + it->second;
+					uint64_t offset = (start + alignment - 1) / alignment * alignment;
+					if (offset + size > end) continue;
+
+					m_FreeRanges.erase(it);
+
+					if (offset > start) m_FreeRanges[start] = offset - start;
+					if (offset + size < end) m_FreeRanges[offset + size] = end - offset - size;
+
+					m_Used += size;
+					return offset;
+				}
+
+				return std::nullopt;
+			}
+
+			void Free(uint64_t offset, uint64_t size)
+			{
+				if (size == 0) return;
+
+				m_Used -= size;
+
+				auto next = m_FreeRanges.lower_bound(offset);
+				if (next != m_FreeRanges.end() && offset + size == next->first)
+				{
+					size += next->second;
+					next = m_FreeRanges.erase(next);
+				}
+
+				if (next != m_FreeRanges.begin())
+				{
+					auto previous = std::prev(next);
+					if (previous->first + previous->second == offset)
+					{
+						previous->second += size;
+						return;
+					}
+				}
+
+				m_FreeRanges[offset] = size;
+			}
+
+			uint64_t GetCapacity() const { return m_Capacity; }
+			uint64_t GetUsed() const { return m_Used; }
+			size_t GetFreeRangeCount() const { return m_FreeRanges.size(); }
+		private:
+			// Offset to size of every free range
+			std::map<uint64_t, uint64_t> m_FreeRanges;
+			uint64_t m_Capacity = 0;
+			uint64_t m_Used = 0;
+		};
+	}
+}
@@ -46,11 +46,14 @@ namespace Hog
 				}
 			}
 
+			// Every image and mesh upload of the file goes out in a single submission at the end
+			UploadBatch batch;
+
 			std::vector<Ref<Image>> images(data->images_count);
 
 			for (int i = 0; i < data->images_count; i++)
 			{
-				images[i] = Image::LoadFromFile(data->images[i].uri);
+				images[i] = Image::LoadFromFile(data->images[i].uri, batch);
 			}
 
 			auto initialSize = textures.size();
@@ -97,13 +100,11 @@ namespace Hog
 					case 10497: type.AddressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT; break;
 				}
 
-				Ref<Texture> textureRef = Texture::Create(images[texture->image - data->images], type);
-				textureRef->SetGPUIndex(initialSize + i);
-
-				textures.push_back(textureRef);
+				textures.push_back(Texture::Create(images[texture->image - data->images], type));
 			}
 
-			materialBuffer = Buffer::Create(BufferDescription::Defaults::UniformBuffer, sizeof(MaterialGPUData) * data->materials_count);
+			// Shaders find the materials through the buffer's index in the bindless heap
+			materialBuffer = Buffer::Create(BufferDescription::Defaults::StorageBuffer, sizeof(MaterialGPUData) * data->materials_count);
 			size_t offset = 0;
 
 			for (int i = 0; i < data->materials_count; i++)
@@ -118,12 +119,12 @@ namespace Hog
 
 				if (material->pbr_metallic_roughness.base_color_texture.texture)
 				{
-					matData.DiffuseTexture = textures[material->pbr_metallic_roughness.base_color_texture.texture - data->textures];
+					matData.DiffuseTexture = textures[initialSize + (material->pbr_metallic_roughness.base_color_texture.texture - data->textures)];
 				}
 
 				if (material->normal_texture.texture)
 				{
-					matData.BumpMap = textures[material->normal_texture.texture - data->textures];
+					matData.BumpMap = textures[initialSize + (material->normal_texture.texture - data->textures)];
 				}
 
 				materials.push_back(Material::Create(material->name, matData));
@@ -135,6 +136,9 @@ namespace Hog
 			lightBuffer = Buffer::Create(BufferDescription::Defaults::UniformBuffer, sizeof(LightData) * data->lights_count);
 			size_t lightOffset = 0;
 
+			// Meshes already created for a glTF mesh, the opaque one followed by the blended one
+			std::unordered_map<const cgltf_mesh*, std::array<Ref<Mesh>, 2>> loadedMeshes;
+
 			for (int i = 0; i < data->nodes_count; ++i)
 			{
 				const auto node = &(data->nodes[i]);
@@ -177,103 +181,133 @@ namespace Hog
 				if (node->mesh)
 				{
 					const auto mesh = node->mesh;
-					for (int j = 0; j < mesh->primitives_count; ++j)
-					{
-						const auto primitive = &(mesh->primitives[j]);
 
-						auto nodeMesh = Mesh::Create(node->name);
-						if (primitive->material->alpha_mode == cgltf_alpha_mode_opaque)
+					// Nodes referencing a mesh that was loaded already become instances of it
+					auto loaded = loadedMeshes.find(mesh);
+					if (loaded != loadedMeshes.end())
+					{
+						for (const auto& instancedMesh : loaded->second)
 						{
-							opaque.push_back(nodeMesh);
+							if (instancedMesh) instancedMesh->AddInstance(modelMat);
 						}
-						else
+					}
+					else
+					{
+						// Blended primitives are drawn by a different stage, so they get a mesh of their own
+						std::array<Ref<Mesh>, 2> meshes;
+						for (int j = 0; j < mesh->primitives_count; ++j)
 						{
-							transparent.push_back(nodeMesh);
-						}
-
-						std::vector<uint16_t> indexData;
-						std::vector<Vertex> vertexData;
+							const auto primitive = &(mesh->primitives[j]);
 
-						indexData.resize(primitive->indices->count);
-						for (int z = 0; z < primitive->indices->count; z += 3)
-						{
-							if (options.SwapFrontFace)
+							bool isOpaque = primitive->material->alpha_mode == cgltf_alpha_mode_opaque;
+							auto& nodeMesh = meshes[isOpaque ? 0 : 1];
+							if (!nodeMesh)
 							{
-								indexData[z + 2] = static_cast<uint16_t>(cgltf_accessor_read_index(primitive->indices, z));
-								indexData[z + 1] = static_cast<uint16_t>(cgltf_accessor_read_index(primitive->indices, z + 1));
-								indexData[z + 0] = static_cast<uint16_t>(cgltf_accessor_read_index(primitive->indices, z + 2));
+								nodeMesh = Mesh::Create(mesh->name ? mesh->name : "");
+								(isOpaque ? opaque : transparent).push_back(nodeMesh);
 							}
-							else
-							{
-								indexData[z + 0] = static_cast<uint16_t>(cgltf_accessor_read_index(primitive->indices, z));
-								indexData[z + 1] = static_cast<uint16_t>(cgltf_accessor_read_index(primitive->indices, z + 1));
-								indexData[z + 2] = static_cast<uint16_t>(cgltf_accessor_read_index(primitive->indices, z + 2));
-							}
-						}
 
-						vertexData.resize(primitive->attributes->data->count);
-						std::vector<glm::vec3> positions;
-						std::vector<glm::vec3> normals;
-						std::vector<glm::vec2> texcoords;
-						std::vector<glm::vec4> tangent;
-						for (int z = 0; z < primitive->attributes_count; ++z)
-						{
-							const auto attribute = &(primitive->attributes[z]);
+							// The primitive picks the index width it stores, so large primitives keep their 32 bit indices
+							std::vector<uint32_t> indexData;
+							std::vector<Vertex> vertexData;
 
-							switch (attribute->type)
+							indexData.resize(primitive->indices->count);
+							for (int z = 0; z < primitive->indices->count; z += 3)
 							{
-							case cgltf_attribute_type_position:
-							{
-								cgltf_size count = cgltf_accessor_unpack_floats(attribute->data, nullptr, 0);
-
-								positions.resize(count / 3);
-
-								cgltf_accessor_unpack_floats(attribute->data, reinterpret_cast<cgltf_float*>(positions.data()), count);
-							}break;
-							case cgltf_attribute_type_normal:
-							{
-								cgltf_size count = cgltf_accessor_unpack_floats(attribute->data, nullptr, 0);
-
-								normals.resize(count / 3);
+								if (options.SwapFrontFace)
+								{
+									indexData[z + 2] = static_cast<uint32_t>(cgltf_accessor_read_index(primitive->indices, z));
+									indexData[z + 1] = static_cast<uint32_t>(cgltf_accessor_read_index(primitive->indices, z + 1));
+									indexData[z + 0] = static_cast<uint32_t>(cgltf_accessor_read_index(primitive->indices, z + 2));
+								}
+								else
+								{
+									indexData[z + 0] = static_cast<uint32_t>(cgltf_accessor_read_index(primitive->indices, z));
+									indexData[z + 1] = static_cast<uint32_t>(cgltf_accessor_read_index(primitive->indices, z + 1));
+									indexData[z + 2] = static_cast<uint32_t>(cgltf_accessor_read_index(primitive->indices, z + 2));
+								}
+							}
 
-								cgltf_accessor_unpack_floats(attribute->data, reinterpret_cast<cgltf_float*>(normals.data()), count);
-							}break;
-							case cgltf_attribute_type_texcoord:
+							vertexData.resize(primitive->attributes->data->count);
+							std::vector<glm::vec3> positions;
+							std::vector<glm::vec3> normals;
+							std::vector<glm::vec2> texcoords;
+							std::vector<glm::vec4> tangent;
+							std::optional<Math::BoundingBox> bounds;
+							for (int z = 0; z < primitive->attributes_count; ++z)
 							{
-								cgltf_size count = cgltf_accessor_unpack_floats(attribute->data, nullptr, 0);
+								const auto attribute = &(primitive->attributes[z]);
+
+								switch (attribute->type)
+								{
+								case cgltf_attribute_type_position:
+								{
+									cgltf_size count = cgltf_accessor_unpack_floats(attribute->data, nullptr, 0);
+
+									positions.resize(count / 3);
+
+									cgltf_accessor_unpack_floats(attribute->data, reinterpret_cast<cgltf_float*>(positions.data()), count);
+
+									// glTF requires the bounds of positions, the primitive only computes them when a file leaves them out.
+									// Unpacking handles the integer positions KHR_mesh_quantization allows. Normalized ones get their
+									// bounds computed from the unpacked values instead of relying on the space the stored ones are in.
+									if (attribute->data->has_min && attribute->data->has_max && !attribute->data->normalized)
+									{
+										const cgltf_float* min = attribute->data->min;
+										const cgltf_float* max = attribute->data->max;
+										bounds = Math::BoundingBox{ glm::vec3(min[0], min[1], min[2]), glm::vec3(max[0], max[1], max[2]) };
+									}
+								}break;
+								case cgltf_attribute_type_normal:
+								{
+									cgltf_size count = cgltf_accessor_unpack_floats(attribute->data, nullptr, 0);
+
+									normals.resize(count / 3);
+
+									cgltf_accessor_unpack_floats(attribute->data, reinterpret_cast<cgltf_float*>(normals.data()), count);
+								}break;
+								case cgltf_attribute_type_texcoord:
+								{
+									cgltf_size count = cgltf_accessor_unpack_floats(attribute->data, nullptr, 0);
+
+									texcoords.resize(count / 2);
+
+									cgltf_accessor_unpack_floats(attribute->data, reinterpret_cast<cgltf_float*>(texcoords.data()), count);
+								}break;
+								case cgltf_attribute_type_tangent:
+								{
+									cgltf_size count = cgltf_accessor_unpack_floats(attribute->data, nullptr, 0);
+
+									tangent.resize(count / 4);
+
+									cgltf_accessor_unpack_floats(attribute->data, reinterpret_cast<cgltf_float*>(tangent.data()), count);
+								}break;
+								default: break;
+								}
+							}
 
-								texcoords.resize(count / 2);
+							int32_t materialIndex = primitive->material ? materials[primitive->material - data->materials]->GetGPUIndex() : -1;
 
-								cgltf_accessor_unpack_floats(attribute->data, reinterpret_cast<cgltf_float*>(texcoords.data()), count);
-							}break;
-							case cgltf_attribute_type_tangent:
+							for (int z = 0; z < vertexData.size(); ++z)
 							{
-								cgltf_size count = cgltf_accessor_unpack_floats(attribute->data, nullptr, 0);
-
-								tangent.resize(count / 4);
-
-								cgltf_accessor_unpack_floats(attribute->data, reinterpret_cast<cgltf_float*>(tangent.data()), count);
-							}break;
-							default: break;
+								vertexData[z].Position = positions[z];
+								vertexData[z].Normal = normals[z];
+								vertexData[z].TexCoords = texcoords[z];
+								vertexData[z].Tangent = tangent[z];
 							}
+
+							nodeMesh->AddPrimitive(vertexData, indexData, materialIndex, bounds);
 						}
 
-						for (int z = 0; z < vertexData.size(); ++z)
+						for (const auto& nodeMesh : meshes)
 						{
-							vertexData[z].Position = positions[z];
-							vertexData[z].Normal = normals[z];
-							vertexData[z].TexCoords = texcoords[z];
-							vertexData[z].Tangent = tangent[z];
+							if (!nodeMesh) continue;
 
-							if (primitive->material)
-							{
-								vertexData[z].MaterialIndex = materials[primitive->material - data->materials]->GetGPUIndex();
-							}
+							nodeMesh->Build(batch);
+							nodeMesh->SetModelMatrix(modelMat);
 						}
 
-						nodeMesh->AddPrimitive(vertexData, indexData);
-						nodeMesh->Build();
-						nodeMesh->SetModelMatrix(modelMat);
+						loadedMeshes[mesh] = meshes;
 					}
 				}
 
@@ -372,6 +406,8 @@ namespace Hog
 				}
 			}
 
+			batch.Submit();
+
 			std::filesystem::current_path(currentPath);
 			cgltf_free(data);
 			return true;
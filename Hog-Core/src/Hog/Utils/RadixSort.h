@@ -0,0 +1,48 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+namespace Hog
+{
+	namespace Util
+	{
+		// Stable least significant digit radix sort on a 64 bit key, one byte per pass. Passes over bytes that
+		// are the same for every item are skipped, so keys that only use a few of their bits sort in a few passes.
+		// scratch is resized as needed and can be kept around to avoid reallocating it every time.
+		template<typename T, typename KeyFunction>
+		void RadixSort(std::vector<T>& items, std::vector<T>& scratch, KeyFunction key)
+		{
+			if (items.size() < 2) return;
+
+			scratch.resize(items.size());
+
+			for (uint32_t shift = 0; shift < 64; shift += 8)
+			{
+				std::array<size_t, 256> offsets = {};
+				for (const T& item : items)
+				{
+					offsets[(key(item) >> shift) & 0xFF]++;
+				}
+
+				if (offsets[(key(items.front()) >> shift) & 0xFF] == items.size()) continue;
+
+				size_t offset = 0;
+				for (auto& count : offsets)
+				{
+					size_t next = offset + count;
+					count = offset;
+					offset = next;
+				}
+
+				for (const T& item : items)
+				{
+					scratch[offsets[(key(item) >> shift) & 0xFF]++] = item;
+				}
+
+				items.swap(scratch);
+			}
+		}
+	}
+}